@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "tug.h"
+#include "tuglib.h"
+
+// substring search over a synthetic access log, every kernel against the
+// memchr loop on the same input; build and run with ./bench
+
+#define LOG_SIZE (8 << 20)
+#define RUNS 15
+
+typedef struct {
+	const char* name;
+	tuglib_Finder find;
+} Kernel;
+
+static uint64_t seed = 0x2545f4914f6cdd1dULL;
+
+static uint32_t rnd(void) {
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return (uint32_t)(seed >> 32);
+}
+
+// fixed seed, so every run and every machine searches the same bytes
+static char* make_log(size_t size) {
+	static const char* methods[] = {"GET", "POST", "PUT", "DELETE"};
+	static const char* paths[] = {"/api/v1/users", "/api/v1/orders", "/static/app.js", "/login", "/health"};
+	static const char* levels[] = {"info", "info", "info", "warn", "error"};
+
+	char* log = malloc(size + 256);
+	size_t len = 0;
+	while (len < size) {
+		len += (size_t)snprintf(log + len, 256, "10.0.%u.%u - [18/Oct/2026:%02u:%02u:%02u] \"%s %s?user_id=%u\" %u %u level=%s\n",
+			rnd() % 256, rnd() % 256, rnd() % 24, rnd() % 60, rnd() % 60,
+			methods[rnd() % 4], paths[rnd() % 5], rnd() % 100000,
+			200 + rnd() % 4 * 100, rnd() % 65536, levels[rnd() % 5]);
+	}
+
+	return log;
+}
+
+static double now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// counts non-overlapping matches the way str.find with `all` walks the string
+static size_t count_all(tuglib_Finder find, const char* hay, size_t len, const char* needle) {
+	size_t needle_len = strlen(needle);
+	const char* end = hay + len;
+	size_t count = 0;
+	const char* pos;
+	while ((pos = find(hay, (size_t)(end - hay), needle, needle_len)) != NULL) {
+		count++;
+		hay = pos + needle_len;
+	}
+
+	return count;
+}
+
+static double best_ms(tuglib_Finder find, const char* hay, size_t len, const char* needle, size_t* count) {
+	double best = 1e30;
+	for (int i = 0; i < RUNS; i++) {
+		double start = now_ms();
+		*count = count_all(find, hay, len, needle);
+		double took = now_ms() - start;
+		if (took < best) best = took;
+	}
+
+	return best;
+}
+
+int main(void) {
+	char* log = make_log(LOG_SIZE);
+	size_t len = strlen(log);
+
+	Kernel kernels[] = {
+		{"scalar", tuglib_memfind_scalar},
+		#ifdef TUGLIB_X86
+		{"sse2", tuglib_memfind_sse2},
+		{"avx2", tuglib_memfind_avx2},
+		#endif
+		{"memfind", tuglib_memfind},
+	};
+	size_t kernel_count = sizeof(kernels) / sizeof(kernels[0]);
+
+	// common first byte but absent, frequent matches, sparse matches, rare first byte
+	const char* needles[] = {"request_failed", "error", "user_id=", "zzzz"};
+
+	printf("%zu bytes, best of %d runs (ms)\n\n%-16s", len, RUNS, "");
+	for (size_t k = 0; k < kernel_count; k++) {
+		if (strcmp(kernels[k].name, "avx2") == 0 && !__builtin_cpu_supports("avx2")) continue;
+		printf("%10s", kernels[k].name);
+	}
+	printf("%10s\n", "matches");
+
+	for (size_t n = 0; n < sizeof(needles) / sizeof(needles[0]); n++) {
+		printf("%-16s", needles[n]);
+		size_t count = 0;
+		for (size_t k = 0; k < kernel_count; k++) {
+			if (strcmp(kernels[k].name, "avx2") == 0 && !__builtin_cpu_supports("avx2")) continue;
+			printf("%10.2f", best_ms(kernels[k].find, log, len, needles[n], &count));
+		}
+		printf("%10zu\n", count);
+	}
+
+	free(log);
+	return 0;
+}
@@ -26,6 +26,7 @@
 #define VARMAPENTRY_POOL_LIMIT 256
 #define VECTOR_POOL_LIMIT 256
 #define OBJ_POOL_LIMIT 4096
+#define FRAME_POOL_LIMIT 256
 
 // Garbage collector
 #define TUG_TARGET_UNTIL 0.6
@@ -100,6 +101,7 @@ static char ch;
 static int tkind;
 static size_t tln;
 static char* tstr;
+static size_t tlen;
 static double tnum;
 
 static size_t ldepth;
@@ -114,13 +116,14 @@ enum {
 	WHILE, FOR, IN, DO,
 	BREAK, CONTINUE,
 	FUNC, RETURN, END,
+	STRUCT,
 
 	LPAREN, RPAREN,
 	LBRACK, RBRACK,
 	LCURLY, RCURLY,
 
 	LOCAL,
-	ASSIGN, DOT, COMMA,
+	ASSIGN, DOT, COMMA, COLON,
 
 	POS, NEG,
 
@@ -131,10 +134,15 @@ enum {
 	#endif
 
 	FUNCDEF, FUNCCALL,
-	TUPLE, TABLE, INDEX, SETINDEX,
-	ITER_STR, ITER_TABLE,
+	TUPLE, TABLE, INDEX, SETINDEX, SLICE,
+	ITER_STR, ITER_TABLE, ITER_UTF8, ITER_RANGE,
 	LIST, ITER_LIST,
+	F64ARRAY, I64ARRAY, ITER_ARRAY,
 	USERDATA,
+	MAP, ITER_MAP,
+	RECORD,
+	BUFFER,
+	MULTRET,
 };
 
 typedef struct Node Node;
@@ -168,6 +176,136 @@ static inline void ladv(void) {
 #define lpeek() (idx + 1 >= len ? '\0' : text[idx + 1])
 #define streq(__s1, __s2) (strcmp((__s1), (__s2)) == 0)
 
+static const double num_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static int num_hexdigit(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+static size_t num_word(const char* str, size_t len, const char* word) {
+	size_t n = strlen(word);
+	if (len < n) return 0;
+	for (size_t i = 0; i < n; i++) {
+		if (tolower((unsigned char)str[i]) != word[i]) return 0;
+	}
+
+	return n;
+}
+
+// parses the number `str` starts with in place and returns how many bytes it took,
+// 0 when there is none. Decimals with up to 19 significant digits and a power of ten
+// that is exact as a double take Clinger's fast path, which covers nearly everything
+// real data has; the rest go through strtod on a stack copy of the token
+static size_t num_parse(const char* str, size_t len, double* out) {
+	size_t i = 0;
+	int neg = 0;
+	if (i < len && (str[i] == '+' || str[i] == '-')) neg = str[i++] == '-';
+
+	if (i + 1 < len && str[i] == '0' && (str[i + 1] == 'x' || str[i + 1] == 'X') && i + 2 < len && num_hexdigit(str[i + 2]) >= 0) {
+		i += 2;
+		uint64_t mant = 0;
+		double value = 0;
+		int big = 0;
+		for (int d; i < len && (d = num_hexdigit(str[i])) >= 0; i++) {
+			if (!big && mant >> 60) {
+				big = 1;
+				value = (double)mant;
+			}
+			if (big) value = value * 16 + d;
+			else mant = mant * 16 + (uint64_t)d;
+		}
+
+		if (!big) value = (double)mant;
+		*out = neg ? -value : value;
+		return i;
+	}
+
+	size_t n = 0;
+	if (i < len && (str[i] | 0x20) == 'i' && ((n = num_word(str + i, len - i, "infinity")) || (n = num_word(str + i, len - i, "inf")))) {
+		*out = neg ? -HUGE_VAL : HUGE_VAL;
+		return i + n;
+	}
+	if (i < len && (str[i] | 0x20) == 'n' && (n = num_word(str + i, len - i, "nan"))) {
+		*out = neg ? -NAN : NAN;
+		return i + n;
+	}
+
+	size_t start = i;
+	uint64_t mant = 0;
+	int digits = 0;
+	int any = 0;
+	int truncated = 0;
+	long exp10 = 0;
+	for (; i < len && str[i] >= '0' && str[i] <= '9'; i++) {
+		any = 1;
+		if (digits < 19) {
+			mant = mant * 10 + (uint64_t)(str[i] - '0');
+			if (mant) digits++;
+		} else {
+			exp10++;
+			if (str[i] != '0') truncated = 1;
+		}
+	}
+	if (i < len && str[i] == '.') {
+		size_t dot = i++;
+		for (; i < len && str[i] >= '0' && str[i] <= '9'; i++) {
+			any = 1;
+			if (digits < 19) {
+				mant = mant * 10 + (uint64_t)(str[i] - '0');
+				if (mant) digits++;
+				exp10--;
+			} else if (str[i] != '0') truncated = 1;
+		}
+		if (!any) i = dot;
+	}
+	if (!any) return 0;
+
+	if (i < len && (str[i] == 'e' || str[i] == 'E')) {
+		size_t j = i + 1;
+		int exp_neg = 0;
+		if (j < len && (str[j] == '+' || str[j] == '-')) exp_neg = str[j++] == '-';
+		if (j < len && str[j] >= '0' && str[j] <= '9') {
+			long exp = 0;
+			for (; j < len && str[j] >= '0' && str[j] <= '9'; j++) {
+				if (exp < 100000) exp = exp * 10 + (str[j] - '0');
+			}
+			exp10 += exp_neg ? -exp : exp;
+			i = j;
+		}
+	}
+
+	if (!truncated && mant <= (1ULL << 53)) {
+		double value = (double)mant;
+		int exact = 1;
+		if (mant == 0 || exp10 == 0);
+		else if (exp10 > 0 && exp10 <= 22) value *= num_pow10[exp10];
+		else if (exp10 < 0 && exp10 >= -22) value /= num_pow10[-exp10];
+		else exact = 0;
+
+		if (exact) {
+			*out = neg ? -value : value;
+			return i;
+		}
+	}
+
+	char buf[128];
+	size_t n_bytes = i - start;
+	char* copy = n_bytes < sizeof(buf) ? buf : malloc(n_bytes + 1);
+	memcpy(copy, str + start, n_bytes);
+	copy[n_bytes] = '\0';
+	double value = strtod(copy, NULL);
+	if (copy != buf) free(copy);
+
+	*out = neg ? -value : value;
+	return i;
+}
+
 static int ltok(void) {
 	gc_free(tstr);
 	tstr = NULL;
@@ -180,29 +318,9 @@ static int ltok(void) {
 	}
 
 	if (isdigit(ch) || (ch == '.' && isdigit(lpeek()))) {
-		int dot = ch == '.';
-		size_t start = idx;
-
-		while (isdigit(ch) || ch == '.') {
-			if (ch == '.') {
-				if (dot) break;
-				dot++;
-			}
-			ladv();
-		}
-
-		size_t len = idx - start;
-		char* s = gc_malloc(len + 1);
-		memcpy(s, &text[start], len);
-		s[len] = '\0';
-
-		char* endptr;
-		tnum = strtod(s, &endptr);
-		if (*endptr != '\0') {
-			gc_free(s);
-			return perr("malformed number");
-		}
-		gc_free(s);
+		size_t n = num_parse(&text[idx], len - idx, &tnum);
+		for (size_t i = 0; i < n; i++) ladv();
+		if (isalnum(ch) || ch == '_') return perr("malformed number");
 
 		tkind = NUM;
 		return 0;
@@ -226,6 +344,17 @@ static int ltok(void) {
 					case '"': c = '\"'; break;
 					case 'n': c = '\n'; break;
 					case 't': c = '\t'; break;
+					case 'r': c = '\r'; break;
+					case '0': c = '\0'; break;
+					case 'x': {
+						int hex = 0;
+						for (int i = 0; i < 2; i++) {
+							ladv();
+							if (!isxdigit((unsigned char)ch)) return perr("malformed '\\x' escape");
+							hex = hex * 16 + (isdigit((unsigned char)ch) ? ch - '0' : tolower((unsigned char)ch) - 'a' + 10);
+						}
+						c = (char)hex;
+					} break;
 					default: return perr("invalid escape character '\\%c'", ch);
 				}
 			} else c = ch;
@@ -234,6 +363,7 @@ static int ltok(void) {
 			ladv();
 		}
 		tstr[len] = '\0';
+		tlen = len;
 
 		if (ch != del) return perr("unfinished string");
 		ladv();
@@ -269,6 +399,7 @@ static int ltok(void) {
 		else if (streq(tstr, "func")) tkind = FUNC;
 		else if (streq(tstr, "return")) tkind = RETURN;
 		else if (streq(tstr, "end")) tkind = END;
+		else if (streq(tstr, "struct")) tkind = STRUCT;
 
 		#if TUG_DEBUG
 
@@ -323,7 +454,7 @@ static int ltok(void) {
 			if (lpeek() == '=') {
 				ladv();
 				tkind = LOCAL;
-			} else return perr("unexpected symbol ':'");
+			} else tkind = COLON;
 		} break;
 		default: {
 			if (isprint((unsigned char)ch)) return perr("unexpected symbol '%c'", ch);
@@ -478,6 +609,166 @@ static inline void __vec_advfree(Vector* vec, void (*freefunc)(void*)) {
 // freeing vector and vector items using standard `free`
 #define vec_stdfree(__vec) vec_advfree((__vec), gc_free)
 
+// lists are growable ring buffers so both ends push and pop in O(1),
+// `head` is where index 0 lives and `cap` is a power of two; a slice is a
+// window on its parent's array, which they share until either is written to
+typedef struct {
+	tug_Object** items;
+	size_t head;
+	size_t count;
+	size_t cap;
+} List;
+
+#define list_slot(__l, __i) ((__l)->items[((__l)->head + (__i)) & ((__l)->cap - 1)])
+#define list_get(__l, __i) list_slot((__l), (__i))
+#define list_set(__l, __i, __v) (list_slot((__l), (__i)) = (__v))
+
+// a slice shorter than 1/16 of a parent above this size is copied instead of
+// keeping the whole parent's array alive
+#define LIST_VIEW_PIN 4096
+
+// the item array is preceded by the number of lists using it
+#define list_refs(__l) (((size_t*)(__l)->items)[-1])
+
+static tug_Object** list_alloc(size_t cap) {
+	size_t* refs = gc_malloc(sizeof(size_t) + cap * sizeof(tug_Object*));
+	*refs = 1;
+
+	return (tug_Object**)(refs + 1);
+}
+
+static void list_release(tug_Object** items) {
+	size_t* refs = (size_t*)items - 1;
+	if (--(*refs) == 0) gc_free(refs);
+}
+
+static List* list_create(size_t size) {
+	size_t cap = 8;
+	while (cap < size) cap *= 2;
+
+	List* list = gc_malloc(sizeof(List));
+	list->items = list_alloc(cap);
+	list->head = 0;
+	list->count = 0;
+	list->cap = cap;
+
+	return list;
+}
+
+static void list_free(List* list) {
+	list_release(list->items);
+	gc_free(list);
+}
+
+// moves the items into a fresh array of `cap` slots, unwrapped from index 0
+static void list_resize(List* list, size_t cap) {
+	tug_Object** items = list_alloc(cap);
+	size_t first = list->cap - list->head;
+	if (first >= list->count) memcpy(items, &list->items[list->head], list->count * sizeof(tug_Object*));
+	else {
+		memcpy(items, &list->items[list->head], first * sizeof(tug_Object*));
+		memcpy(&items[first], list->items, (list->count - first) * sizeof(tug_Object*));
+	}
+
+	list_release(list->items);
+	list->items = items;
+	list->head = 0;
+	list->cap = cap;
+}
+
+// anything that writes to a list calls this first, so a shared array is
+// copied out before it changes
+static inline void list_own(List* list) {
+	if (list_refs(list) == 1) return;
+
+	size_t cap = 8;
+	while (cap < list->count) cap *= 2;
+	list_resize(list, cap);
+}
+
+// the items from `start` to `end` as a new list sharing the array
+static List* list_view(List* list, size_t start, size_t end) {
+	size_t count = end - start;
+	if (count <= 8 || (list->count > LIST_VIEW_PIN && count < list->count / 16)) {
+		List* copy = list_create(count);
+		for (size_t i = 0; i < count; i++) {
+			copy->items[i] = list_get(list, start + i);
+		}
+		copy->count = count;
+		return copy;
+	}
+
+	List* view = gc_malloc(sizeof(List));
+	view->items = list->items;
+	view->head = (list->head + start) & (list->cap - 1);
+	view->count = count;
+	view->cap = list->cap;
+	list_refs(list)++;
+
+	return view;
+}
+
+static inline void list_grow(List* list) {
+	if (list->count == list->cap) list_resize(list, list->cap * 2);
+}
+
+static inline void list_shrink(List* list) {
+	if (list->cap > 8 && list->count < list->cap / 4) list_resize(list, list->cap / 2);
+}
+
+static void list_push(List* list, tug_Object* obj) {
+	list_own(list);
+	list_grow(list);
+	list_slot(list, list->count) = obj;
+	list->count++;
+}
+
+static void list_pushfront(List* list, tug_Object* obj) {
+	list_own(list);
+	list_grow(list);
+	list->head = (list->head - 1) & (list->cap - 1);
+	list->items[list->head] = obj;
+	list->count++;
+}
+
+// inserts before `idx`, shifting whichever side of it is shorter
+static void list_insert(List* list, size_t idx, tug_Object* obj) {
+	if (idx >= list->count) {
+		list_push(list, obj);
+		return;
+	}
+	if (idx == 0) {
+		list_pushfront(list, obj);
+		return;
+	}
+
+	list_own(list);
+	list_grow(list);
+	if (idx < list->count / 2) {
+		list->head = (list->head - 1) & (list->cap - 1);
+		for (size_t i = 0; i < idx; i++) list_slot(list, i) = list_slot(list, i + 1);
+	} else {
+		for (size_t i = list->count; i > idx; i--) list_slot(list, i) = list_slot(list, i - 1);
+	}
+	list_slot(list, idx) = obj;
+	list->count++;
+}
+
+static tug_Object* list_remove(List* list, size_t idx) {
+	list_own(list);
+	tug_Object* obj = list_slot(list, idx);
+	if (idx < list->count / 2) {
+		for (size_t i = idx; i > 0; i--) list_slot(list, i) = list_slot(list, i - 1);
+		list->head = (list->head + 1) & (list->cap - 1);
+	} else {
+		for (size_t i = idx; i + 1 < list->count; i++) list_slot(list, i) = list_slot(list, i + 1);
+	}
+	list->count--;
+	list_shrink(list);
+
+	return obj;
+}
+
 typedef struct Node {
 	int kind;
 	void* data;
@@ -521,15 +812,19 @@ static Node* node_unary(int kind, Node* right, size_t ln) {
 
 typedef struct {
 	char* str;
+	size_t len;
 } Node_Str;
 
-static Node* node_str(int kind, const char* str) {
+static Node* node_lstr(int kind, const char* str, size_t len) {
 	Node_Str* data = gc_malloc(sizeof(Node_Str));
-	data->str = gc_strdup(str);
+	data->str = memcpy(gc_malloc(len + 1), str, len + 1);
+	data->len = len;
 
 	return node_create(kind, data);
 }
 
+#define node_str(__kind, __str) node_lstr((__kind), (__str), strlen((__str)))
+
 typedef struct {
 	double num;
 } Node_Num;
@@ -641,12 +936,45 @@ static Node* node_funcdef(Vector* names, Vector* params, NodeBlock* block, size_
 	return node_create(FUNCDEF, funcdef);
 }
 
+typedef struct {
+	char* name;
+	Vector* fields;
+	size_t ln;
+} Node_Struct;
+
+static Node* node_struct(char* name, Vector* fields, size_t ln) {
+	Node_Struct* nstruct = gc_malloc(sizeof(Node_Struct));
+	nstruct->name = name;
+	nstruct->fields = fields;
+	nstruct->ln = ln;
+
+	return node_create(STRUCT, nstruct);
+}
+
 typedef struct {
 	Node* node;
 	Vector* values;
 	size_t ln;
 } Node_FuncCall;
 
+// `obj[start:end]`, either bound can be left out
+typedef struct {
+	Node* obj;
+	Node* start;
+	Node* end;
+	size_t ln;
+} Node_Slice;
+
+static Node* node_slice(Node* obj, Node* start, Node* end, size_t ln) {
+	Node_Slice* slice = gc_malloc(sizeof(Node_Slice));
+	slice->obj = obj;
+	slice->start = start;
+	slice->end = end;
+	slice->ln = ln;
+
+	return node_create(SLICE, slice);
+}
+
 static Node* node_funccall(Node* node, Vector* values, size_t ln) {
 	Node_FuncCall* funccall = gc_malloc(sizeof(Node_FuncCall));
 	funccall->node = node;
@@ -810,6 +1138,13 @@ static void node_free(Node* node) {
 			node_block_free(funcdef->block);
 		} break;
 
+		case STRUCT: {
+			Node_Struct* nstruct = (Node_Struct*)node->data;
+
+			gc_free(nstruct->name);
+			vec_stdfree(nstruct->fields);
+		} break;
+
 		case FUNCCALL: {
 			Node_FuncCall* funccall = (Node_FuncCall*)node->data;
 
@@ -817,6 +1152,13 @@ static void node_free(Node* node) {
 			vec_advfree(funccall->values, node_free);
 		} break;
 
+		case SLICE: {
+			Node_Slice* slice = (Node_Slice*)node->data;
+			node_free(slice->obj);
+			node_free(slice->start);
+			node_free(slice->end);
+		} break;
+
 		case LIST:
 		case RETURN: {
 			vec_advfree(node->data, node_free);
@@ -872,6 +1214,7 @@ static int node_isexpr(Node* node) {
 		case NAME:
 		case FUNCCALL:
 		case INDEX:
+		case SLICE:
 		case LIST:
 		return 1;
 		default:
@@ -884,7 +1227,7 @@ static int por(void);
 static NodeBlock* pblock(int elseif);
 static int pval(void) {
 	if (tkind == STR || tkind == NAME) {
-		node = node_str(tkind, (const char*)tstr);
+		node = tkind == STR ? node_lstr(STR, tstr, tlen) : node_str(NAME, (const char*)tstr);
 		return ltok();
 	} else if (tkind == NUM) {
 		node = node_num(tkind, tnum);
@@ -1006,7 +1349,11 @@ static int pval(void) {
 			return 1;
 		}
 		
+		// a loop around the function doesn't reach into its body
+		size_t outer = ldepth;
+		ldepth = 0;
 		NodeBlock* block = pblock(0);
+		ldepth = outer;
 		if (!block) {
 			vec_stdfree(params);
 			return 1;
@@ -1097,11 +1444,36 @@ static int pcall(void) {
 
 			left = node_funccall(left, values, ln);
 		} else if (kind == LBRACK) {
-			if (pexpr()) {
-				node_free(left);
-				return 1;
+			Node* start = NULL;
+			if (tkind != COLON) {
+				if (pexpr()) {
+					node_free(left);
+					return 1;
+				}
+				start = node;
+				node = NULL;
 			}
 
+			if (tkind == COLON) {
+				Node* end = NULL;
+				if (ltok()) {
+					node_free(start);
+					node_free(left);
+					return 1;
+				}
+				if (tkind != RBRACK) {
+					if (pexpr()) {
+						node_free(start);
+						node_free(left);
+						return 1;
+					}
+					end = node;
+					node = NULL;
+				}
+
+				left = node_slice(left, start, end, ln);
+			} else left = node_binop(INDEX, left, start, ln);
+
 			if (tkind != RBRACK) {
 				node_free(left);
 				return perr("expected ']'");
@@ -1109,8 +1481,6 @@ static int pcall(void) {
 				node_free(left);
 				return 1;
 			}
-
-			left = node_binop(INDEX, left, node, ln);
 		} else if (kind == DOT) {
 			if (tkind != NAME) {
 				node_free(left);
@@ -1411,13 +1781,61 @@ static int pstmt(void) {
 			goto __freeparams;
 		} else if (ltok()) goto __freeparams;
 
+		size_t outer = ldepth;
+		ldepth = 0;
 		NodeBlock* block = pblock(0);
+		ldepth = outer;
 		if (!block) goto __freeparams;
 
 		node = node_funcdef(names, params, block, ln);
 		return ltok();
 	}
 
+	if (tkind == STRUCT) {
+		size_t ln = tln;
+		if (ltok()) return 1;
+		else if (tkind != NAME) return perr("expected '<name>'");
+
+		char* name = gc_strdup(tstr);
+		Vector* fields = vec_create();
+		if (ltok()) goto __structerr;
+		else if (tkind != LCURLY) {
+			perr("expected '{'");
+			goto __structerr;
+		} else if (ltok()) goto __structerr;
+
+		while (tkind != RCURLY) {
+			if (tkind != NAME) {
+				perr("expected '<name>'");
+				goto __structerr;
+			}
+			for (size_t i = 0; i < vec_count(fields); i++) {
+				if (streq((char*)vec_get(fields, i), tstr)) {
+					perr("duplicate field '%s'", tstr);
+					goto __structerr;
+				}
+			}
+			vec_push(fields, gc_strdup(tstr));
+
+			if (ltok()) goto __structerr;
+			if (tkind == COMMA) {
+				if (ltok()) goto __structerr;
+			} else if (tkind != RCURLY) {
+				perr("expected ',' or '}'");
+				goto __structerr;
+			}
+		}
+
+		node = node_struct(name, fields, ln);
+		return ltok();
+
+		__structerr: {
+			gc_free(name);
+			vec_stdfree(fields);
+			return 1;
+		}
+	}
+
 	if (tkind == RETURN) {
 		if (ltok()) return 1;
 		if (tkind == END || tkind == ELSEIF || tkind == ELSE || tkind == EOF) {
@@ -1480,7 +1898,9 @@ static int pstmt(void) {
 		Node* obj = node;
 		node = NULL;
 
+		ldepth++;
 		NodeBlock* block = pblock(0);
+		ldepth--;
 		if (!block) {
 			node_free(obj);
 			goto __forerr;
@@ -1629,6 +2049,14 @@ static size_t emit_addr(size_t addr) {
 	return pos;
 }
 
+// length-prefixed and still NUL terminated
+static void emit_lstr(const char* str, size_t len) {
+	emit_addr(len);
+	ensure(len + 1);
+	memcpy(&main_bc->data[main_bc->size], str, len + 1);
+	main_bc->size += len + 1;
+}
+
 static size_t emit_jump(uint8_t op, size_t addr, uint8_t pback) {
 	ensure(sizeof(uint8_t) * 2 + sizeof(size_t));
 	emit_byte(op);
@@ -1649,40 +2077,6 @@ static void emit_bc(Bytecode* bc) {
 	main_bc->size += bc->size;
 }
 
-// used for small things like storing object kinds (types)
-typedef struct {
-	uint8_t* values;
-	size_t count;
-	size_t capacity;
-} ui8_array;
-
-static ui8_array* ui8_array_create(void) {
-	ui8_array* array = gc_malloc(sizeof(ui8_array));
-	array->count = 0;
-	array->capacity = 8;
-	array->values = gc_malloc(array->capacity * sizeof(uint8_t));
-
-	return array;
-}
-
-static void ui8_array_push(ui8_array* array, uint8_t value) {
-	if (array->count >= array->capacity) {
-		array->capacity *= 2;
-		array->values = gc_realloc(array, array->capacity * sizeof(uint8_t));
-	}
-
-	array->values[array->count++] = value;
-}
-
-static uint8_t ui8_array_get(ui8_array* array, size_t index) {
-	return array->values[index];
-}
-
-static void ui8_array_free(ui8_array* array) {
-	gc_free(array->values);
-	gc_free(array);
-}
-
 typedef struct {
 	size_t* poses;
 	size_t count;
@@ -1729,10 +2123,13 @@ typedef struct LoopContext {
 
 static LoopContext* loop_ctx;
 static size_t depth;
+// set while compiling a call whose every returned value is wanted
+static int call_multret;
 
 static inline void compiler_init(void) {
 	loop_ctx = NULL;
 	depth = 0;
+	call_multret = 0;
 }
 
 static void push_loop(size_t start) {
@@ -1767,10 +2164,12 @@ enum {
 	OP_PUSH_CLOSURE, OP_POP_CLOSURE,
 	OP_JUMPP,
 	OP_FUNCDEF, OP_CALL, OP_TUPLE,
-	OP_TABLE, OP_SETINDEX, OP_GETINDEX,
+	OP_TABLE, OP_SETINDEX, OP_GETINDEX, OP_SLICE,
 	OP_MULTIASSIGN,
 	OP_ITER, OP_NEXT,
+	OP_FORPREP, OP_FORLOOP,
 	OP_LIST,
+	OP_STRUCT, OP_GETFIELD,
 	OP_HALT,
 
 	#if TUG_DEBUG
@@ -1818,11 +2217,16 @@ const char* get_opname(uint8_t op) {
 		case OP_TABLE: return "OP_TABLE";
 		case OP_SETINDEX: return "OP_SETINDEX";
 		case OP_GETINDEX: return "OP_GETINDEX";
+		case OP_SLICE: return "OP_SLICE";
 		case OP_MULTIASSIGN: return "OP_MULTIASSIGN";
 		case OP_ITER: return "OP_ITER";
 		case OP_NEXT: return "OP_NEXT";
+		case OP_FORPREP: return "OP_FORPREP";
+		case OP_FORLOOP: return "OP_FORLOOP";
 		case OP_HALT: return "OP_HALT";
 		case OP_LIST: return "OP_LIST";
+		case OP_STRUCT: return "OP_STRUCT";
+		case OP_GETFIELD: return "OP_GETFIELD";
 	
 		#if TUG_DEBUG
 	
@@ -1847,6 +2251,29 @@ static void emit_closure(int i) {
 }
 
 static void compile_node(Node* node);
+// `for i in range(...)` with one to three bounds counts without an iterator when
+// `range` is still the builtin, gives the call or NULL for any other loop
+static Node_FuncCall* for_range(Node_For* nfor) {
+	Node* header = nfor->node;
+	if (vec_count(nfor->names) != 1 || header->kind != FUNCCALL) return NULL;
+
+	Node_FuncCall* call = (Node_FuncCall*)header->data;
+	if (call->node->kind != NAME || !streq(((Node_Str*)call->node->data)->str, "range")) return NULL;
+
+	size_t count = vec_count(call->values);
+	return count >= 1 && count <= 3 ? call : NULL;
+}
+
+// calls in a value list keep all of their results, they're spread in place
+static void compile_values(Vector* values) {
+	for (size_t i = 0; i < vec_count(values); i++) {
+		Node* value = vec_get(values, i);
+		call_multret = value->kind == FUNCCALL;
+		compile_node(value);
+		call_multret = 0;
+	}
+}
+
 static void compile_block(NodeBlock* block) {
 	for (size_t i = 0; i < block->count; i++) {
 		Node* node = block->nodes[i];
@@ -1867,9 +2294,13 @@ static void compile_node(Node* node) {
 			Node_Num* num = (Node_Num*)node->data;
 			emit_num(num->num);
 		} break;
-		case STR:
+		case STR: {
+			Node_Str* str = (Node_Str*)node->data;
+			emit_byte(OP_STR);
+			emit_lstr(str->str, str->len);
+		} break;
 		case NAME: {
-			emit_byte(node->kind == STR ? OP_STR : OP_VAR);
+			emit_byte(OP_VAR);
 
 			Node_Str* str = (Node_Str*)node->data;
 			emit_str((const char*)str->str);
@@ -1890,6 +2321,19 @@ static void compile_node(Node* node) {
 		case NE:
 		case INDEX: {
 			Node_BinOp* binop = (Node_BinOp*)node->data;
+			if (node->kind == INDEX && binop->o2->kind == STR) {
+				// constant keys carry an inline cache: shape id, slot, key object
+				compile_node(binop->o1);
+				emit_byte(OP_GETFIELD);
+				emit_addr(binop->ln);
+				emit_addr(0);
+				emit_addr(0);
+				emit_addr(0);
+				Node_Str* key = (Node_Str*)binop->o2->data;
+				emit_lstr(key->str, key->len);
+				break;
+			}
+
 			compile_node(binop->o1);
 			compile_node(binop->o2);
 
@@ -2029,7 +2473,7 @@ static void compile_node(Node* node) {
 
 		case CONTINUE: {
 			emit_byte(OP_JUMPP);
-			emit_addr(depth - loop_ctx->depth - 1);
+			emit_addr(depth - loop_ctx->depth);
 			emit_addr(loop_ctx->start);
 		} break;
 
@@ -2070,14 +2514,43 @@ static void compile_node(Node* node) {
 			}
 		} break;
 
+		case STRUCT: {
+			Node_Struct* nstruct = (Node_Struct*)node->data;
+
+			emit_byte(OP_STRUCT);
+			emit_str(nstruct->name);
+			emit_addr(vec_count(nstruct->fields));
+			vec_iter(nstruct->fields, emit_str);
+
+			emit_byte(OP_STORE);
+			emit_byte(1);
+			emit_addr(1);
+			emit_str(nstruct->name);
+		} break;
+
+		case SLICE: {
+			Node_Slice* slice = (Node_Slice*)node->data;
+			compile_node(slice->obj);
+			if (slice->start) compile_node(slice->start);
+			else emit_byte(OP_NIL);
+			if (slice->end) compile_node(slice->end);
+			else emit_byte(OP_NIL);
+
+			emit_byte(OP_SLICE);
+			emit_addr(slice->ln);
+		} break;
+
 		case FUNCCALL: {
 			Node_FuncCall* funccall = (Node_FuncCall*)node->data;
+			uint8_t multret = call_multret;
+			call_multret = 0;
 			compile_node(funccall->node);
 			vec_iter(funccall->values, compile_node);
 
 			emit_byte(OP_CALL);
 			emit_addr(vec_count(funccall->values));
 			emit_addr(funccall->ln);
+			emit_byte(multret);
 		} break;
 
 		case RETURN: {
@@ -2087,12 +2560,8 @@ static void compile_node(Node* node) {
 				Vector* values = (Vector*)node->data;
 				size_t val_count = vec_count(values);
 
-				if (val_count == 1) {
-					compile_node(vec_get(values, 0));
-				} else {
-					for (size_t i = 0; i < val_count; i++) {
-						compile_node(vec_get(values, i));
-					}
+				compile_values(values);
+				if (val_count > 1) {
 					emit_byte(OP_TUPLE);
 					emit_addr(val_count);
 				}
@@ -2139,14 +2608,20 @@ static void compile_node(Node* node) {
 				}
 			}
 
-			vec_iter(assignment->values, compile_node);
+			compile_values(assignment->values);
+
+			size_t index_count = 0;
+			for (size_t i = 0; i < vec_count(assigns); i++) {
+				index_count += ((Assign*)vec_get(assigns, i))->kind == SETINDEX;
+			}
 
 			emit_byte(OP_MULTIASSIGN);
 			emit_addr(assignment->ln);
 			emit_byte(assignment->local);
 			emit_addr(vec_count(assignment->values));
 			emit_addr(vec_count(assigns));
-			for (size_t i = vec_count(assigns); i-- > 0;) {
+			emit_addr(index_count);
+			for (size_t i = 0; i < vec_count(assigns); i++) {
 				Assign* assign = vec_get(assigns, i);
 				if (assign->kind == ASSIGN) {
 					emit_byte(1);
@@ -2160,6 +2635,46 @@ static void compile_node(Node* node) {
 		case FOR: {
 			Node_For* nfor = (Node_For*)node->data;
 
+			Node_FuncCall* call = for_range(nfor);
+			if (call) {
+				size_t count = vec_count(call->values);
+				compile_node(call->node);
+				vec_iter(call->values, compile_node);
+
+				emit_closure(1);
+				emit_byte(OP_FORPREP);
+				emit_addr(nfor->ln);
+				emit_addr(count);
+				size_t ppos = emit_addr(0);
+
+				// any other `range` is called and iterated the way every other header is
+				emit_byte(OP_CALL);
+				emit_addr(count);
+				emit_addr(call->ln);
+				emit_byte(0);
+				emit_byte(OP_ITER);
+				emit_addr(nfor->ln);
+
+				patch_addr(ppos, main_bc->size);
+				push_loop(main_bc->size);
+				emit_byte(OP_FORLOOP);
+				emit_str(vec_get(nfor->names, 0));
+				size_t upos = emit_addr(0);
+
+				compile_block(nfor->block);
+
+				emit_byte(OP_JUMP);
+				emit_addr(loop_ctx->start);
+
+				patch_addr(upos, main_bc->size);
+				pop_loop(main_bc->size);
+				emit_byte(OP_POP);
+				emit_addr(1);
+
+				emit_closure(0);
+				break;
+			}
+
 			compile_node(nfor->node);
 			
 			emit_closure(1);
@@ -2181,6 +2696,8 @@ static void compile_node(Node* node) {
 
 			patch_addr(upos, main_bc->size);
 			pop_loop(main_bc->size);
+			emit_byte(OP_POP);
+			emit_addr(1);
 
 			emit_closure(0);
 		} break;
@@ -2276,7 +2793,11 @@ int bcreader_read(BCReader* reader) {
 			double num = bcreader_num(reader);
 			printf("%.17g", num);
 		} break;
-		case OP_STR: 
+		case OP_STR: {
+			size_t len = bcreader_addr(reader);
+			const char* str = bcreader_str(reader);
+			printf("len:%zu |%s|", len, str);
+		} break;
 		case OP_VAR: {
 			const char* str = bcreader_str(reader);
 			printf("|%s|", str);
@@ -2294,6 +2815,7 @@ int bcreader_read(BCReader* reader) {
 		case OP_NEG:
 		case OP_NOT:
 		case OP_GETINDEX:
+		case OP_SLICE:
 		case OP_ITER: {
 			size_t ln = bcreader_addr(reader);
 			printf("ln:%zu", ln);
@@ -2363,7 +2885,8 @@ int bcreader_read(BCReader* reader) {
 		case OP_CALL: {
 			size_t argc = bcreader_addr(reader);
 			size_t ln = bcreader_addr(reader);
-			printf("argc:%zu ln:%zu", argc, ln);
+			uint8_t multret = bcreader_byte(reader);
+			printf("argc:%zu ln:%zu multret:%d", argc, ln, multret);
 		} break;
 
 		case OP_SETINDEX: {
@@ -2377,8 +2900,9 @@ int bcreader_read(BCReader* reader) {
 			uint8_t local = bcreader_byte(reader);
 			size_t valuec = bcreader_addr(reader);
 			size_t assignc = bcreader_addr(reader);
+			size_t indexc = bcreader_addr(reader);
 
-			printf("ln:%zu local:%d valuec:%zu assignc:%zu", ln, local, valuec, assignc);
+			printf("ln:%zu local:%d valuec:%zu assignc:%zu indexc:%zu", ln, local, valuec, assignc, indexc);
 			printf(" kinds:");
 			for (size_t i = 0; i < assignc; i++) {
 				uint8_t kind = bcreader_byte(reader);
@@ -2404,6 +2928,39 @@ int bcreader_read(BCReader* reader) {
 			size_t pos = bcreader_addr(reader);
 			printf(" pos:%zu", pos);
 		} break;
+
+		case OP_FORPREP: {
+			size_t ln = bcreader_addr(reader);
+			size_t count = bcreader_addr(reader);
+			size_t pos = bcreader_addr(reader);
+			printf("ln:%zu count:%zu pos:%zu", ln, count, pos);
+		} break;
+
+		case OP_FORLOOP: {
+			const char* name = bcreader_str(reader);
+			size_t pos = bcreader_addr(reader);
+			printf("%s pos:%zu", name, pos);
+		} break;
+
+		case OP_STRUCT: {
+			const char* name = bcreader_str(reader);
+			size_t count = bcreader_addr(reader);
+			printf("%s count:%zu", name, count);
+
+			for (size_t i = 0; i < count; i++) {
+				printf(" %s", bcreader_str(reader));
+			}
+		} break;
+
+		case OP_GETFIELD: {
+			size_t ln = bcreader_addr(reader);
+			size_t id = bcreader_addr(reader);
+			size_t slot = bcreader_addr(reader);
+			bcreader_addr(reader);
+			bcreader_addr(reader);
+			const char* name = bcreader_str(reader);
+			printf("ln:%zu |%s| shape:%zu slot:%zu", ln, name, id, slot);
+		} break;
 	}
 
 	printf("\n");
@@ -2457,12 +3014,30 @@ static Bytecode* gen_bc(const char* src, const char* text, char* errmsg) {
 struct VarMap;
 struct Table;
 struct TableEntry;
+// who owns a string's bytes
+#define STR_GC 0
+#define STR_MALLOC 1
+#define STR_INLINE 2
+#define STR_VIEW 3
+
+// a slice shorter than 1/16 of a parent above this size is copied instead of
+// keeping the whole parent alive
+#define STR_VIEW_PIN 65536
+
+// short strings live in the object itself, this fits in the union without growing it
+#define STR_INLINE_MAX 23
+
 typedef struct tug_Object {
 	int kind;
 	union {
 		struct {
 			char* str;
+			size_t len;
 			uint8_t m;
+			union {
+				char sso[STR_INLINE_MAX + 1];
+				struct tug_Object* parent;
+			};
 		};
 		double num;
 		struct {
@@ -2479,25 +3054,97 @@ typedef struct tug_Object {
 			tug_deallocator dealloc;
 			struct Table* table;
 			struct tug_Object* metatable;
+			struct Shape* shape;
+			union {
+				struct tug_Object** slots;
+				// a table's private reference for C code, scripts can't reach it
+				struct tug_Object* uservalue;
+			};
 		};
 		struct {
 			struct tug_Object* obj;
 			size_t len;
 			size_t idx;
-			struct TableEntry* entry;
+			tug_Cursor cursor;
+			void* state;
 		} iter;
-		Vector* list;
+		struct {
+			double start;
+			double stop;
+			double step;
+			double idx;
+		} range;
+		List* list;
+		struct {
+			struct MapNode* root;
+			size_t count;
+		} map;
+		struct {
+			char* data;
+			size_t len;
+			size_t cap;
+		} buf;
+		struct {
+			union {
+				double* f64;
+				int64_t* i64;
+			};
+			size_t len;
+			size_t cap;
+		} arr;
 	};
 	uint8_t collected;
 	uint8_t marked;
+	uint8_t frozen;
 	uint64_t id;
 } Object;
 
-static Object __obj_true = {TRUE, NULL};
-static Object __obj_false = {FALSE, NULL};
-static Object __obj_nil = {NIL, NULL};
+// the field layout shared by a struct and its records, ids are never
+// reused so bytecode can cache a field's slot against them
+typedef struct Shape {
+	char* name;
+	char** fields;
+	size_t count;
+	size_t id;
+	int refs;
+} Shape;
 
-#define obj_true (&__obj_true)
+static size_t next_shape_id = 1;
+
+static Shape* shape_create(const char* name, size_t count) {
+	Shape* shape = gc_malloc(sizeof(Shape));
+	shape->name = gc_strdup(name);
+	shape->fields = count ? gc_malloc(count * sizeof(char*)) : NULL;
+	shape->count = count;
+	shape->id = next_shape_id++;
+	shape->refs = 1;
+
+	return shape;
+}
+
+static void shape_release(Shape* shape) {
+	if (--shape->refs > 0) return;
+	for (size_t i = 0; i < shape->count; i++) {
+		gc_free(shape->fields[i]);
+	}
+	gc_free(shape->fields);
+	gc_free(shape->name);
+	gc_free(shape);
+}
+
+static long shape_find(Shape* shape, const char* name) {
+	for (size_t i = 0; i < shape->count; i++) {
+		if (strcmp(shape->fields[i], name) == 0) return (long)i;
+	}
+
+	return -1;
+}
+
+static Object __obj_true = {TRUE, NULL};
+static Object __obj_false = {FALSE, NULL};
+static Object __obj_nil = {NIL, NULL};
+
+#define obj_true (&__obj_true)
 #define obj_false (&__obj_false)
 #define obj_nil (&__obj_nil)
 #define obj_truth(c) ((c) ? obj_true : obj_false)
@@ -2517,17 +3164,20 @@ static Object* obj_create(int kind) {
 	}
 	obj->kind = kind;
 	obj->str = NULL;
-	obj->m = 0;
+	obj->m = STR_GC;
 	obj->marked = 0;
 	obj->collected = 0;
+	obj->frozen = 0;
 
 	obj->id = (next_id++ ^ (seed_id & 0xFFFFFF));
 
 	return obj;
 }
 
+static void* mapiter_create(struct MapNode* root);
 static Object* obj_iter(Object* obj) {
 	int kind = -1;
+	if (obj->kind == ITER_UTF8) return obj;
 	if (obj->kind == TABLE) {
 		Object* meta = tuglib_getmetafield(obj, "__next");
 		if (meta != obj_nil) return obj;
@@ -2535,25 +3185,158 @@ static Object* obj_iter(Object* obj) {
 	}
 	else if (obj->kind == STR) kind = ITER_STR;
 	else if (obj->kind == LIST) kind = ITER_LIST;
+	else if (obj->kind == F64ARRAY || obj->kind == I64ARRAY) kind = ITER_ARRAY;
+	else if (obj->kind == MAP) kind = ITER_MAP;
 	else return NULL;
 
 	Object* iter_obj = obj_create(kind);
-	if (obj->kind == STR) iter_obj->iter.len = strlen(obj->str);
+	if (obj->kind == STR) iter_obj->iter.len = obj->len;
 	else iter_obj->iter.len = 0;
 	iter_obj->iter.idx = 0;
-	iter_obj->iter.entry = NULL;
+	iter_obj->iter.cursor.bucket = 0;
+	iter_obj->iter.cursor.slot = 0;
+	iter_obj->iter.state = obj->kind == MAP ? mapiter_create(obj->map.root) : NULL;
 	iter_obj->iter.obj = obj;
 
 	return iter_obj;
 }
 
-static Object* obj_str(char* str) {
+// `str` must have a NUL after its `len` bytes
+static Object* obj_lstr(char* str, size_t len) {
 	Object* obj = obj_create(STR);
 	obj->str = str;
+	obj->len = len;
 
 	return obj;
 }
 
+#define obj_str(__str) obj_lstr((__str), strlen((__str)))
+
+static Object* obj_inlstr(const char* str, size_t len) {
+	Object* obj = obj_create(STR);
+	memcpy(obj->sso, str, len);
+	obj->sso[len] = '\0';
+	obj->str = obj->sso;
+	obj->len = len;
+	obj->m = STR_INLINE;
+
+	return obj;
+}
+
+// gives a view its own copy of the bytes, after this it no longer needs its parent
+static void str_materialize(Object* obj) {
+	if (obj->m != STR_VIEW) return;
+	const char* src = obj->str;
+	size_t len = obj->len;
+
+	if (len <= STR_INLINE_MAX) {
+		memcpy(obj->sso, src, len);
+		obj->sso[len] = '\0';
+		obj->str = obj->sso;
+		obj->m = STR_INLINE;
+	} else {
+		char* copy = gc_malloc(len + 1);
+		memcpy(copy, src, len);
+		copy[len] = '\0';
+		obj->str = copy;
+		obj->m = STR_GC;
+	}
+}
+
+// views aren't NUL-terminated, anything that needs a C string goes through here
+static const char* str_cstr(Object* obj) {
+	str_materialize(obj);
+	return obj->str;
+}
+
+// every single-byte string is preallocated, immortal and shared
+static Object str_chars[256];
+
+static void str_chars_init(void) {
+	for (int i = 0; i < 256; i++) {
+		Object* obj = &str_chars[i];
+		obj->kind = STR;
+		obj->sso[0] = (char)i;
+		obj->sso[1] = '\0';
+		obj->str = obj->sso;
+		obj->len = 1;
+		obj->m = STR_INLINE;
+		obj->marked = 0;
+		obj->collected = 1;
+		obj->frozen = 1;
+		obj->id = (size_t)i;
+	}
+}
+
+// code points below 128 come from here so walking ASCII text boxes nothing
+static Object num_ascii[128];
+
+static void num_ascii_init(void) {
+	for (int i = 0; i < 128; i++) {
+		Object* obj = &num_ascii[i];
+		obj->kind = NUM;
+		obj->num = (double)i;
+		obj->marked = 0;
+		obj->collected = 1;
+		obj->frozen = 1;
+		obj->id = (size_t)i;
+	}
+}
+
+// a call that returns k > 1 values leaves them in order on the stack with
+// `multret_marks[k]` above them, only bigger results are boxed into a tuple
+#define MULTRET_MAX 64
+static Object multret_marks[MULTRET_MAX + 1];
+
+static void multret_init(void) {
+	for (int i = 0; i <= MULTRET_MAX; i++) {
+		Object* obj = &multret_marks[i];
+		obj->kind = MULTRET;
+		obj->len = (size_t)i;
+		obj->marked = 0;
+		obj->collected = 1;
+		obj->frozen = 1;
+		obj->id = (size_t)i;
+	}
+}
+
+// length of the UTF-8 sequence at `str` or 0 when it's malformed, overlong
+// encodings and surrogates are rejected
+static size_t utf8_decode(const char* str, size_t len, uint32_t* cp) {
+	const uint8_t* s = (const uint8_t*)str;
+	if (len == 0) return 0;
+	if (s[0] < 0x80) {
+		*cp = s[0];
+		return 1;
+	}
+
+	size_t n;
+	uint32_t value, min;
+	if (s[0] >= 0xC2 && s[0] <= 0xDF) {
+		n = 2;
+		value = s[0] & 0x1F;
+		min = 0x80;
+	} else if ((s[0] & 0xF0) == 0xE0) {
+		n = 3;
+		value = s[0] & 0x0F;
+		min = 0x800;
+	} else if (s[0] >= 0xF0 && s[0] <= 0xF4) {
+		n = 4;
+		value = s[0] & 0x07;
+		min = 0x10000;
+	} else return 0;
+	if (len < n) return 0;
+
+	for (size_t i = 1; i < n; i++) {
+		if ((s[i] & 0xC0) != 0x80) return 0;
+		value = (value << 6) | (s[i] & 0x3F);
+	}
+	if (value < min || value > 0x10FFFF || (value >= 0xD800 && value <= 0xDFFF)) return 0;
+
+	*cp = value;
+	return n;
+}
+
 static Object* obj_num(double num) {
 	Object* obj = obj_create(NUM);
 	obj->num = num;
@@ -2561,6 +3344,90 @@ static Object* obj_num(double num) {
 	return obj;
 }
 
+// the bytes are malloc'd so they can be handed to a string as they are
+static Object* obj_buffer(size_t cap) {
+	Object* obj = obj_create(BUFFER);
+	obj->buf.data = NULL;
+	obj->buf.len = 0;
+	obj->buf.cap = 0;
+	if (cap > 0) {
+		obj->buf.data = malloc(cap + 1);
+		obj->buf.cap = cap + 1;
+	}
+
+	return obj;
+}
+
+// makes room for `extra` more bytes plus a NUL, growing geometrically
+static void buf_reserve(Object* buf, size_t extra) {
+	size_t need = buf->buf.len + extra + 1;
+	if (need <= buf->buf.cap) return;
+
+	size_t cap = buf->buf.cap < 16 ? 16 : buf->buf.cap * 2;
+	while (cap < need) cap *= 2;
+	buf->buf.data = realloc(buf->buf.data, cap);
+	buf->buf.cap = cap;
+}
+
+static void buf_append(Object* buf, const char* str, size_t len) {
+	buf_reserve(buf, len);
+	memcpy(buf->buf.data + buf->buf.len, str, len);
+	buf->buf.len += len;
+}
+
+// hands the bytes over to a new string and leaves the buffer empty
+static Object* buf_tostr(Object* buf) {
+	buf_reserve(buf, 0);
+	char* data = buf->buf.data;
+	size_t len = buf->buf.len;
+	data[len] = '\0';
+	if (buf->buf.cap - len > 64 && buf->buf.cap / 4 > len) data = realloc(data, len + 1);
+
+	buf->buf.data = NULL;
+	buf->buf.len = 0;
+	buf->buf.cap = 0;
+
+	Object* str = obj_lstr(data, len);
+	str->m = STR_MALLOC;
+	return str;
+}
+
+// elements are stored flat, both kinds are 8 bytes wide and start zeroed
+static Object* obj_array(int kind, size_t len) {
+	Object* obj = obj_create(kind);
+	obj->arr.f64 = len ? gc_calloc(len, 8) : NULL;
+	obj->arr.len = len;
+	obj->arr.cap = len;
+
+	return obj;
+}
+
+static void array_resize(Object* arr, size_t len) {
+	if (len > arr->arr.cap) {
+		size_t cap = arr->arr.cap < 8 ? 8 : arr->arr.cap * 2;
+		while (cap < len) cap *= 2;
+		arr->arr.f64 = gc_realloc(arr->arr.f64, cap * 8);
+		arr->arr.cap = cap;
+	}
+	if (len > arr->arr.len) memset(arr->arr.f64 + arr->arr.len, 0, (len - arr->arr.len) * 8);
+	arr->arr.len = len;
+}
+
+// out of range values saturate and nan becomes 0 instead of being undefined
+static int64_t num_toi64(double num) {
+	if (num != num) return 0;
+	if (num >= 9223372036854775807.0) return INT64_MAX;
+	if (num <= -9223372036854775808.0) return INT64_MIN;
+	return (int64_t)num;
+}
+
+#define array_get(__arr, __idx) ((__arr)->kind == F64ARRAY ? (__arr)->arr.f64[(__idx)] : (double)(__arr)->arr.i64[(__idx)])
+
+static inline void array_put(Object* arr, size_t idx, double num) {
+	if (arr->kind == F64ARRAY) arr->arr.f64[idx] = num;
+	else arr->arr.i64[idx] = num_toi64(num);
+}
+
 // Name will not be duplicated
 // Bytecode ref-count will not be increased
 // Params will not also be duplicated
@@ -2599,16 +3466,50 @@ static Object* obj_table(struct Table* table) {
 	obj->table = table;
 	obj->metatable = obj_nil;
 	obj->userdata = NULL;
+	obj->dealloc = NULL;
+	obj->uservalue = NULL;
+
+	return obj;
+}
+
+// takes over the reference to `shape`
+static Object* obj_struct(Shape* shape) {
+	Object* obj = obj_create(STRUCT);
+	obj->userdata = NULL;
+	obj->dealloc = NULL;
+	obj->table = NULL;
+	obj->metatable = obj_nil;
+	obj->shape = shape;
+	obj->slots = NULL;
+
+	return obj;
+}
+
+// records start out with the metatable their struct has at that moment
+static Object* obj_record(Object* type) {
+	Shape* shape = type->shape;
+	Object* obj = obj_create(RECORD);
+	obj->userdata = NULL;
+	obj->dealloc = NULL;
+	obj->table = NULL;
+	obj->metatable = type->metatable;
+	obj->shape = shape;
+	shape->refs++;
+	obj->slots = shape->count ? gc_malloc(shape->count * sizeof(Object*)) : NULL;
+	for (size_t i = 0; i < shape->count; i++) {
+		obj->slots[i] = obj_nil;
+	}
 
 	return obj;
 }
 
 static void table_free(struct Table* table);
+static void mapnode_release(struct MapNode* node);
 static void obj_free(Object* obj) {
 	switch (obj->kind) {
 		case STR: {
-			if (obj->m) free(obj->str);
-			else gc_free(obj->str);	
+			if (obj->m == STR_MALLOC) free(obj->str);
+			else if (obj->m == STR_GC) gc_free(obj->str);
 		} break;
 		case FUNC: {
 			if (!obj->func.cfunc) {
@@ -2618,12 +3519,22 @@ static void obj_free(Object* obj) {
 			}
 			gc_free(obj->func.name);
 		} break;
-		case LIST: vec_free(obj->list); break;
+		case LIST: list_free(obj->list); break;
 		case TUPLE: vec_free(obj->tuple); break;
 		case TABLE: {
-			obj->deallocate(obj);
+			if (obj->dealloc) obj->dealloc(obj);
 			table_free(obj->table);
 		} break;
+		case MAP: mapnode_release(obj->map.root); break;
+		case STRUCT: shape_release(obj->shape); break;
+		case BUFFER: free(obj->buf.data); break;
+		case F64ARRAY:
+		case I64ARRAY: gc_free(obj->arr.f64); break;
+		case RECORD: {
+			gc_free(obj->slots);
+			shape_release(obj->shape);
+		} break;
+		case ITER_MAP: gc_free(obj->iter.state); break;
 	}
 	
 	if (obj_poolc < OBJ_POOL_LIMIT) {
@@ -2641,6 +3552,12 @@ static const char* obj_type(Object* obj) {
 		case FUNC: return "func";
 		case TABLE: return "table";
 		case LIST: return "list";
+		case MAP: return "map";
+		case STRUCT: return "struct";
+		case RECORD: return "record";
+		case BUFFER: return "buffer";
+		case F64ARRAY: return "f64array";
+		case I64ARRAY: return "i64array";
 		default: return "unknown";
 	}
 }
@@ -2649,7 +3566,7 @@ static const char* obj_type(Object* obj) {
 static void obj_print(Object* obj) {
 	switch (obj->kind) {
 		case STR: {
-			printf("%s\n", obj->str);
+			printf("%s\n", str_cstr(obj));
 		} break;
 		case NUM: {
 			printf("%.17g\n", obj->num);
@@ -2675,6 +3592,22 @@ static void obj_print(Object* obj) {
 		case LIST: {
 			printf("list: 0x%lx\n", obj->id);
 		} break;
+		case MAP: {
+			printf("map: 0x%lx\n", obj->id);
+		} break;
+		case STRUCT: {
+			printf("struct %s: 0x%lx\n", obj->shape->name, obj->id);
+		} break;
+		case RECORD: {
+			printf("%s: 0x%lx\n", obj->shape->name, obj->id);
+		} break;
+		case BUFFER: {
+			printf("buffer: 0x%lx\n", obj->id);
+		} break;
+		case F64ARRAY:
+		case I64ARRAY: {
+			printf("%s: 0x%lx\n", obj_type(obj), obj->id);
+		} break;
 		default: {
 			printf("unknown\n");
 		} break;
@@ -2686,7 +3619,7 @@ static int obj_compare(Object* o1, Object* o2) {
 	if (o1->kind != o2->kind) return 0;
 	switch (o1->kind) {
 		case NUM: return o1->num == o2->num;
-		case STR: return strcmp(o1->str, o2->str) == 0;
+		case STR: return o1->len == o2->len && memcmp(o1->str, o2->str, o1->len) == 0;
 		case TRUE:
 		case FALSE:
 		case NIL: return 1;
@@ -2694,10 +3627,20 @@ static int obj_compare(Object* o1, Object* o2) {
 	}
 }
 
+#define obj_hasmeta(__obj) (((__obj)->kind == TABLE || (__obj)->kind == RECORD) && (__obj)->metatable != obj_nil)
+
+static int str_cmp(Object* o1, Object* o2) {
+	size_t len = o1->len < o2->len ? o1->len : o2->len;
+	int res = memcmp(o1->str, o2->str, len);
+	if (res != 0) return res;
+
+	return (o1->len > o2->len) - (o1->len < o2->len);
+}
+
 static int obj_check(Object* obj) {
 	switch (obj->kind) {
 		case NUM: return obj->num != 0;
-		case STR: return obj->str[0] != '\0';
+		case STR: return obj->len != 0;
 		case FALSE:
 		case NIL: return 0;
 		case LIST: return obj->list->count != 0;
@@ -2716,9 +3659,8 @@ static uint64_t obj_hash(Object* obj) {
 		} break;
 		case STR: {
 			uint64_t hash = 1469598103934665603ULL;
-			char* ptr = obj->str;
-			while (*ptr) {
-				hash ^= (unsigned char)(*ptr++);
+			for (size_t i = 0; i < obj->len; i++) {
+				hash ^= (unsigned char)obj->str[i];
 				hash *= 1099511628211ULL;
 			}
 
@@ -2743,24 +3685,146 @@ static uint64_t obj_hash(Object* obj) {
 typedef struct TableEntry {
 	Object* key;
 	Object* value;
+	uint64_t hash;
 	struct TableEntry* next;
 } TableEntry;
 
+// an ordered table keeps its entries in a dense array in insertion order,
+// `index` is an open addressing array of positions into `entries`
+// (same idea as CPython's compact dict), removed entries leave a hole
+// with a NULL key until the next resize compacts them away
 typedef struct Table {
 	TableEntry** buckets;
 	size_t capacity;
 	size_t count;
+	uint8_t ordered;
+	TableEntry* entries;
+	size_t* index;
+	size_t used;
 } Table;
 
+#define ORDERED_EMPTY ((size_t)-1)
+#define ORDERED_DUMMY ((size_t)-2)
+#define ordered_usable(__cap) ((__cap) * 2 / 3)
+
 static struct Table* table_create() {
 	struct Table* table = gc_malloc(sizeof(struct Table));
 	table->count = 0;
 	table->capacity = 0;
 	table->buckets = NULL;
+	table->ordered = 0;
+	table->entries = NULL;
+	table->index = NULL;
+	table->used = 0;
+
+	return table;
+}
+
+static struct Table* table_ordered() {
+	struct Table* table = table_create();
+	table->ordered = 1;
 
 	return table;
 }
 
+// returns the entry position of `key` or ORDERED_EMPTY, `slot` receives the index
+// slot holding it, or the empty slot where it would go
+static size_t ordered_lookup(Table* table, Object* key, uint64_t hash, size_t* slot) {
+	size_t mask = table->capacity - 1;
+	size_t i = hash & mask;
+
+	while (1) {
+		size_t pos = table->index[i];
+		if (pos == ORDERED_EMPTY) break;
+		if (pos != ORDERED_DUMMY) {
+			TableEntry* entry = &table->entries[pos];
+			if (entry->hash == hash && obj_compare(entry->key, key)) {
+				if (slot) *slot = i;
+				return pos;
+			}
+		}
+		i = (i + 1) & mask;
+	}
+
+	if (slot) *slot = i;
+	return ORDERED_EMPTY;
+}
+
+// rebuilds the index and squeezes the holes out of the entries
+static void ordered_resize(Table* table, size_t new_cap) {
+	size_t mask = new_cap - 1;
+	TableEntry* entries = gc_malloc(ordered_usable(new_cap) * sizeof(TableEntry));
+	size_t* index = gc_malloc(new_cap * sizeof(size_t));
+	for (size_t i = 0; i < new_cap; i++) index[i] = ORDERED_EMPTY;
+
+	size_t used = 0;
+	for (size_t i = 0; i < table->used; i++) {
+		TableEntry* entry = &table->entries[i];
+		if (!entry->key) continue;
+
+		size_t j = entry->hash & mask;
+		while (index[j] != ORDERED_EMPTY) j = (j + 1) & mask;
+		index[j] = used;
+		entries[used++] = *entry;
+	}
+
+	gc_free(table->entries);
+	gc_free(table->index);
+	table->entries = entries;
+	table->index = index;
+	table->capacity = new_cap;
+	table->used = used;
+}
+
+static Object* ordered_get(Table* table, Object* key) {
+	if (table->capacity == 0) return obj_nil;
+
+	size_t pos = ordered_lookup(table, key, obj_hash(key), NULL);
+	return pos == ORDERED_EMPTY ? obj_nil : table->entries[pos].value;
+}
+
+// O(1), the entry is only punched out, order of the others is untouched
+static void ordered_remove(Table* table, Object* key) {
+	if (table->capacity == 0) return;
+
+	size_t slot;
+	size_t pos = ordered_lookup(table, key, obj_hash(key), &slot);
+	if (pos == ORDERED_EMPTY) return;
+
+	table->index[slot] = ORDERED_DUMMY;
+	table->entries[pos].key = NULL;
+	table->entries[pos].value = NULL;
+	table->count--;
+}
+
+static void ordered_set(Table* table, Object* key, Object* value) {
+	uint64_t hash = obj_hash(key);
+	size_t slot;
+
+	if (table->capacity > 0) {
+		size_t pos = ordered_lookup(table, key, hash, &slot);
+		if (pos != ORDERED_EMPTY) {
+			table->entries[pos].value = value;
+			return;
+		}
+	}
+
+	if (table->used >= ordered_usable(table->capacity)) {
+		size_t new_cap = 8;
+		while (new_cap < (table->count + 1) * 3) new_cap *= 2;
+		ordered_resize(table, new_cap);
+		ordered_lookup(table, key, hash, &slot);
+	}
+
+	TableEntry* entry = &table->entries[table->used];
+	entry->key = key;
+	entry->value = value;
+	entry->hash = hash;
+	entry->next = NULL;
+	table->index[slot] = table->used++;
+	table->count++;
+}
+
 static void table_resize(Table* table, size_t new_cap) {
 	TableEntry** new_buckets = gc_calloc(new_cap, sizeof(TableEntry*));
 
@@ -2769,7 +3833,7 @@ static void table_resize(Table* table, size_t new_cap) {
 
 		while (entry) {
 			TableEntry* next = entry->next;
-			uint64_t idx = obj_hash(entry->key) & (new_cap - 1);
+			uint64_t idx = entry->hash & (new_cap - 1);
 
 			entry->next = new_buckets[idx];
 			new_buckets[idx] = entry;
@@ -2802,11 +3866,17 @@ static void table_smresize(Table* table) {
 }
 
 static void table_remove(Table* table, Object* key) {
-	size_t index = obj_hash(key) & (table->capacity - 1);
+	if (table->ordered) {
+		ordered_remove(table, key);
+		return;
+	}
+	if (table->buckets == NULL) return;
+	uint64_t hash = obj_hash(key);
+	size_t index = hash & (table->capacity - 1);
 
 	TableEntry* prev = NULL;
 	for (TableEntry* entry = table->buckets[index]; entry; prev = entry, entry = entry->next) {
-		if (obj_compare(entry->key, key)) {
+		if (entry->hash == hash && obj_compare(entry->key, key)) {
 			if (prev) prev->next = entry->next;
 			else table->buckets[index] = entry->next;
 
@@ -2820,12 +3890,14 @@ static void table_remove(Table* table, Object* key) {
 }
 
 static Object* table_get(Table* table, Object* key) {
+	if (table->ordered) return ordered_get(table, key);
 	if (table->buckets == NULL) return obj_nil;
 
-	size_t index = obj_hash(key) & (table->capacity - 1);
+	uint64_t hash = obj_hash(key);
+	size_t index = hash & (table->capacity - 1);
 
 	for (TableEntry* entry = table->buckets[index]; entry; entry = entry->next) {
-		if (obj_compare(entry->key, key)) return entry->value;
+		if (entry->hash == hash && obj_compare(entry->key, key)) return entry->value;
 	}
 
 	return obj_nil;
@@ -2837,12 +3909,19 @@ static void table_set(Table* table, Object* key, Object* value) {
 		return;
 	}
 
+	if (key->kind == STR) str_materialize(key);
+	if (table->ordered) {
+		ordered_set(table, key, value);
+		return;
+	}
+
 	table_smresize(table);
 
-	size_t index = obj_hash(key) & (table->capacity - 1);
+	uint64_t hash = obj_hash(key);
+	size_t index = hash & (table->capacity - 1);
 	if (table->buckets) {
 		for (TableEntry* entry = table->buckets[index]; entry; entry = entry->next) {
-			if (obj_compare(entry->key, key)) {
+			if (entry->hash == hash && obj_compare(entry->key, key)) {
 				entry->value = value;
 				return;
 			}
@@ -2852,12 +3931,82 @@ static void table_set(Table* table, Object* key, Object* value) {
 	TableEntry* new_entry = gc_malloc(sizeof(TableEntry));
 	new_entry->key = key;
 	new_entry->value = value;
+	new_entry->hash = hash;
 	new_entry->next = table->buckets[index];
 	table->buckets[index] = new_entry;
 	table->count++;
 }
 
+// walks the table without allocating, `cursor` is a bucket index plus the
+// slot inside that bucket's chain, start from {0, 0}
+// for ordered tables `bucket` is the position in the entries array
+// the table must not be resized while walking
+static int table_next(Table* table, tug_Cursor* cursor, Object** key, Object** value) {
+	if (table->ordered) {
+		while (cursor->bucket < table->used) {
+			TableEntry* entry = &table->entries[cursor->bucket++];
+			if (!entry->key) continue;
+
+			if (key) *key = entry->key;
+			if (value) *value = entry->value;
+			return 1;
+		}
+
+		return 0;
+	}
+
+	while (cursor->bucket < table->capacity) {
+		TableEntry* entry = table->buckets[cursor->bucket];
+		for (size_t i = 0; entry && i < cursor->slot; i++) entry = entry->next;
+
+		if (entry) {
+			cursor->slot++;
+			if (key) *key = entry->key;
+			if (value) *value = entry->value;
+			return 1;
+		}
+
+		cursor->bucket++;
+		cursor->slot = 0;
+	}
+
+	return 0;
+}
+
+// places `cursor` right after `key`, so the next `table_next` gives the entry following it
+static int table_seek(Table* table, Object* key, tug_Cursor* cursor) {
+	if (table->ordered) {
+		if (table->capacity == 0) return 0;
+		size_t pos = ordered_lookup(table, key, obj_hash(key), NULL);
+		if (pos == ORDERED_EMPTY) return 0;
+
+		cursor->bucket = pos + 1;
+		cursor->slot = 0;
+		return 1;
+	}
+	if (table->buckets == NULL) return 0;
+
+	uint64_t hash = obj_hash(key);
+	size_t index = hash & (table->capacity - 1);
+	size_t slot = 0;
+	for (TableEntry* entry = table->buckets[index]; entry; entry = entry->next, slot++) {
+		if (entry->hash == hash && obj_compare(entry->key, key)) {
+			cursor->bucket = index;
+			cursor->slot = slot + 1;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
 static void table_free(struct Table* table) {
+	if (table && table->ordered) {
+		gc_free(table->entries);
+		gc_free(table->index);
+		gc_free(table);
+		return;
+	}
 	if (!table || !table->buckets) {
 		gc_free(table);
 		return;
@@ -2876,6 +4025,421 @@ static void table_free(struct Table* table) {
     gc_free(table);
 }
 
+// lays a table out for read-only use, buckets sized so chains stay short
+static void table_compact(Table* table) {
+	size_t cap = 8;
+	while (cap < table->count * 2) cap *= 2;
+	if (table->ordered) ordered_resize(table, cap);
+	else if (cap != table->capacity) table_resize(table, cap);
+}
+
+// only plain data can be frozen, script functions keep mutable closures
+static int obj_freezable(Object* obj, Vector* seen) {
+	if (obj == obj_true || obj == obj_false || obj == obj_nil) return 1;
+	if (obj->frozen || obj->marked) return 1;
+	obj->marked = 1;
+	vec_push(seen, obj);
+
+	switch (obj->kind) {
+		case STR:
+		case NUM: return 1;
+		case FUNC: return obj->func.cfunc != NULL;
+		case TABLE: {
+			tug_Cursor cursor = {0, 0};
+			Object* key;
+			Object* value;
+			while (table_next(obj->table, &cursor, &key, &value)) {
+				if (!obj_freezable(key, seen) || !obj_freezable(value, seen)) return 0;
+			}
+			if (obj->uservalue && !obj_freezable(obj->uservalue, seen)) return 0;
+			return obj_freezable(obj->metatable, seen);
+		}
+		case LIST: {
+			for (size_t i = 0; i < obj->list->count; i++) {
+				if (!obj_freezable(list_get(obj->list, i), seen)) return 0;
+			}
+			return 1;
+		}
+		case STRUCT: return obj_freezable(obj->metatable, seen);
+		case F64ARRAY:
+		case I64ARRAY: return 1;
+		case RECORD: {
+			for (size_t i = 0; i < obj->shape->count; i++) {
+				if (!obj_freezable(obj->slots[i], seen)) return 0;
+			}
+			return obj_freezable(obj->metatable, seen);
+		}
+		default: return 0;
+	}
+}
+
+// frozen objects are immortal, the collector neither marks nor sweeps them
+static void obj_freeze(Object* obj) {
+	if (obj == obj_true || obj == obj_false || obj == obj_nil || obj->frozen) return;
+	if (obj->kind == STR) str_materialize(obj);
+	obj->frozen = 1;
+
+	if (obj->kind == TABLE) {
+		tug_Cursor cursor = {0, 0};
+		Object* key;
+		Object* value;
+		while (table_next(obj->table, &cursor, &key, &value)) {
+			obj_freeze(key);
+			obj_freeze(value);
+		}
+		if (obj->uservalue) obj_freeze(obj->uservalue);
+		obj_freeze(obj->metatable);
+		table_compact(obj->table);
+	} else if (obj->kind == LIST) {
+		// other lists would still count on a shared array, a frozen one keeps its own
+		list_own(obj->list);
+		for (size_t i = 0; i < obj->list->count; i++) {
+			obj_freeze(list_get(obj->list, i));
+		}
+	} else if (obj->kind == STRUCT) {
+		obj_freeze(obj->metatable);
+	} else if (obj->kind == RECORD) {
+		for (size_t i = 0; i < obj->shape->count; i++) {
+			obj_freeze(obj->slots[i]);
+		}
+		obj_freeze(obj->metatable);
+	}
+}
+
+static int freeze(Object* obj) {
+	Vector* seen = vec_create();
+	int ok = obj_freezable(obj, seen);
+	for (size_t i = 0; i < vec_count(seen); i++) {
+		((Object*)vec_get(seen, i))->marked = 0;
+	}
+	vec_free(seen);
+
+	if (ok) obj_freeze(obj);
+	return ok;
+}
+
+// persistent maps are hash array mapped tries, every update copies the path
+// from the root down to the changed slot and shares everything else, nodes
+// are ref-counted so a snapshot costs nothing until one side changes
+#define MAP_BITS 5
+#define MAP_MASK 31
+#define MAP_MAX_DEPTH 15
+
+typedef struct MapItem {
+	Object* key; // NULL when the slot holds a sub-node
+	union {
+		Object* value;
+		struct MapNode* node;
+	};
+	uint64_t hash;
+} MapItem;
+
+// a bitmap node stores one item per set bit, in bit order,
+// a collision node (all 64 hash bits used up) stores its items unordered
+typedef struct MapNode {
+	uint32_t bitmap;
+	uint32_t size;
+	uint8_t collision;
+	int refs;
+	size_t epoch;
+	MapItem items[];
+} MapNode;
+
+typedef struct MapIter {
+	MapNode* nodes[MAP_MAX_DEPTH];
+	uint32_t pos[MAP_MAX_DEPTH];
+	size_t depth;
+} MapIter;
+
+#define map_index(__hash, __shift) ((uint32_t)((__hash) >> (__shift)) & MAP_MASK)
+#define map_pos(__node, __bit) ((uint32_t)__builtin_popcount((__node)->bitmap & ((__bit) - 1)))
+#define map_match(__item, __key, __hash) ((__item)->key && (__item)->hash == (__hash) && obj_compare((__item)->key, (__key)))
+
+static MapNode* mapnode_create(uint32_t bitmap, uint32_t size) {
+	MapNode* node = gc_malloc(sizeof(MapNode) + size * sizeof(MapItem));
+	node->bitmap = bitmap;
+	node->size = size;
+	node->collision = 0;
+	node->refs = 1;
+	node->epoch = 0;
+
+	return node;
+}
+
+static inline MapNode* mapnode_retain(MapNode* node) {
+	if (node) node->refs++;
+	return node;
+}
+
+static void mapnode_release(MapNode* node) {
+	if (!node || --node->refs > 0) return;
+	for (uint32_t i = 0; i < node->size; i++) {
+		if (!node->items[i].key) mapnode_release(node->items[i].node);
+	}
+	gc_free(node);
+}
+
+static inline void mapitem_copy(MapItem* dst, MapItem* src) {
+	*dst = *src;
+	if (!dst->key) mapnode_retain(dst->node);
+}
+
+// copy of `node` with `item` placed at `pos`, the item's sub-node reference is taken over
+static MapNode* mapnode_replace(MapNode* node, uint32_t pos, MapItem* item) {
+	MapNode* res = mapnode_create(node->bitmap, node->size);
+	res->collision = node->collision;
+	for (uint32_t i = 0; i < node->size; i++) {
+		if (i != pos) mapitem_copy(&res->items[i], &node->items[i]);
+	}
+	res->items[pos] = *item;
+
+	return res;
+}
+
+static MapNode* mapnode_insert(MapNode* node, uint32_t pos, uint32_t bit, MapItem* item) {
+	MapNode* res = mapnode_create(node->bitmap | bit, node->size + 1);
+	res->collision = node->collision;
+	for (uint32_t i = 0; i < pos; i++) mapitem_copy(&res->items[i], &node->items[i]);
+	res->items[pos] = *item;
+	for (uint32_t i = pos; i < node->size; i++) mapitem_copy(&res->items[i + 1], &node->items[i]);
+
+	return res;
+}
+
+static MapNode* mapnode_erase(MapNode* node, uint32_t pos, uint32_t bit) {
+	if (node->size == 1) return NULL;
+
+	MapNode* res = mapnode_create(node->bitmap & ~bit, node->size - 1);
+	res->collision = node->collision;
+	for (uint32_t i = 0; i < pos; i++) mapitem_copy(&res->items[i], &node->items[i]);
+	for (uint32_t i = pos + 1; i < node->size; i++) mapitem_copy(&res->items[i - 1], &node->items[i]);
+
+	return res;
+}
+
+// builds the smallest subtree that tells two leaves apart
+static MapNode* mapnode_merge(MapItem* a, MapItem* b, unsigned shift) {
+	MapNode* node;
+	if (shift >= 64) {
+		node = mapnode_create(0, 2);
+		node->collision = 1;
+		node->items[0] = *a;
+		node->items[1] = *b;
+		return node;
+	}
+
+	uint32_t ia = map_index(a->hash, shift);
+	uint32_t ib = map_index(b->hash, shift);
+	if (ia == ib) {
+		node = mapnode_create(1u << ia, 1);
+		node->items[0].key = NULL;
+		node->items[0].node = mapnode_merge(a, b, shift + MAP_BITS);
+		node->items[0].hash = 0;
+		return node;
+	}
+
+	node = mapnode_create((1u << ia) | (1u << ib), 2);
+	node->items[ia < ib ? 0 : 1] = *a;
+	node->items[ia < ib ? 1 : 0] = *b;
+
+	return node;
+}
+
+static Object* mapnode_get(MapNode* node, Object* key, uint64_t hash) {
+	unsigned shift = 0;
+	while (node) {
+		if (node->collision) {
+			for (uint32_t i = 0; i < node->size; i++) {
+				if (map_match(&node->items[i], key, hash)) return node->items[i].value;
+			}
+			return obj_nil;
+		}
+
+		uint32_t bit = 1u << map_index(hash, shift);
+		if (!(node->bitmap & bit)) return obj_nil;
+
+		MapItem* item = &node->items[map_pos(node, bit)];
+		if (item->key) return map_match(item, key, hash) ? item->value : obj_nil;
+
+		node = item->node;
+		shift += MAP_BITS;
+	}
+
+	return obj_nil;
+}
+
+// returns a new reference, `added` is set when the key was not present before
+static MapNode* mapnode_assoc(MapNode* node, unsigned shift, MapItem* leaf, int* added) {
+	if (!node) {
+		*added = 1;
+		node = mapnode_create(1u << map_index(leaf->hash, shift), 1);
+		node->items[0] = *leaf;
+		return node;
+	}
+
+	if (node->collision) {
+		for (uint32_t i = 0; i < node->size; i++) {
+			if (!map_match(&node->items[i], leaf->key, leaf->hash)) continue;
+			if (obj_compare(node->items[i].value, leaf->value)) return mapnode_retain(node);
+			return mapnode_replace(node, i, leaf);
+		}
+		*added = 1;
+		return mapnode_insert(node, node->size, 0, leaf);
+	}
+
+	uint32_t bit = 1u << map_index(leaf->hash, shift);
+	uint32_t pos = map_pos(node, bit);
+	if (!(node->bitmap & bit)) {
+		*added = 1;
+		return mapnode_insert(node, pos, bit, leaf);
+	}
+
+	MapItem* item = &node->items[pos];
+	MapItem sub;
+	sub.key = NULL;
+	sub.hash = 0;
+	if (!item->key) {
+		sub.node = mapnode_assoc(item->node, shift + MAP_BITS, leaf, added);
+		if (sub.node == item->node) {
+			mapnode_release(sub.node);
+			return mapnode_retain(node);
+		}
+	} else if (map_match(item, leaf->key, leaf->hash)) {
+		if (obj_compare(item->value, leaf->value)) return mapnode_retain(node);
+		return mapnode_replace(node, pos, leaf);
+	} else {
+		*added = 1;
+		sub.node = mapnode_merge(item, leaf, shift + MAP_BITS);
+	}
+
+	return mapnode_replace(node, pos, &sub);
+}
+
+// returns a new reference (NULL once empty), `removed` is set when the key was found
+static MapNode* mapnode_dissoc(MapNode* node, unsigned shift, Object* key, uint64_t hash, int* removed) {
+	if (node->collision) {
+		for (uint32_t i = 0; i < node->size; i++) {
+			if (map_match(&node->items[i], key, hash)) {
+				*removed = 1;
+				return mapnode_erase(node, i, 0);
+			}
+		}
+		return mapnode_retain(node);
+	}
+
+	uint32_t bit = 1u << map_index(hash, shift);
+	if (!(node->bitmap & bit)) return mapnode_retain(node);
+
+	uint32_t pos = map_pos(node, bit);
+	MapItem* item = &node->items[pos];
+	if (item->key) {
+		if (!map_match(item, key, hash)) return mapnode_retain(node);
+		*removed = 1;
+		return mapnode_erase(node, pos, bit);
+	}
+
+	MapNode* child = mapnode_dissoc(item->node, shift + MAP_BITS, key, hash, removed);
+	if (!*removed) {
+		mapnode_release(child);
+		return mapnode_retain(node);
+	}
+	if (!child) return mapnode_erase(node, pos, bit);
+
+	// a sub-node left with a single leaf is folded back into its parent
+	MapItem sub;
+	if (child->size == 1 && child->items[0].key) {
+		sub = child->items[0];
+		mapnode_release(child);
+	} else {
+		sub.key = NULL;
+		sub.node = child;
+		sub.hash = 0;
+	}
+
+	return mapnode_replace(node, pos, &sub);
+}
+
+static void* mapiter_create(MapNode* root) {
+	MapIter* it = gc_malloc(sizeof(MapIter));
+	it->depth = 0;
+	if (root) {
+		it->nodes[0] = root;
+		it->pos[0] = 0;
+		it->depth = 1;
+	}
+
+	return it;
+}
+
+static int mapiter_next(MapIter* it, Object** key, Object** value) {
+	while (it->depth > 0) {
+		size_t d = it->depth - 1;
+		MapNode* node = it->nodes[d];
+		if (it->pos[d] >= node->size) {
+			it->depth--;
+			continue;
+		}
+
+		MapItem* item = &node->items[it->pos[d]++];
+		if (item->key) {
+			*key = item->key;
+			*value = item->value;
+			return 1;
+		}
+
+		it->nodes[it->depth] = item->node;
+		it->pos[it->depth] = 0;
+		it->depth++;
+	}
+
+	return 0;
+}
+
+static Object* obj_map(MapNode* root, size_t count) {
+	Object* obj = obj_create(MAP);
+	obj->map.root = root;
+	obj->map.count = count;
+
+	return obj;
+}
+
+static Object* map_dissoc(Object* map, Object* key) {
+	if (!map->map.root) return map;
+
+	int removed = 0;
+	MapNode* root = mapnode_dissoc(map->map.root, 0, key, obj_hash(key), &removed);
+	if (!removed) {
+		mapnode_release(root);
+		return map;
+	}
+
+	return obj_map(root, map->map.count - 1);
+}
+
+// assigning nil removes the key, same as tables
+static Object* map_assoc(Object* map, Object* key, Object* value) {
+	if (value == obj_nil) return map_dissoc(map, key);
+	if (key->kind == STR) str_materialize(key);
+
+	MapItem leaf;
+	leaf.key = key;
+	leaf.value = value;
+	leaf.hash = obj_hash(key);
+
+	int added = 0;
+	MapNode* root = mapnode_assoc(map->map.root, 0, &leaf, &added);
+	if (root == map->map.root) {
+		mapnode_release(root);
+		return map;
+	}
+
+	return obj_map(root, map->map.count + added);
+}
+
+static inline Object* map_get(Object* map, Object* key) {
+	return mapnode_get(map->map.root, key, obj_hash(key));
+}
+
 typedef struct VarMapEntry {
 	char* key;
 	Object* value;
@@ -3077,45 +4641,79 @@ typedef struct Frame {
 	size_t iptr;
 	size_t scope;
 	size_t base;
+	// arguments either come in `args` or sit on the stack from `argbase`
 	Vector* args;
+	size_t argbase;
+	size_t argc;
 	Object* ret;
 	int protected;
+	// whether the caller takes every returned value or only the last one
+	int multret;
+	// the function being run, `src` and `name` are borrowed from it while it is set
+	Object* func;
 	struct Frame* next;
 } Frame;
 
-static Frame* frame_create(const char* src, const char* name, Bytecode* bc, size_t scope, size_t base, Vector* args) {
-	Frame* frame = gc_malloc(sizeof(Frame));
-	frame->src = gc_strdup(src);
-	frame->name = gc_strdup(name);
+static Frame* frame_pool[FRAME_POOL_LIMIT];
+static size_t frame_poolc = 0;
+
+static Frame* frame_alloc(Bytecode* bc, size_t scope, size_t base, Vector* args) {
+	Frame* frame = frame_poolc > 0 ? frame_pool[--frame_poolc] : gc_malloc(sizeof(Frame));
+	frame->ln = 0;
 	frame->bc = bc;
 	if (bc) bc->ref++;
 	frame->iptr = 0;
 	frame->scope = scope;
 	frame->base = base;
 	frame->args = args;
+	frame->argbase = 0;
+	frame->argc = 0;
 	frame->ret = obj_nil;
 	frame->protected = 0;
+	frame->multret = 0;
+	frame->func = NULL;
 	frame->next = NULL;
 
 	return frame;
 }
 
+static Frame* frame_create(const char* src, const char* name, Bytecode* bc, size_t scope, size_t base, Vector* args) {
+	Frame* frame = frame_alloc(bc, scope, base, args);
+	frame->src = gc_strdup(src);
+	frame->name = gc_strdup(name);
+
+	return frame;
+}
+
+// frames for calls come from the pool and point at the callee's names, so a
+// call costs no allocation until the frame ends up in a traceback
+static Frame* frame_call(Object* func, size_t scope, size_t base, Vector* args) {
+	Frame* frame = frame_alloc(func->func.bc, scope, base, args);
+	frame->src = func->func.src;
+	frame->name = func->func.name;
+	frame->func = func;
+
+	return frame;
+}
+
 static void frame_free(Frame* frame, Info** info_p) {
 	if (!frame) return;
 	if (info_p) {
 		Info* info = gc_malloc(sizeof(Info));
-		info->src = frame->src;
-		info->name = frame->name;
+		info->src = frame->func ? gc_strdup(frame->src) : frame->src;
+		info->name = frame->func ? gc_strdup(frame->name) : frame->name;
 		info->ln = frame->ln;
 		info->next = (*info_p);
 		(*info_p) = info;
-	} else {
+	} else if (!frame->func) {
 		gc_free(frame->src);
 		gc_free(frame->name);
 	}
 	bc_free(frame->bc);
 	vec_free(frame->args);
-	gc_free(frame);
+	if (frame_poolc < FRAME_POOL_LIMIT) {
+		frame_pool[frame_poolc++] = frame;
+	} else gc_free(frame);
 }
 
 enum {
@@ -3131,7 +4729,10 @@ typedef struct tug_Task {
 	Vector* varmaps;
 	VarMap* global;
 	size_t frame_count;
-	Vector* stack;
+	// operand stack, `sp` is the number of live slots
+	Object** stack;
+	size_t sp;
+	size_t stack_cap;
 	Info* info;
 	char msg[2048];
 	int state;
@@ -3147,7 +4748,9 @@ static Task* task_create(const char* src, Bytecode* bc) {
 	vec_push(task->varmaps, map);
 	task->global = varmap_create();
 	task->frame_count = 1;
-	task->stack = vec_create();
+	task->stack = gc_malloc(64 * sizeof(Object*));
+	task->sp = 0;
+	task->stack_cap = 64;
 	task->info = NULL;
 	task->state = TASK_NEW;
 
@@ -3177,6 +4780,16 @@ static double read_num(Task* task) {
 	return value;
 }
 
+static const char* read_lstr(Task* task, size_t* len) {
+	Frame* frame = task->frame;
+	memcpy(len, &frame->bc->data[frame->iptr], sizeof(size_t));
+
+	const char* str = (const char*)&frame->bc->data[frame->iptr + sizeof(size_t)];
+	frame->iptr += sizeof(size_t) + *len + 1;
+
+	return str;
+}
+
 static const char* read_str(Task* task) {
 	Frame* frame = task->frame;
 
@@ -3215,8 +4828,14 @@ static Bytecode* read_bc(Task* task) {
 
 #define set_addr(__T, __addr) ((__T)->frame->iptr = (__addr))
 
-static void push_obj(Task* task, Object* obj) {
-	vec_push(task->stack, obj);
+static void stack_grow(Task* task) {
+	task->stack_cap *= 2;
+	task->stack = gc_realloc(task->stack, task->stack_cap * sizeof(Object*));
+}
+
+static inline void push_obj(Task* task, Object* obj) {
+	if (task->sp == task->stack_cap) stack_grow(task);
+	task->stack[task->sp++] = obj;
 }
 
 static void gc_collect_obj(Object* obj);
@@ -3227,7 +4846,44 @@ static inline Object* gc_obj(Object* obj) {
 }
 
 #define new_num(__num) gc_obj(obj_num(__num))
+
+// small non-negative integers come from the shared cache
+static inline Object* box_num(double num) {
+	return num >= 0 && num < 128 && num == (int)num ? &num_ascii[(int)num] : new_num(num);
+}
 #define new_str(__str) gc_obj(obj_str((char*)__str))
+#define new_lstr(__str, __len) gc_obj(obj_lstr((char*)(__str), (__len)))
+
+static Object* new_strcopy(const char* str, size_t len);
+
+// `len` bytes of `str` from `start`, sharing the bytes when that's worth it
+static Object* new_strslice(Object* str, size_t start, size_t len) {
+	Object* parent = str->m == STR_VIEW ? str->parent : str;
+	if (len <= STR_INLINE_MAX || (parent->len > STR_VIEW_PIN && len < parent->len / 16)) {
+		return new_strcopy(str->str + start, len);
+	}
+	if (start == 0 && len == str->len) return str;
+
+	Object* obj = obj_create(STR);
+	obj->str = str->str + start;
+	obj->len = len;
+	obj->m = STR_VIEW;
+	obj->parent = parent;
+
+	return gc_obj(obj);
+}
+
+// copies `len` bytes into a new string
+static Object* new_strcopy(const char* str, size_t len) {
+	if (len == 1) return &str_chars[(uint8_t)str[0]];
+	if (len <= STR_INLINE_MAX) return gc_obj(obj_inlstr(str, len));
+
+	char* copy = gc_malloc(len + 1);
+	memcpy(copy, str, len);
+	copy[len] = '\0';
+
+	return new_lstr(copy, len);
+}
 
 static inline VarMap* get_map(Task* task);
 // Expecting `params` must be an array of `const char*`
@@ -3259,64 +4915,138 @@ static Object* new_func(Task* task, char* name, Vector* params, Bytecode* bc) {
 #define push_str(T, __str) push_obj((T), new_str((__str)))
 #define push_newtable(T) push_obj((T), new_table())
 
-static Vector* pop_nvalue(Task* task, size_t n) {
-	Vector* res = vec_serve(n);
-	Frame* frame = task->frame;
-	Vector* stack = task->stack;
+static inline Object* pop_tvalue(Task* task) {
+	if (get_base(task) >= task->sp) return obj_nil;
 
-	for (size_t i = 0; i < n; i++) {
-		Object* obj;
+	return task->stack[--task->sp];
+}
 
-		if (get_base(task) >= stack->count) {
-			obj = obj_nil;
-		} else {
-			obj = vec_pop(stack);
-			obj = obj ? obj : obj_nil;
-		}
+static inline Object* peek_tvalue(Task* task) {
+	if (get_base(task) >= task->sp) return obj_nil;
 
-		if (vec_count(res) < n) {
-			if (obj->kind == TUPLE) {
-				while (vec_count(res) < n && vec_count(obj->tuple) > 0) {
-					vec_pushfirst(res, vec_pop(obj->tuple));
-				}
-			} else vec_pushfirst(res, obj);
-		}
+	return task->stack[task->sp - 1];
+}
+
+// a multiple result on top gives up its last value, which is what a single-value context sees
+static inline Object* pop_value(Task* task) {
+	Object* obj = pop_tvalue(task);
+	if (obj->kind == MULTRET) {
+		task->sp -= obj->len;
+		return task->stack[task->sp + obj->len - 1];
 	}
+	if (obj->kind != TUPLE) return obj;
 
-	return res;
+	return vec_count(obj->tuple) ? vec_peek(obj->tuple) : obj_nil;
 }
 
-static Object* pop_value(Task* task) {
-	Vector* objs = pop_nvalue(task, 1);
-	Object* obj = vec_pop(objs);
-	vec_free(objs);
-
+static inline Object* peek_value(Task* task) {
+	Object* obj = peek_tvalue(task);
+	if (obj->kind == MULTRET) return task->stack[task->sp - 2];
+	if (obj->kind == TUPLE) return vec_count(obj->tuple) ? vec_peek(obj->tuple) : obj_nil;
 	return obj;
 }
 
-static Object* pop_tvalue(Task* task) {
-	Frame* frame = task->frame;
-	Vector* stack = task->stack;
-		
-	if (get_base(task) >= stack->count) return obj_nil;
+// the first of the values on top, multiple or not, and drops them
+static Object* pop_first(Task* task) {
+	Object* obj = pop_tvalue(task);
+	if (obj->kind == MULTRET) {
+		task->sp -= obj->len;
+		return task->stack[task->sp];
+	}
+	if (obj->kind != TUPLE) return obj;
 
-	return vec_pop(stack);
+	return vec_count(obj->tuple) ? vec_get(obj->tuple, 0) : obj_nil;
 }
 
-static Object* peek_tvalue(Task* task) {
-	Frame* frame = task->frame;
-	Vector* stack = task->stack;
+// pops the values on top for C, a multiple result has to be stored somewhere so
+// this is where it becomes a tuple
+static Object* pop_result(Task* task) {
+	Object* obj = pop_tvalue(task);
+	if (obj->kind != MULTRET) return obj;
 
-	if (get_base(task) >= stack->count) return obj_nil;
-	return vec_peek(stack);
-}
+	size_t count = obj->len;
+	task->sp -= count;
+	Vector* tuple = vec_serve(count);
+	for (size_t i = 0; i < count; i++) {
+		vec_push(tuple, task->stack[task->sp + i]);
+	}
+	obj = gc_obj(obj_create(TUPLE));
+	obj->tuple = tuple;
 
-static Object* peek_value(Task* task) {
-	Object* obj = peek_tvalue(task);
-	if (obj->kind == TUPLE) return vec_peek(obj->tuple);
 	return obj;
 }
 
+// slot where the last `exprs` expressions on the stack start, a multiple
+// result spans its values and its mark
+static size_t expr_start(Task* task, size_t exprs) {
+	size_t base = get_base(task);
+	size_t pos = task->sp;
+	while (exprs-- > 0 && pos > base) {
+		Object* obj = task->stack[pos - 1];
+		pos -= obj->kind == MULTRET ? obj->len + 1 : 1;
+	}
+
+	return pos;
+}
+
+// lays the values from `start` out one per slot, marks are dropped and boxed
+// tuples spread, and returns how many there are
+static size_t expr_flatten(Task* task, size_t start) {
+	size_t count = 0;
+	int boxed = 0;
+	for (size_t i = start; i < task->sp; i++) {
+		Object* obj = task->stack[i];
+		if (obj->kind == MULTRET) continue;
+		if (obj->kind == TUPLE) {
+			boxed = 1;
+			break;
+		}
+		task->stack[start + count++] = obj;
+	}
+
+	if (boxed) {
+		Vector* values = vec_serve(task->sp - start);
+		for (size_t i = start; i < task->sp; i++) {
+			Object* obj = task->stack[i];
+			if (obj->kind == TUPLE) {
+				for (size_t j = 0; j < vec_count(obj->tuple); j++) {
+					vec_push(values, vec_get(obj->tuple, j));
+				}
+			} else if (obj->kind != MULTRET) vec_push(values, obj);
+		}
+		task->sp = start;
+		for (size_t i = 0; i < vec_count(values); i++) {
+			push_obj(task, vec_get(values, i));
+		}
+		count = vec_count(values);
+		vec_free(values);
+	}
+	task->sp = start + count;
+
+	return count;
+}
+
+// turns the `count` values from `start` into one result on top
+static void push_multret(Task* task, size_t start, size_t count) {
+	if (count == 0) {
+		task->sp = start;
+		push_obj(task, obj_nil);
+	} else if (count == 1) {
+		task->sp = start + 1;
+	} else if (count <= MULTRET_MAX) {
+		task->sp = start + count;
+		push_obj(task, &multret_marks[count]);
+	} else {
+		Vector* tuple = vec_serve(count);
+		for (size_t i = 0; i < count; i++) {
+			vec_push(tuple, task->stack[start + i]);
+		}
+		task->sp = start;
+		Object* obj = gc_obj(obj_create(TUPLE));
+		obj->tuple = tuple;
+		push_obj(task, obj);
+	}
+}
 static void assign_err(Task* task, const char* fmt, ...) {
 	va_list args;
 	va_start(args, fmt);
@@ -3345,19 +5075,111 @@ static Object* get_var(Task* task, const char* name) {
 
 static Object* get_arg(Task* task, size_t idx) {
 	Frame* frame = task->frame;
-	if (frame->args == NULL) return obj_nil;
+	if (frame->args == NULL) return idx < frame->argc ? task->stack[frame->argbase + idx] : obj_nil;
+	if (idx >= vec_count(frame->args)) return obj_nil;
 	Object* res = vec_get(frame->args, idx);
 	if (res == NULL) return obj_nil;
 
 	return res;
 }
 
-#define get_argc(__T) (((__T)->frame->args == NULL) ? 0 : vec_count((__T)->frame->args))
+#define get_argc(__T) (((__T)->frame->args == NULL) ? (__T)->frame->argc : vec_count((__T)->frame->args))
 
 jmp_buf cfunc_jmp_buf;
 
-void call_obj(Task* task, Object* obj, Vector* args, int f, int protected) {
-	if (obj->kind == TABLE && obj->metatable != obj_nil) {
+// runs a C function on the frame that was just pushed for it, C functions can call
+// back into scripts and other C functions so the outer jump target is kept aside
+static void cfunc_run(Task* task, Object* obj) {
+	jmp_buf outer;
+	memcpy(outer, cfunc_jmp_buf, sizeof(jmp_buf));
+	if (setjmp(cfunc_jmp_buf) == 0) {
+		obj->func.cfunc(task);
+	}
+	memcpy(cfunc_jmp_buf, outer, sizeof(jmp_buf));
+}
+
+// a tuple in a single-value slot stands for its last value, as pop_value gives it
+static inline Object* slot_value(Object* obj) {
+	if (obj->kind != TUPLE) return obj;
+	return vec_count(obj->tuple) ? vec_peek(obj->tuple) : obj_nil;
+}
+
+// pops the frame of a C function that returned and puts its result at `dst`,
+// values given to tug_rets sit on top of the stack under their mark
+static void cfunc_finish(Task* task, size_t dst) {
+	Frame* frame = task->frame;
+	Object* ret = frame->ret;
+	int multret = frame->multret;
+	task->frame = frame->next;
+	task->frame_count--;
+	frame_free(frame, NULL);
+
+	if (ret->kind == MULTRET) {
+		size_t count = ret->len;
+		Object** values = &task->stack[task->sp - count];
+		if (!multret) {
+			ret = values[count - 1];
+		} else {
+			memmove(&task->stack[dst], values, count * sizeof(Object*));
+			task->sp = dst + count;
+			push_obj(task, ret);
+			return;
+		}
+	}
+	task->sp = dst;
+	push_obj(task, ret);
+}
+
+// calls `obj` with the `argc` stack slots from `argbase` as arguments, nothing is
+// copied; the slot below them holds the callee and the result replaces all of it
+static int call_window(Task* task, Object* obj, size_t argbase, size_t argc, int multret) {
+	if (task->frame_count >= TUG_CALL_LIMIT) {
+		assign_err(task, "stack overflow");
+		return 0;
+	}
+
+	Object** argv = &task->stack[argbase];
+	if (!obj->func.cfunc) {
+		Frame* new_frame = frame_call(obj, vec_count(task->varmaps), argbase - 1, NULL);
+		new_frame->multret = multret;
+		new_frame->next = task->frame;
+		task->frame->protected = 0;
+		task->frame = new_frame;
+		task->frame_count++;
+
+		VarMap* func_env = varmap_create();
+		gc_collect_closure(func_env);
+		func_env->next = obj->func.upper;
+		vec_push(task->varmaps, func_env);
+		size_t paramc = vec_count(obj->func.params);
+		for (size_t i = 0; i < paramc; i++) {
+			set_var(task, vec_get(obj->func.params, i), i < argc ? argv[i] : obj_nil);
+		}
+		// parameters hold the arguments now, the callee's stack starts where its slot was
+		task->sp = argbase - 1;
+
+		return 1;
+	}
+
+	Frame* new_frame = frame_call(obj, vec_count(task->varmaps), task->sp, NULL);
+	new_frame->argbase = argbase;
+	new_frame->argc = argc;
+	new_frame->multret = multret;
+	new_frame->next = task->frame;
+	task->frame->protected = 0;
+	task->frame = new_frame;
+	task->frame_count++;
+
+	cfunc_run(task, obj);
+	if (task->state != TASK_ERROR) cfunc_finish(task, argbase - 1);
+
+	return 0;
+}
+
+// returns 1 when a script frame was pushed and still has to be run,
+// cfuncs and struct constructors are done by the time this returns
+int call_obj(Task* task, Object* obj, Vector* args, int f, int protected, int multret) {
+	if (obj_hasmeta(obj)) {
 		Table* mtable = obj->metatable->table;
 		vec_pushfirst(args, obj);
 		Object* func = table_get(mtable, tug_conststr("__call"));
@@ -3365,20 +5187,41 @@ void call_obj(Task* task, Object* obj, Vector* args, int f, int protected) {
 		if (obj->kind != FUNC) {
 			if (f) vec_free(args);
 			assign_err(task, "metamethod '__call' must be 'func', got '%s'", obj_type(obj));
-			return;
+			return 0;
+		}
+	}
+	if (obj->kind == STRUCT) {
+		Shape* shape = obj->shape;
+		size_t argc = vec_count(args);
+		if (argc > shape->count) {
+			vec_free(args);
+			assign_err(task, "too many arguments to '%s' (expected %zu, got %zu)", shape->name, shape->count, argc);
+			return 0;
+		}
+
+		Object* record = gc_obj(obj_record(obj));
+		for (size_t i = 0; i < argc; i++) {
+			Object* arg = vec_get(args, i);
+			record->slots[i] = arg ? arg : obj_nil;
 		}
+		vec_free(args);
+
+		push_obj(task, record);
+		return 0;
 	}
+
 	if (obj->kind != FUNC) {
 		if (f) vec_free(args);
 		assign_err(task, "unable to call '%s'", obj_type(obj));
-		return;
+		return 0;
 	} else if (task->frame_count >= TUG_CALL_LIMIT) {
 		if (f) vec_free(args);
 		assign_err(task, "stack overflow");
-		return;
+		return 0;
 	}
 
-	Frame* new_frame = frame_create(obj->func.src, obj->func.name, obj->func.bc, vec_count(task->varmaps), vec_count(task->stack), args);
+	Frame* new_frame = frame_call(obj, vec_count(task->varmaps), task->sp, args);
+	new_frame->multret = multret;
 	new_frame->next = task->frame;
 	task->frame->protected = protected;
 	task->frame = new_frame;
@@ -3396,34 +5239,260 @@ void call_obj(Task* task, Object* obj, Vector* args, int f, int protected) {
 			if (i >= argc) set_var(task, vec_get(obj->func.params, i), obj_nil);
 			else set_var(task, vec_get(obj->func.params, i), vec_get(args, i));
 		}
+
+		return 1;
 	} else {
-		if (setjmp(cfunc_jmp_buf) == 0) {
-			obj->func.cfunc(task);
-		}
+		cfunc_run(task, obj);
 
 		if (task->state != TASK_ERROR) {
-			push_obj(task, task->frame->ret);
-
-			Frame* next_frame = task->frame->next;
-			frame_free(task->frame, NULL);
-			task->frame = next_frame;
+			cfunc_finish(task, task->frame->base);
+		} else if (protected) {
+			// the caller catches this, drop the failed frame right here since
+			// there is no task_exec loop between it and the caller to unwind it
+			Frame* frame = task->frame;
+			task->sp = frame->base;
+			task->varmaps->count = frame->scope;
+			task->frame = frame->next;
 			task->frame_count--;
+			frame_free(frame, NULL);
+
+			info_free(task->info);
+			task->info = NULL;
+			task->frame->protected = 0;
 		}
 	}
+
+	return 0;
 }
 
-static void set_ret(Task* task, Object* obj) {
-	if (task->frame) task->frame->ret = obj;
+// stores into an f64array or i64array, 0 with the error set when it can't
+static int array_setindex(Task* task, Object* obj, Object* key, Object* value) {
+	if (obj->frozen) {
+		assign_err(task, "unable to set index of frozen '%s'", obj_type(obj));
+		return 0;
+	} else if (key->kind != NUM) {
+		assign_err(task, "unable to set %s index with '%s'", obj_type(obj), obj_type(key));
+		return 0;
+	} else if (value->kind != NUM) {
+		assign_err(task, "unable to store '%s' in '%s'", obj_type(value), obj_type(obj));
+		return 0;
+	}
+
+	long idx = (long)key->num;
+	if (idx < 0 || (size_t)idx >= obj->arr.len) {
+		assign_err(task, "set index out of range");
+		return 0;
+	}
+	array_put(obj, idx, value->num);
+
+	return 1;
 }
 
-static Object* get_ret(Task* task) {
-	if (task->frame) return task->frame->ret;
-	return obj_nil;
+static void get_index(Task* task, Object* obj, Object* key) {
+	if (obj->kind == TABLE) {
+		if (obj->metatable != obj_nil) {
+			Object* func = table_get(obj->metatable->table, tug_conststr("__get"));
+
+			if (func != obj_nil) {
+				Vector* args = vec_serve(3);
+				vec_push(args, obj);
+				vec_push(args, key);
+
+				call_obj(task, func, args, 1, 0, 0);
+				return;
+			}
+		}
+
+		push_obj(task, table_get(obj->table, key));
+	} else if (obj->kind == RECORD) {
+		long slot = key->kind == STR ? shape_find(obj->shape, str_cstr(key)) : -1;
+		if (slot >= 0) {
+			push_obj(task, obj->slots[slot]);
+			return;
+		}
+
+		// fields are fixed, anything else is left to the metatable
+		if (obj->metatable != obj_nil) {
+			Object* func = table_get(obj->metatable->table, tug_conststr("__get"));
+
+			if (func != obj_nil) {
+				Vector* args = vec_serve(3);
+				vec_push(args, obj);
+				vec_push(args, key);
+
+				call_obj(task, func, args, 1, 0, 0);
+				return;
+			}
+		}
+
+		if (key->kind == STR) assign_err(task, "'%s' has no field '%s'", obj->shape->name, str_cstr(key));
+		else assign_err(task, "unable to get index '%s' with '%s'", obj_type(obj), obj_type(key));
+	} else if (obj->kind == STR && key->kind == NUM) {
+		long idx = (long)key->num;
+		if (idx < 0 || idx >= obj->len) {
+			push_obj(task, obj_nil);
+			return;
+		}
+
+		push_obj(task, new_strcopy(&obj->str[idx], 1));
+	} else if (obj->kind == LIST && key->kind == NUM) {
+		long idx = (long)key->num;
+		if (idx < 0 || idx >= obj->list->count) {
+			push_obj(task, obj_nil);
+			return;
+		}
+
+		push_obj(task, list_get(obj->list, idx));
+	} else if ((obj->kind == F64ARRAY || obj->kind == I64ARRAY) && key->kind == NUM) {
+		long idx = (long)key->num;
+		if (idx < 0 || (size_t)idx >= obj->arr.len) {
+			push_obj(task, obj_nil);
+			return;
+		}
+
+		push_obj(task, box_num(array_get(obj, idx)));
+	} else if (obj->kind == MAP) {
+		push_obj(task, map_get(obj, key));
+	} else {
+		assign_err(task, "unable to get index '%s' with '%s'", obj_type(obj), obj_type(key));
+	}
+}
+
+static void task_exec(Task* task, Frame* stop);
+// what `for ... in` walks over `obj`, after '__iter' had its say; NULL after an error
+static Object* iter_create(Task* task, Object* obj) {
+	int meta = 0;
+	if (obj_hasmeta(obj)) {
+		Table* mtable = obj->metatable->table;
+		Object* func = table_get(mtable, tug_conststr("__iter"));
+
+		if (func != obj_nil) {
+			Vector* args = vec_serve(1);
+			vec_push(args, obj);
+
+			Object* args_obj = gc_obj(obj_create(TUPLE));
+			args_obj->tuple = args;
+
+			obj = tug_call(task, func, args_obj);
+			if (tuglib_iserr(task)) return NULL;
+			meta = 1;
+		}
+	}
+
+	Object* iter_obj = obj_iter(obj);
+	if (iter_obj == NULL) {
+		if (meta) {
+			assign_err(task, "metamethod '__iter' must return an iterable, got '%s'", obj_type(obj));
+		} else {
+			assign_err(task, "unable to iterate '%s'", obj_type(obj));
+		}
+		return NULL;
+	}
+
+	return gc_obj(iter_obj);
+}
+
+// pushes the values of the next step and counts them in `count`, `want` only
+// says whether values that cost an allocation are worth making;
+// 0 once the iterator is exhausted or when the step failed
+static int iter_step(Task* task, Object* iter_obj, size_t want, size_t* count) {
+	*count = 0;
+	if (iter_obj->kind == ITER_STR) {
+		if (iter_obj->iter.idx >= iter_obj->iter.len) return 0;
+		push_obj(task, new_strcopy(&iter_obj->iter.obj->str[iter_obj->iter.idx++], 1));
+		*count = 1;
+	} else if (iter_obj->kind == ITER_UTF8) {
+		Object* str = iter_obj->iter.obj;
+		size_t idx = iter_obj->iter.idx;
+		if (idx >= iter_obj->iter.len) return 0;
+
+		uint32_t cp = (uint8_t)str->str[idx];
+		size_t n = cp < 0x80 ? 1 : utf8_decode(str->str + idx, iter_obj->iter.len - idx, &cp);
+		if (n == 0) {
+			assign_err(task, "invalid UTF-8 code at byte %zu", idx);
+			return 0;
+		}
+		iter_obj->iter.idx += n;
+		push_obj(task, box_num((double)cp));
+		if (want >= 2) push_obj(task, box_num((double)idx));
+		*count = want >= 2 ? 2 : 1;
+	} else if (iter_obj->kind == ITER_TABLE) {
+		Object* key;
+		Object* value;
+		if (!table_next(iter_obj->iter.obj->table, &iter_obj->iter.cursor, &key, &value)) return 0;
+		push_obj(task, key);
+		push_obj(task, value);
+		*count = 2;
+	} else if (iter_obj->kind == ITER_MAP) {
+		Object* key;
+		Object* value;
+		if (!mapiter_next(iter_obj->iter.state, &key, &value)) return 0;
+		push_obj(task, key);
+		push_obj(task, value);
+		*count = 2;
+	} else if (iter_obj->kind == ITER_ARRAY) {
+		Object* arr = iter_obj->iter.obj;
+		if (iter_obj->iter.idx >= arr->arr.len) return 0;
+		push_obj(task, box_num(array_get(arr, iter_obj->iter.idx++)));
+		*count = 1;
+	} else if (iter_obj->kind == ITER_LIST) {
+		List* list = iter_obj->iter.obj->list;
+		if (iter_obj->iter.idx >= list->count) return 0;
+		push_obj(task, list_get(list, iter_obj->iter.idx++));
+		*count = 1;
+	} else {
+		Object* func = tuglib_getmetafield(iter_obj, "__next");
+		if (func == obj_nil) {
+			assign_err(task, "iteration fatal error");
+			return 0;
+		}
+
+		Vector* args = vec_serve(1);
+		vec_push(args, iter_obj);
+		if (call_obj(task, func, args, 1, 0, 1) && !tuglib_iserr(task)) task_exec(task, task->frame->next);
+		if (tuglib_iserr(task)) return 0;
+
+		// the flag leads the values '__next' left on the stack, it's dropped from them
+		Object* ret = pop_tvalue(task);
+		Object* flag;
+		if (ret->kind == MULTRET) {
+			size_t retc = ret->len;
+			size_t base = task->sp - retc;
+			flag = retc ? task->stack[base] : obj_nil;
+			if (retc) {
+				memmove(&task->stack[base], &task->stack[base + 1], (retc - 1) * sizeof(Object*));
+				task->sp--;
+				*count = retc - 1;
+			}
+		} else if (ret->kind == TUPLE) {
+			size_t retc = vec_count(ret->tuple);
+			flag = retc ? vec_get(ret->tuple, 0) : obj_nil;
+			for (size_t i = 1; i < retc; i++) {
+				push_obj(task, vec_get(ret->tuple, i));
+			}
+			*count = retc ? retc - 1 : 0;
+		} else flag = ret;
+
+		if (flag == obj_nil || flag == obj_false) {
+			task->sp -= *count;
+			*count = 0;
+			return 0;
+		} else if (flag != obj_true) {
+			task->sp -= *count;
+			*count = 0;
+			assign_err(task, "metamethod '__next' must return 'bool' or 'nil', got '%s'", obj_type(flag));
+			return 0;
+		}
+	}
+
+	return 1;
 }
 
 static void gc_run(void);
-static void task_exec(Task* task) {
-	#define call_fobj(_obj, _args) call_obj(task, (_obj), (_args), 1, 0); if (!tuglib_iserr(task)) {task_exec(task); if (tuglib_iserr(task)) break;}
+// runs until the frame below the one it was entered with is back on top (stop), so
+// script calls made from inside it return here instead of to whoever nested us
+static void task_exec(Task* task, Frame* stop) {
+	#define call_fobj(_obj, _args) if (call_obj(task, (_obj), (_args), 1, 0, 0) && !tuglib_iserr(task)) task_exec(task, task->frame->next); if (tuglib_iserr(task)) break;
 	if (task->frame->bc == NULL) {
 		return;
 	}
@@ -3441,8 +5510,9 @@ static void task_exec(Task* task) {
 				push_num(task, num);
 			} break;
 			case OP_STR: {
-				const char* str = read_str(task);
-				push_str(task, gc_strdup(str));
+				size_t len;
+				const char* str = read_lstr(task, &len);
+				push_obj(task, new_strcopy(str, len));
 			} break;
 			case OP_ADD:
 			case OP_SUB:
@@ -3461,7 +5531,7 @@ static void task_exec(Task* task) {
 				Object* o2 = pop_value(task);
 				Object* o1 = pop_value(task);
 
-				if (o1->kind == TABLE && o1->metatable->kind == TABLE) {
+				if (obj_hasmeta(o1)) {
 					Table* mtable = o1->metatable->table;
 
 					const char* method_name = NULL;
@@ -3497,12 +5567,13 @@ static void task_exec(Task* task) {
 							case OP_LE:
 							case OP_EQ:
 							case OP_NE: {
-								if (tug_gettype(res) != TRUE && tug_gettype(res) != FALSE && tug_gettype(res) != NIL) {
+								if (res->kind != TRUE && res->kind != FALSE && res->kind != NIL) {
 									assign_err(task, "metamethod '%s' must return 'bool', got '%s'", method_name, obj_type(res));
 								} else {
 									push_obj(task, res);
 								}
 							} break;
+							default: push_obj(task, res); break;
 						}
 						break;
 					}
@@ -3555,26 +5626,33 @@ static void task_exec(Task* task) {
 				) {
 					switch (op) {
 						case OP_GT: {
-							push_obj(task, obj_truth(strcmp(o1->str, o2->str) > 0));
+							push_obj(task, obj_truth(str_cmp(o1, o2) > 0));
 						} break;
 						case OP_LT: {
-							push_obj(task, obj_truth(strcmp(o1->str, o2->str) < 0));
+							push_obj(task, obj_truth(str_cmp(o1, o2) < 0));
 						} break;
 						case OP_GE: {
-							push_obj(task, obj_truth(strcmp(o1->str, o2->str) >= 0));
+							push_obj(task, obj_truth(str_cmp(o1, o2) >= 0));
 						} break;
 						case OP_LE: {
-							push_obj(task, obj_truth(strcmp(o1->str, o2->str) <= 0));
+							push_obj(task, obj_truth(str_cmp(o1, o2) <= 0));
 						} break;
 						case OP_ADD: {
-							size_t len1 = strlen(o1->str);
-							size_t len2 = strlen(o2->str);
+							size_t len1 = o1->len;
+							size_t len2 = o2->len;
+							if (len1 + len2 <= STR_INLINE_MAX) {
+								char tmp[STR_INLINE_MAX];
+								memcpy(tmp, o1->str, len1);
+								memcpy(tmp + len1, o2->str, len2);
+								push_obj(task, new_strcopy(tmp, len1 + len2));
+								break;
+							}
 
 							char* res = gc_malloc(len1 + len2 + 1);
 							memcpy(res, o1->str, len1);
 							memcpy(res + len1, o2->str, len2);
 							res[len1 + len2] = '\0';
-							push_str(task, res);
+							push_obj(task, new_lstr(res, len1 + len2));
 						} break;
 					}
 				} else {
@@ -3594,19 +5672,31 @@ static void task_exec(Task* task) {
 				}
 			} break;
 			case OP_HALT: {
-				Frame* next_frame = task->frame->next;
-				frame_free(task->frame, NULL);
+				// only the result is left behind, whatever else the function had on the stack goes
+				Frame* frame = task->frame;
+				Object* ret = task->sp > frame->base ? task->stack[task->sp - 1] : obj_nil;
+				if (ret->kind == MULTRET && !frame->multret) ret = task->stack[task->sp - 2];
+				if (ret->kind == MULTRET) {
+					size_t slots = ret->len + 1;
+					memmove(&task->stack[frame->base], &task->stack[task->sp - slots], slots * sizeof(Object*));
+					task->sp = frame->base + slots;
+				} else {
+					task->sp = frame->base;
+					push_obj(task, ret);
+				}
+
+				Frame* next_frame = frame->next;
+				frame_free(frame, NULL);
 				task->frame = next_frame;
 				task->frame_count--;
-				set_ret(task, peek_tvalue(task));
 				if (task->frame == NULL) task->state = TASK_END;
 				else {
 					task->frame->protected = 0;
 				}
 
 				vec_pop(task->varmaps);
-				return;
-			}
+				if (task->frame == stop) return;
+			} break;
 
 			case OP_TRUE: push_obj(task, obj_true); break;
 			case OP_FALSE: push_obj(task, obj_false); break;
@@ -3676,7 +5766,7 @@ static void task_exec(Task* task) {
 				Object* obj = pop_value(task);
 
 				int err = 0;
-				if (obj->kind == TABLE && obj->metatable != obj_nil) {
+				if (obj_hasmeta(obj)) {
 					Table* mtable = obj->metatable->table;
 					Object* func;
 					if (op == OP_NOT) func = table_get(mtable, tug_conststr("__truth"));
@@ -3720,14 +5810,14 @@ static void task_exec(Task* task) {
 
 			case OP_POP_CLOSURE: {
 				VarMap* map = get_map(task);
-				map = map->next;
+				vec_set(task->varmaps, vec_count(task->varmaps) - 1, map->next);
 			} break;
 
 			case OP_JUMPP: {
 				size_t count = read_addr(task);
 				for (size_t i = 0; i < count; i++) {
 					VarMap* map = get_map(task);
-					map = map->next;
+					vec_set(task->varmaps, vec_count(task->varmaps) - 1, map->next);
 				}
 				set_addr(task, read_addr(task));
 			} break;
@@ -3766,11 +5856,7 @@ static void task_exec(Task* task) {
 									vec_push(args, tug_conststr(part));
 
 									call_fobj(mmethod, args);
-									Object* ret = pop_tvalue(task);
-									if (ret->kind == TUPLE) {
-										ret = vec_get(ret->tuple, 0);
-									}
-									obj = ret;
+									obj = pop_first(task);
 								} else if (obj->kind == TABLE) {
 									obj = table_get(obj->table, tug_conststr(part));
 								} else {
@@ -3805,47 +5891,46 @@ static void task_exec(Task* task) {
 
 						call_fobj(mmethod, args);
 						pop_value(task);
+					} else if (obj->frozen) {
+						assign_err(task, "unable to set field of frozen '%s'", obj_type(obj));
 					} else if (obj->kind == TABLE) {
 						table_set(obj->table, new_str(lastname), fobj);
 					} else {
 						assign_err(task, "unable to set function to field '%s'", obj_type(obj));
 					}
-				} else vec_push(task->stack, fobj);
+				} else push_obj(task, fobj);
 				vec_free(params);
 			} break;
 
 			case OP_CALL: {
 				size_t arg_count = read_addr(task);
 				size_t ln = read_addr(task);
+				uint8_t multret = read_byte(task);
 				task->frame->ln = ln;
 
-				Vector* args = vec_serve(arg_count);
+				size_t argbase = task->sp - arg_count;
+				Object** argv = &task->stack[argbase];
 				for (size_t i = 0; i < arg_count; i++) {
-					vec_pushfirst(args, pop_value(task));
+					argv[i] = slot_value(argv[i]);
 				}
 
-				Object* obj = pop_value(task);
-				call_obj(task, obj, args, 1, 0);
+				Object* obj = slot_value(task->stack[argbase - 1]);
+				if (obj->kind == FUNC) call_window(task, obj, argbase, arg_count, multret);
+				else {
+					// constructors and '__call' take the generic path with one copy of the arguments
+					Vector* args = vec_serve(arg_count);
+					for (size_t i = 0; i < arg_count; i++) {
+						vec_push(args, argv[i]);
+					}
+					task->sp = argbase - 1;
+					call_obj(task, obj, args, 1, 0, multret);
+				}
 			} break;
 
 			case OP_TUPLE: {
 				size_t count = read_addr(task);
-				Vector* tuple = vec_serve(count);
-
-				for (size_t i = 0; i < count; i++) {
-					Object* obj = pop_tvalue(task);
-					if (obj->kind == TUPLE) {
-						for (size_t i = vec_count(obj->tuple); i-- > 0;) {
-							vec_pushfirst(tuple, vec_get(obj->tuple, i));
-						}
-					} else vec_pushfirst(tuple, obj);
-				}
-
-				Object* obj = obj_create(TUPLE);
-				obj->tuple = tuple;
-
-				push_obj(task, obj);
-				gc_collect_obj(obj);
+				size_t start = expr_start(task, count);
+				push_multret(task, start, expr_flatten(task, start));
 			} break;
 
 			case OP_TABLE: {
@@ -3878,20 +5963,32 @@ static void task_exec(Task* task) {
 						}
 					}
 
-					if (!meta) table_set(table, key, value);
+					if (!meta) {
+						if (obj->frozen) {
+							assign_err(task, "unable to set index of frozen '%s'", obj_type(obj));
+							break;
+						}
+						table_set(table, key, value);
+					}
 				} else if (obj->kind == LIST) {
-					Vector* lvec = obj->list;
-					if (key->kind != NUM) {
+					List* lvec = obj->list;
+					if (obj->frozen) {
+						assign_err(task, "unable to set index of frozen '%s'", obj_type(obj));
+						break;
+					} else if (key->kind != NUM) {
 						assign_err(task, "unable to set list index with '%s'", obj_type(key));
 						break;
 					}
 
 					long idx = (long)key->num;
-					if (idx < 0 || idx >= vec_count(lvec)) {
+					if (idx < 0 || (size_t)idx >= lvec->count) {
 						assign_err(task, "set index out of range");
 						break;
 					}
-					lvec->array[idx] = value;
+					list_own(lvec);
+					list_set(lvec, idx, value);
+				} else if (obj->kind == F64ARRAY || obj->kind == I64ARRAY) {
+					if (!array_setindex(task, obj, key, value)) break;
 				} else {
 					assign_err(task, "unable to set index '%s'", obj_type(obj));
 					break;
@@ -3905,99 +6002,117 @@ static void task_exec(Task* task) {
 				Object* key = pop_value(task);
 				Object* obj = pop_value(task);
 
-				if (obj->kind == TABLE) {
-					Table* table = obj->table;
-					int meta = 0;
+				get_index(task, obj, key);
+			} break;
 
-					if (obj->metatable != obj_nil) {
-						Table* mtable = obj->metatable->table;
-						Object* func = table_get(mtable, tug_conststr("__get"));
+			case OP_SLICE: {
+				task->frame->ln = read_addr(task);
+				Object* end_obj = pop_value(task);
+				Object* start_obj = pop_value(task);
+				Object* obj = pop_value(task);
 
-						if (func != obj_nil) {
-							Vector* args = vec_serve(3);
-							vec_push(args, obj);
-							vec_push(args, key);
+				if (obj->kind != LIST && obj->kind != STR) {
+					assign_err(task, "unable to slice '%s'", obj_type(obj));
+					break;
+				} else if ((start_obj != obj_nil && start_obj->kind != NUM) || (end_obj != obj_nil && end_obj->kind != NUM)) {
+					assign_err(task, "slice bounds must be 'num' or 'nil'");
+					break;
+				}
 
-							call_obj(task, func, args, 1, 0);
-							meta = 1;
+				// bounds are clamped to the object like str.sub does
+				size_t len = obj->kind == LIST ? obj->list->count : obj->len;
+				double start = start_obj == obj_nil ? 0 : start_obj->num;
+				double end = end_obj == obj_nil ? (double)len : end_obj->num;
+				size_t from = start < 0 ? 0 : start > len ? len : (size_t)start;
+				size_t to = end < 0 ? 0 : end > len ? len : (size_t)end;
+				if (to < from) to = from;
+
+				if (obj->kind == LIST) push_obj(task, tug_listslice(obj, from, to));
+				else push_obj(task, new_strslice(obj, from, to - from));
+			} break;
+
+			case OP_STRUCT: {
+				const char* name = read_str(task);
+				size_t count = read_addr(task);
+				Shape* shape = shape_create(name, count);
+				for (size_t i = 0; i < count; i++) {
+					shape->fields[i] = gc_strdup(read_str(task));
+				}
+
+				push_obj(task, gc_obj(obj_struct(shape)));
+			} break;
+
+			case OP_GETFIELD: {
+				task->frame->ln = read_addr(task);
+				uint8_t* cache = &task->frame->bc->data[task->frame->iptr];
+				size_t id = read_addr(task);
+				size_t slot = read_addr(task);
+				Object* key = (Object*)(uintptr_t)read_addr(task);
+				size_t len;
+				const char* name = read_lstr(task, &len);
+				Object* obj = pop_value(task);
+
+				if (obj->kind == RECORD) {
+					Shape* shape = obj->shape;
+					if (shape->id != id) {
+						long found = shape_find(shape, name);
+						if (found >= 0) {
+							id = shape->id;
+							slot = (size_t)found;
+							memcpy(cache, &id, sizeof(size_t));
+							memcpy(cache + sizeof(size_t), &slot, sizeof(size_t));
 						}
 					}
 
-					if (!meta) push_obj(task, table_get(table, key));
-				} else if (obj->kind == STR && key->kind == NUM) {
-					long idx = (long)key->num;
-					if (idx < 0) {
-						push_obj(task, obj_nil);
-						break;
-					}
-					size_t len = strlen(obj->str);
-					if (idx > len) {
-						push_obj(task, obj_nil);
-						break;
-					}
-					
-					char res[2];
-					res[0] = obj->str[idx];
-					res[1] = '\0';
-					push_obj(task, tug_conststr(res));
-				} else if (obj->kind == LIST && key->kind == NUM) {
-					long idx = (long)key->num;
-					if (idx < 0) {
-						push_obj(task, obj_nil);
-						break;
-					}
-					size_t len = obj->list->count;
-					if (idx > len) {
-						push_obj(task, obj_nil);
+					if (shape->id == id) {
+						push_obj(task, obj->slots[slot]);
 						break;
 					}
-					
-					push_obj(task, vec_get(obj->list, idx));
-				} else {
-					assign_err(task, "unable to get index '%s' with '%s'", obj_type(obj), obj_type(key));
 				}
+
+				// the key is built the first time the site misses and kept there for good
+				if (!key) {
+					key = new_strcopy(name, len);
+					obj_freeze(key);
+					size_t addr = (size_t)(uintptr_t)key;
+					memcpy(cache + 2 * sizeof(size_t), &addr, sizeof(size_t));
+				}
+
+				if (obj->kind == TABLE && obj->metatable == obj_nil) push_obj(task, table_get(obj->table, key));
+				else get_index(task, obj, key);
 			} break;
 
 			case OP_MULTIASSIGN: {
-				task->frame->ln = read_addr(task);
-				uint8_t local = read_byte(task);
-				size_t value_count = read_addr(task);
-				size_t assign_count = read_addr(task);
-
-				Vector* objects = pop_nvalue(task, assign_count);
-				if (assign_count < value_count) {
-					for (size_t i = assign_count; i < value_count; i++) {
-						pop_tvalue(task);
-					}
-				}
-				Vector* leftside = vec_create();
-				ui8_array* kinds = ui8_array_create();
-				for (size_t i = 0; i < assign_count; i++) {
-					uint8_t kind = read_byte(task);
+				task->frame->ln = read_addr(task);
+				uint8_t local = read_byte(task);
+				size_t value_count = read_addr(task);
+				size_t assign_count = read_addr(task);
+				size_t index_count = read_addr(task);
 
-					if (kind) vec_push(leftside, (void*)read_str(task));
-					else vec_push(leftside, pop_nvalue(task, 2));
-					ui8_array_push(kinds, kind);
-				}
+				// values are spread in place, the object/key pairs of index targets sit below them
+				size_t start = expr_start(task, value_count);
+				size_t valuec = expr_flatten(task, start);
+				size_t pairs = start - 2 * index_count;
+				// surplus values are dropped from the front, the targets take the last ones
+				size_t skip = valuec > assign_count ? valuec - assign_count : 0;
 
 				uint8_t err = 0;
 				for (size_t i = 0; i < assign_count; i++) {
-					size_t ri = assign_count - i - 1;
-					uint8_t kind = ui8_array_get(kinds, ri);
-					Object* value = vec_get(objects, i);
+					uint8_t kind = read_byte(task);
+					const char* name = kind ? read_str(task) : NULL;
+					Object* value = skip + i < valuec ? task->stack[start + skip + i] : obj_nil;
 
 					if (!err) {
 						if (kind) {
-							const char* name = vec_get(leftside, ri);
 							if (local) {
 								set_var(task, name, value);
 							} else {
 								edit_var(task, name, value);
 							}
 						} else {
-							Vector* obj_key = vec_get(leftside, ri);
-							Object* obj = vec_get(obj_key, 0);
-							Object* key = vec_get(obj_key, 1);
+							Object* obj = task->stack[pairs];
+							Object* key = task->stack[pairs + 1];
+							pairs += 2;
 
 							if (obj->kind == TABLE) {
 								int meta = 0;
@@ -4018,65 +6133,73 @@ static void task_exec(Task* task) {
 									}
 								}
 
-								if (!meta) table_set(obj->table, key, value);
+								if (!meta) {
+									if (obj->frozen) {
+										assign_err(task, "unable to set index of frozen '%s'", obj_type(obj));
+										err = 1;
+									} else table_set(obj->table, key, value);
+								}
+							} else if (obj->kind == RECORD) {
+								long slot = key->kind == STR ? shape_find(obj->shape, str_cstr(key)) : -1;
+								Object* func = obj_nil;
+								if (slot < 0 && obj->metatable != obj_nil) {
+									func = table_get(obj->metatable->table, tug_conststr("__set"));
+								}
+
+								if (func != obj_nil) {
+									Vector* args = vec_serve(3);
+									vec_push(args, obj);
+									vec_push(args, key);
+									vec_push(args, value);
+
+									call_fobj(func, args);
+									err = task->state == TASK_ERROR;
+									pop_value(task);
+								} else if (obj->frozen) {
+									assign_err(task, "unable to set field of frozen '%s'", obj->shape->name);
+									err = 1;
+								} else if (slot >= 0) {
+									obj->slots[slot] = value;
+								} else {
+									if (key->kind == STR) assign_err(task, "'%s' has no field '%s'", obj->shape->name, str_cstr(key));
+									else assign_err(task, "unable to set index '%s' with '%s'", obj_type(obj), obj_type(key));
+									err = 1;
+								}
 							} else if (obj->kind == LIST) {
-								Vector* lvec = obj->list;
-								if (key->kind != NUM) {
+								List* lvec = obj->list;
+								if (obj->frozen) {
+									assign_err(task, "unable to set index of frozen '%s'", obj_type(obj));
+									err = 1;
+								} else if (key->kind != NUM) {
 									assign_err(task, "unable to set list index with '%s'", obj_type(key));
 									err = 1;
 								} else {
 									long idx = (long)key->num;
-									if (idx < 0 || idx >= vec_count(lvec)) {
+									if (idx < 0 || (size_t)idx >= lvec->count) {
 										assign_err(task, "set index out of range");
 										err = 1;
-									} else lvec->array[idx] = value;
+									} else {
+										list_own(lvec);
+										list_set(lvec, idx, value);
+									}
 								}
+							} else if (obj->kind == F64ARRAY || obj->kind == I64ARRAY) {
+								err = !array_setindex(task, obj, key, value);
 							} else {
 								assign_err(task, "unable to set index '%s'", obj_type(obj));
 								err = 1;
 							}
 						}
 					}
-
-					if (!kind) {
-						vec_free((Vector*)(vec_get(leftside, i)));
-					}
 				}
 
-				vec_free(objects);
-				vec_free(leftside);
-				ui8_array_free(kinds);
+				task->sp = start - 2 * index_count;
 			} break;
 
 			case OP_ITER: {
 				task->frame->ln = read_addr(task);
-				Object* obj = pop_value(task);
-				int meta = 0;
-				if (obj->kind == TABLE && obj->metatable != obj_nil) {
-					Table* mtable = obj->metatable->table;
-					Object* func = table_get(mtable, tug_conststr("__iter"));
-
-					if (func != obj_nil) {
-						Vector* args = vec_serve(1);
-						vec_push(args, obj);
-
-						Object* args_obj = gc_obj(obj_create(TUPLE));
-						args_obj->tuple = args;
-
-						obj = tug_call(task, func, args_obj);
-						meta = 1;
-					}
-				}
-				Object* iter_obj = obj_iter(obj);
-				if (iter_obj == NULL) {
-					if (meta) {
-						assign_err(task, "metamethod '__iter' must return an iterable, got '%s'", obj_type(obj));
-					} else {
-						assign_err(task, "unable to iterate '%s'", obj_type(obj));
-					}
-				} else {
-					push_obj(task, gc_obj(iter_obj));
-				}
+				Object* iter_obj = iter_create(task, pop_value(task));
+				if (iter_obj) push_obj(task, iter_obj);
 			} break;
 
 			case OP_NEXT: {
@@ -4088,91 +6211,84 @@ static void task_exec(Task* task) {
 				}
 				size_t pos = read_addr(task);
 
-				Object* iter_obj = peek_value(task);
-				int done = 0;
-				int used = 0;
-				if (iter_obj->kind == ITER_STR) {
-					if (iter_obj->iter.idx < iter_obj->iter.len) {
-						char str[2];
-						str[0] = iter_obj->iter.obj->str[iter_obj->iter.idx++];
-						str[1] = '\0';
-						set_var(task, vec_get(names, 0), tug_conststr(str));
-						used = 1;
-					} else {
-						done = 1;
-					}
-				} else if (iter_obj->kind == ITER_TABLE) {
-					Object* table_obj = iter_obj->iter.obj;
-					Table* table = table_obj->table;
-					if (iter_obj->iter.entry == NULL) {
-						while (iter_obj->iter.idx < table->capacity && !table->buckets[iter_obj->iter.idx]) {
-							iter_obj->iter.idx++;
-						}
-						iter_obj->iter.entry = table->buckets[iter_obj->iter.idx];
-					}
-					if (iter_obj->iter.entry == NULL) done = 1;
-					else {
-						set_var(task, vec_get(names, 0), iter_obj->iter.entry->key);
-						if (vec_count(names) >= 2) {
-							set_var(task, vec_get(names, 1), iter_obj->iter.entry->value);
-						}
-						iter_obj->iter.entry = iter_obj->iter.entry->next;
-						while (iter_obj->iter.entry == NULL && ++iter_obj->iter.idx < table->capacity) {
-							iter_obj->iter.entry = table->buckets[iter_obj->iter.idx];
-						}
-						used = 2;
+				size_t got;
+				if (iter_step(task, peek_value(task), count, &got)) {
+					Object** values = &task->stack[task->sp - got];
+					for (size_t i = 0; i < count; i++) {
+						set_var(task, (const char*)vec_get(names, i), i < got ? values[i] : obj_nil);
 					}
-				} else if (iter_obj->kind == ITER_LIST) {
-					Vector* list = iter_obj->iter.obj->list;
-					if (iter_obj->iter.idx < vec_count(list)) {
-						set_var(task, vec_get(names, 0), vec_get(list, iter_obj->iter.idx++));
-						used = 1;
-					} else done = 1;
-				} else {
-					Object* func = tuglib_getmetafield(iter_obj, "__next");
+					task->sp -= got;
+				} else if (!tuglib_iserr(task)) set_addr(task, pos);
+				vec_free(names);
+			} break;
+			
+			case OP_FORPREP: {
+				task->frame->ln = read_addr(task);
+				size_t count = read_addr(task);
+				size_t pos = read_addr(task);
 
-					if (func != obj_nil) {
-						Vector* args = vec_serve(1);
-						vec_push(args, iter_obj);
-						
-						call_fobj(func, args);
-						
-						Object* ret = pop_tvalue(task);
-						Object* dobj;
-						if (ret->kind == TUPLE) {
-							dobj = vec_get(ret->tuple, 0);
-							for (size_t i = 0; i < vec_count(names); i++) {
-								size_t j = i + 1;
-								if (j >= vec_count(ret->tuple)) break;
-								set_var(task, (const char*)vec_get(names, i), vec_get(ret->tuple, j));
-								used++;
-							}
-						} else dobj = ret;
+				// a rebound `range` falls through to a plain call and OP_ITER
+				Object* func = slot_value(task->stack[task->sp - count - 1]);
+				if (func->kind != FUNC || func->func.cfunc != __tuglib_range) break;
+
+				Object* step = count == 3 ? pop_value(task) : box_num(1);
+				Object* stop = pop_value(task);
+				Object* start = count > 1 ? pop_value(task) : box_num(0);
+				task->sp--;
+				set_addr(task, pos);
 
-						if (dobj == obj_nil || dobj == obj_false) {
-							done = 1;
-						} else if (dobj != obj_true) assign_err(task, "metamethod '__next' must return 'bool' or 'nil', got '%s'", obj_type(dobj));
-					} else assign_err(task, "iteration fatal error");
+				if (start->kind != NUM || stop->kind != NUM || step->kind != NUM) {
+					Object* bad = start->kind != NUM ? start : stop->kind != NUM ? stop : step;
+					assign_err(task, "'range' expects 'num', got '%s'", obj_type(bad));
+					break;
+				} else if (!isfinite(start->num) || !isfinite(stop->num) || !isfinite(step->num)) {
+					assign_err(task, "'range' bounds must be finite");
+					break;
+				} else if (step->num == 0) {
+					assign_err(task, "'range' step must not be zero");
+					break;
 				}
 
-				if (done) {
-					set_addr(task, pos);
-					pop_value(task);
-				} else {
-					for (size_t i = used; i < vec_count(names); i++) {
-						const char* name = (const char*)vec_get(names, i);
-						set_var(task, name, obj_nil);
-					}
+				// the counter lives unboxed in here, the loop variable only gets a copy
+				Object* range = gc_obj(obj_create(ITER_RANGE));
+				range->range.start = start->num;
+				range->range.stop = stop->num;
+				range->range.step = step->num;
+				range->range.idx = 0;
+				push_obj(task, range);
+			} break;
+
+			case OP_FORLOOP: {
+				const char* name = read_str(task);
+				size_t pos = read_addr(task);
+				Object* range = task->stack[task->sp - 1];
+				if (range->kind != ITER_RANGE) {
+					size_t got;
+					if (iter_step(task, range, 1, &got)) {
+						set_var(task, name, got ? task->stack[task->sp - got] : obj_nil);
+						task->sp -= got;
+					} else if (!tuglib_iserr(task)) set_addr(task, pos);
+					break;
 				}
-				vec_free(names);
+
+				// stepping by multiplication keeps fractional steps from drifting
+				double at = range->range.start + range->range.idx * range->range.step;
+
+				if (range->range.step > 0 ? at < range->range.stop : at > range->range.stop) {
+					set_var(task, name, box_num(at));
+					range->range.idx++;
+				} else set_addr(task, pos);
 			} break;
-			
+
 			case OP_LIST: {
 				size_t count = read_addr(task);
-				Vector* list = vec_create();
+				List* list = list_create(count);
+				list->count = count;
+				Object** values = &task->stack[task->sp - count];
 				for (size_t i = 0; i < count; i++) {
-					vec_pushfirst(list, pop_value(task));
+					list->items[i] = slot_value(values[i]);
 				}
+				task->sp -= count;
 				
 				Object* obj = gc_obj(obj_create(LIST));
 				obj->list = list;
@@ -4189,8 +6305,10 @@ static void task_exec(Task* task) {
 					task->info = NULL;
 					frame->protected = 0;
 					break;
+				} else if (frame == stop) {
+					break;
 				} else {
-					task->stack->count = frame->base;
+					task->sp = frame->base;
 					task->varmaps->count = frame->scope;
 				}
 
@@ -4214,7 +6332,7 @@ static void task_run(Task* task) {
 	task->state = TASK_RUNNING;
 
 	while (task->state == TASK_RUNNING) {
-		task_exec(task);
+		task_exec(task, NULL);
 	}
 }
 
@@ -4253,8 +6371,9 @@ static void task_close(Task* task) {
 	task->state = TASK_END;
 
 	vec_free(task->varmaps);
-	vec_free(task->stack);
+	gc_free(task->stack);
 	task->stack = NULL;
+	task->sp = 0;
 	info_free(task->info);
 }
 
@@ -4277,11 +6396,13 @@ typedef struct {
 static size_t gc_size;
 static size_t threshold;
 static Vector* objects;
+static Vector* frozen;
 static Vector* closures;
 static Vector* tasks;
 
 static void gc_init() {
 	objects = vec_create();
+	frozen = vec_create();
 	closures = vec_create();
 	tasks = vec_create();
 	gc_size = 0;
@@ -4338,29 +6459,52 @@ static inline void gc_collect_task(Task* task) {
 	vec_push(tasks, task);
 }
 
+// shared map nodes are visited once per collection
+static size_t gc_epoch = 0;
+
 static void gc_mark_closure(VarMap* varmap);
+static void gc_mark_obj(Object* obj);
+static void gc_mark_mapnode(MapNode* node) {
+	if (!node || node->epoch == gc_epoch) return;
+	node->epoch = gc_epoch;
+	for (uint32_t i = 0; i < node->size; i++) {
+		MapItem* item = &node->items[i];
+		if (item->key) {
+			gc_mark_obj(item->key);
+			gc_mark_obj(item->value);
+		} else gc_mark_mapnode(item->node);
+	}
+}
+
 static void gc_mark_obj(Object* obj) {
 	if (!obj || obj == obj_true || obj == obj_false || obj == obj_nil) return;
-	if (obj->marked) return;
+	if (obj->marked || obj->frozen) return;
 	obj->marked = 1;
 	if (obj->kind == TUPLE) {
 		for (size_t i = 0; i < vec_count(obj->tuple); i++) {
-			gc_mark_obj(obj);
+			gc_mark_obj(vec_get(obj->tuple, i));
 		}
 	} else if (obj->kind == TABLE) {
-		Table* table = obj->table;
-		for (size_t i = 0; i < table->capacity; i++) {
-			TableEntry* entry = table->buckets[i];
-
-			while (entry) {
-				gc_mark_obj(entry->key);
-				gc_mark_obj(entry->value);
-				entry = entry->next;
-			}
+		tug_Cursor cursor = {0, 0};
+		Object* key;
+		Object* value;
+		while (table_next(obj->table, &cursor, &key, &value)) {
+			gc_mark_obj(key);
+			gc_mark_obj(value);
 		}
 		
 		gc_mark_obj(obj->metatable);
-	} else if (obj->kind == ITER_STR || obj->kind == ITER_TABLE || obj->kind == ITER_LIST) gc_mark_obj(obj->iter.obj);
+		gc_mark_obj(obj->uservalue);
+	} else if (obj->kind == ITER_STR || obj->kind == ITER_UTF8 || obj->kind == ITER_TABLE || obj->kind == ITER_LIST || obj->kind == ITER_ARRAY || obj->kind == ITER_MAP) gc_mark_obj(obj->iter.obj);
+	else if (obj->kind == MAP) gc_mark_mapnode(obj->map.root);
+	else if (obj->kind == STR && obj->m == STR_VIEW) gc_mark_obj(obj->parent);
+	else if (obj->kind == STRUCT) gc_mark_obj(obj->metatable);
+	else if (obj->kind == RECORD) {
+		for (size_t i = 0; i < obj->shape->count; i++) {
+			gc_mark_obj(obj->slots[i]);
+		}
+		gc_mark_obj(obj->metatable);
+	}
 	else if (obj->kind == FUNC) {
 		VarMap* map = obj->func.upper;
 		while (map) {
@@ -4368,8 +6512,8 @@ static void gc_mark_obj(Object* obj) {
 			map = map->next;
 		}
 	} else if (obj->kind == LIST) {
-		for (size_t i = 0; i < vec_count(obj->list); i++) {
-			gc_mark_obj(vec_get(obj->list, i));
+		for (size_t i = 0; i < obj->list->count; i++) {
+			gc_mark_obj(list_get(obj->list, i));
 		}
 	}
 }
@@ -4389,7 +6533,7 @@ static void gc_mark_closure(VarMap* varmap) {
 static void gc_mark_task(Task* task) {
 	if (!task || task->state == TASK_END) return;
 
-	vec_iter(task->stack, gc_mark_obj);
+	for (size_t i = 0; i < task->sp; i++) gc_mark_obj(task->stack[i]);
 
 	for (size_t i = 0; i < vec_count(task->varmaps); i++) {
 		VarMap* map = vec_get(task->varmaps, i);
@@ -4410,6 +6554,7 @@ static void gc_mark_task(Task* task) {
 			}
 		}
 		gc_mark_obj(frame->ret);
+		if (frame->func) gc_mark_obj(frame->func);
 		frame = frame->next;
 	}
 }
@@ -4418,7 +6563,9 @@ static void gc_sweep(void) {
 	size_t count = 0;
 	for (size_t i = 0; i < vec_count(objects); i++) {
 		Object* obj = vec_get(objects, i);
-		if (!obj->marked) {
+		if (obj->frozen) {
+			vec_push(frozen, obj);
+		} else if (!obj->marked) {
 			obj_free(obj);
 		} else {
 			obj->marked = 0;
@@ -4449,6 +6596,7 @@ static void gc_sweep(void) {
 			vec_set(tasks, count++, task);
 		}
 	}
+	tasks->count = count;
 
 	size_t ssize = gc_size;
 	size_t old_threshold = threshold;
@@ -4466,17 +6614,275 @@ static void gc_sweep(void) {
 static inline void gc_run(void) {
 	if (gc_size < threshold) return;
 
+	gc_epoch++;
 	vec_iter(tasks, gc_mark_task);
 	gc_sweep();
 }
 
 static inline void gc_close(void) {
 	gc_sweep();
+	vec_iter(frozen, obj_free);
+	vec_free(frozen);
 	vec_free(objects);
 	vec_free(closures);
 	vec_free(tasks);
 }
 
+// Grisu2 shortest round-trip double formatting (Loitsch, "Printing Floating-Point
+// Numbers Quickly and Accurately with Integers"), output follows "%.17g" layout
+
+typedef struct {
+	uint64_t f;
+	int e;
+} DiyFp;
+
+// 10^-348 .. 10^340 in steps of 8, as normalized 64-bit mantissa and binary exponent
+static const uint64_t grisu_pow10_f[] = {
+	0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL, 0xcf42894a5dce35eaULL,
+	0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL, 0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL,
+	0xbe5691ef416bd60cULL, 0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+	0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL, 0xc21094364dfb5637ULL,
+	0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL, 0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL,
+	0xb23867fb2a35b28eULL, 0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+	0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL, 0xb5b5ada8aaff80b8ULL,
+	0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL, 0x964e858c91ba2655ULL, 0xdff9772470297ebdULL,
+	0xa6dfbd9fb8e5b88fULL, 0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+	0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL, 0xaa242499697392d3ULL,
+	0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL, 0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL,
+	0x9c40000000000000ULL, 0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+	0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL, 0x9f4f2726179a2245ULL,
+	0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL, 0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL,
+	0x924d692ca61be758ULL, 0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+	0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL, 0x952ab45cfa97a0b3ULL,
+	0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL, 0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL,
+	0x88fcf317f22241e2ULL, 0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+	0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL, 0x8bab8eefb6409c1aULL,
+	0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL, 0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL,
+	0x80444b5e7aa7cf85ULL, 0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+	0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+};
+
+static const int16_t grisu_pow10_e[] = {
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+	-901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+	-582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+	-263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+	56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+	375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+	694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+	1013, 1039, 1066
+};
+
+static const uint64_t grisu_pow10[] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+	1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+	100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+	1000000000000000000ULL, 10000000000000000000ULL
+};
+
+static DiyFp diyfp_mul(DiyFp a, DiyFp b) {
+	const uint64_t mask = 0xFFFFFFFFULL;
+	uint64_t a_hi = a.f >> 32, a_lo = a.f & mask;
+	uint64_t b_hi = b.f >> 32, b_lo = b.f & mask;
+	uint64_t ac = a_hi * b_hi, bc = a_lo * b_hi;
+	uint64_t ad = a_hi * b_lo, bd = a_lo * b_lo;
+	uint64_t tmp = (bd >> 32) + (ad & mask) + (bc & mask) + (1ULL << 31);
+
+	DiyFp res = {ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), a.e + b.e + 64};
+	return res;
+}
+
+static DiyFp diyfp_normalize(DiyFp v) {
+	int shift = __builtin_clzll(v.f);
+	v.f <<= shift;
+	v.e -= shift;
+	return v;
+}
+
+// the cached power that brings the product's exponent into [-60, -32]
+static DiyFp grisu_cached_pow(int e, int* K) {
+	double dk = (-61 - e) * 0.30102999566398114 + 347;
+	int k = (int)dk;
+	if (dk - k > 0.0) k++;
+
+	unsigned index = (unsigned)((k >> 3) + 1);
+	*K = -(-348 + (int)(index << 3));
+
+	DiyFp res = {grisu_pow10_f[index], grisu_pow10_e[index]};
+	return res;
+}
+
+static void grisu_round(char* buf, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w) {
+	while (rest < wp_w && delta - rest >= ten_kappa && (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+		buf[len - 1]--;
+		rest += ten_kappa;
+	}
+}
+
+static int grisu_digits(DiyFp w, DiyFp mp, uint64_t delta, char* buf, int* K) {
+	DiyFp one = {1ULL << -mp.e, mp.e};
+	uint64_t wp_w = mp.f - w.f;
+	uint32_t p1 = (uint32_t)(mp.f >> -one.e);
+	uint64_t p2 = mp.f & (one.f - 1);
+
+	int kappa = 1;
+	while (kappa < 10 && p1 >= grisu_pow10[kappa]) kappa++;
+
+	int len = 0;
+	while (kappa > 0) {
+		uint32_t div = (uint32_t)grisu_pow10[kappa - 1];
+		uint32_t d = p1 / div;
+		p1 %= div;
+		if (d || len) buf[len++] = (char)('0' + d);
+		kappa--;
+
+		uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+		if (rest <= delta) {
+			*K += kappa;
+			grisu_round(buf, len, delta, rest, grisu_pow10[kappa] << -one.e, wp_w);
+			return len;
+		}
+	}
+
+	for (;;) {
+		p2 *= 10;
+		delta *= 10;
+		char d = (char)(p2 >> -one.e);
+		if (d || len) buf[len++] = (char)('0' + d);
+		p2 &= one.f - 1;
+		kappa--;
+
+		if (p2 < delta) {
+			*K += kappa;
+			grisu_round(buf, len, delta, p2, one.f, -kappa < 20 ? wp_w * grisu_pow10[-kappa] : 0);
+			return len;
+		}
+	}
+}
+
+// `num` must be finite and positive, the value is `buf` digits times 10^K
+static int grisu2(double num, char* buf, int* K) {
+	uint64_t bits;
+	memcpy(&bits, &num, sizeof(bits));
+	int biased_e = (int)((bits >> 52) & 0x7FF);
+	uint64_t significand = bits & 0xFFFFFFFFFFFFFULL;
+
+	DiyFp v;
+	if (biased_e) {
+		v.f = significand | (1ULL << 52);
+		v.e = biased_e - 1075;
+	} else {
+		v.f = significand;
+		v.e = -1074;
+	}
+
+	// the boundaries halfway to the neighbouring doubles
+	DiyFp plus = {(v.f << 1) + 1, v.e - 1};
+	plus = diyfp_normalize(plus);
+	DiyFp minus;
+	if (v.f == (1ULL << 52)) {
+		minus.f = (v.f << 2) - 1;
+		minus.e = v.e - 2;
+	} else {
+		minus.f = (v.f << 1) - 1;
+		minus.e = v.e - 1;
+	}
+	minus.f <<= minus.e - plus.e;
+	minus.e = plus.e;
+
+	DiyFp c_mk = grisu_cached_pow(plus.e, K);
+	DiyFp w = diyfp_mul(diyfp_normalize(v), c_mk);
+	DiyFp wp = diyfp_mul(plus, c_mk);
+	DiyFp wm = diyfp_mul(minus, c_mk);
+	wm.f++;
+	wp.f--;
+
+	return grisu_digits(w, wp, wp.f - wm.f, buf, K);
+}
+
+static size_t num_exponent(char* out, int exp) {
+	char* ptr = out;
+	*ptr++ = 'e';
+	if (exp < 0) {
+		*ptr++ = '-';
+		exp = -exp;
+	} else *ptr++ = '+';
+
+	if (exp >= 100) {
+		*ptr++ = (char)('0' + exp / 100);
+		exp %= 100;
+	}
+	*ptr++ = (char)('0' + exp / 10);
+	*ptr++ = (char)('0' + exp % 10);
+
+	return (size_t)(ptr - out);
+}
+
+// shortest digits that read back as the same double, `out` holds TUG_NUMBUF bytes
+static size_t num_format(char* out, double num) {
+	char* ptr = out;
+	if (isnan(num)) {
+		memcpy(out, "nan", 4);
+		return 3;
+	}
+	if (signbit(num)) {
+		*ptr++ = '-';
+		num = -num;
+	}
+	if (isinf(num)) {
+		memcpy(ptr, "inf", 4);
+		return (size_t)(ptr - out) + 3;
+	}
+
+	// integers print without going through the digit generator
+	if (num < 1e17 && num == (double)(uint64_t)num) {
+		uint64_t n = (uint64_t)num;
+		char tmp[20];
+		int len = 0;
+		do {
+			tmp[len++] = (char)('0' + n % 10);
+			n /= 10;
+		} while (n);
+		while (len) *ptr++ = tmp[--len];
+		*ptr = '\0';
+		return (size_t)(ptr - out);
+	}
+
+	char digits[20];
+	int K;
+	int len = grisu2(num, digits, &K);
+	int point = len + K;
+
+	if (point - 1 < -4 || point - 1 >= 17) {
+		*ptr++ = digits[0];
+		if (len > 1) {
+			*ptr++ = '.';
+			memcpy(ptr, digits + 1, (size_t)len - 1);
+			ptr += len - 1;
+		}
+		ptr += num_exponent(ptr, point - 1);
+	} else if (point >= len) {
+		memcpy(ptr, digits, (size_t)len);
+		ptr += len;
+		for (int i = len; i < point; i++) *ptr++ = '0';
+	} else if (point > 0) {
+		memcpy(ptr, digits, (size_t)point);
+		ptr += point;
+		*ptr++ = '.';
+		memcpy(ptr, digits + point, (size_t)(len - point));
+		ptr += len - point;
+	} else {
+		*ptr++ = '0';
+		*ptr++ = '.';
+		for (int i = point; i < 0; i++) *ptr++ = '0';
+		memcpy(ptr, digits, (size_t)len);
+		ptr += len;
+	}
+
+	*ptr = '\0';
+	return (size_t)(ptr - out);
+}
+
 // API
 
 tug_Object* tug_true = obj_true;
@@ -4485,34 +6891,174 @@ tug_Object* tug_nil = obj_nil;
 
 tug_Object* tug_str(char* str) {
 	Object* obj = new_str(str);
-	obj->m = 1;
+	obj->m = STR_MALLOC;
 	return obj;
 }
 
 tug_Object* tug_conststr(const char* str) {
-	return new_str(gc_strdup(str));
+	return new_strcopy(str, strlen(str));
+}
+
+// like `tug_str`, a NUL must follow the `len` bytes
+tug_Object* tug_lstr(char* str, size_t len) {
+	Object* obj = new_lstr(str, len);
+	obj->m = STR_MALLOC;
+	return obj;
+}
+
+tug_Object* tug_constlstr(const char* str, size_t len) {
+	return new_strcopy(str, len);
+}
+
+tug_Object* tug_strview(tug_Object* str, size_t start, size_t len) {
+	if (start > str->len) start = str->len;
+	if (len > str->len - start) len = str->len - start;
+
+	return new_strslice(str, start, len);
+}
+
+size_t tug_utf8decode(const char* str, size_t len, uint32_t* cp) {
+	return utf8_decode(str, len, cp);
+}
+
+tug_Object* tug_utf8codes(tug_Object* str) {
+	Object* iter_obj = obj_create(ITER_UTF8);
+	iter_obj->iter.len = str->len;
+	iter_obj->iter.idx = 0;
+	iter_obj->iter.cursor.bucket = 0;
+	iter_obj->iter.cursor.slot = 0;
+	iter_obj->iter.state = NULL;
+	iter_obj->iter.obj = str;
+
+	return gc_obj(iter_obj);
 }
 
 tug_Object* tug_num(double num) {
 	return new_num(num);
 }
 
+size_t tug_numtostr(double num, char* buf) {
+	return num_format(buf, num);
+}
+
+size_t tug_strtonum(const char* str, size_t len, double* num) {
+	return num_parse(str, len, num);
+}
+
 tug_Object* tug_table(void) {
 	return new_table();
 }
 
+tug_Object* tug_orderedtable(void) {
+	return gc_obj(obj_table(table_ordered()));
+}
+
+tug_Object* tug_map(void) {
+	return gc_obj(obj_map(NULL, 0));
+}
+
+tug_Object* tug_mapassoc(tug_Object* map, tug_Object* key, tug_Object* value) {
+	Object* res = map_assoc(map, key, value);
+	return res == map ? res : gc_obj(res);
+}
+
+tug_Object* tug_mapdissoc(tug_Object* map, tug_Object* key) {
+	Object* res = map_dissoc(map, key);
+	return res == map ? res : gc_obj(res);
+}
+
+tug_Object* tug_mapget(tug_Object* map, tug_Object* key) {
+	return map_get(map, key);
+}
+
+tug_Object* tug_struct(const char* name, size_t count, const char** fields) {
+	Shape* shape = shape_create(name, count);
+	for (size_t i = 0; i < count; i++) {
+		shape->fields[i] = gc_strdup(fields[i]);
+	}
+
+	return gc_obj(obj_struct(shape));
+}
+
+tug_Object* tug_record(tug_Object* type) {
+	return gc_obj(obj_record(type));
+}
+
+tug_Object* tug_buffer(size_t cap) {
+	return gc_obj(obj_buffer(cap));
+}
+
+void tug_bufreserve(tug_Object* buf, size_t extra) {
+	buf_reserve(buf, extra);
+}
+
+void tug_bufappend(tug_Object* buf, const char* str, size_t len) {
+	buf_append(buf, str, len);
+}
+
+void tug_bufclear(tug_Object* buf) {
+	buf->buf.len = 0;
+}
+
+const char* tug_bufdata(tug_Object* buf, size_t* len) {
+	if (len) *len = buf->buf.len;
+	return buf->buf.data;
+}
+
+tug_Object* tug_buftostr(tug_Object* buf) {
+	return gc_obj(buf_tostr(buf));
+}
+
+tug_Object* tug_f64array(size_t len) {
+	return gc_obj(obj_array(F64ARRAY, len));
+}
+
+tug_Object* tug_i64array(size_t len) {
+	return gc_obj(obj_array(I64ARRAY, len));
+}
+
+double* tug_f64data(tug_Object* arr) {
+	return arr->kind == F64ARRAY ? arr->arr.f64 : NULL;
+}
+
+int64_t* tug_i64data(tug_Object* arr) {
+	return arr->kind == I64ARRAY ? arr->arr.i64 : NULL;
+}
+
+void tug_arrayresize(tug_Object* arr, size_t len) {
+	array_resize(arr, len);
+}
+
+void tug_arraypush(tug_Object* arr, double num) {
+	array_resize(arr, arr->arr.len + 1);
+	array_put(arr, arr->arr.len - 1, num);
+}
+
 void tug_setuserdata(tug_Object* table, void* userdata) {
 	table->userdata = userdata;
 }
 
 void tug_setdeallocator(tug_Object* table, tug_deallocator deallocator) {
-	table->deallocator = deallocator;
+	table->dealloc = deallocator;
+}
+
+tug_deallocator tug_getdeallocator(tug_Object* table) {
+	return table->dealloc;
 }
 
 void* tug_getuserdata(tug_Object* table) {
 	return table->userdata;
 }
 
+void tug_setuservalue(tug_Object* table, tug_Object* value) {
+	if (table->frozen) return;
+	table->uservalue = value;
+}
+
+tug_Object* tug_getuservalue(tug_Object* table) {
+	return table->uservalue ? table->uservalue : obj_nil;
+}
+
 tug_Object* tug_cfunc(const char* name, tug_CFunc func) {
 	return gc_obj(obj_cfunc(name, func));
 }
@@ -4542,56 +7088,76 @@ tug_Object* tug_tuplepop(tug_Object* tuple) {
 
 tug_Object* tug_list(void) {
 	Object* obj = gc_obj(obj_create(LIST));
-	obj->list = vec_create();
+	obj->list = list_create(0);
 
 	return obj;
 }
 
 void tug_listpush(tug_Object* list, tug_Object* obj) {
-	vec_push(list->list, obj);
+	if (list->frozen) return;
+	list_push(list->list, obj);
 }
 
 tug_Object* tug_listpop(tug_Object* list, size_t idx) {
-	Vector* lvec = list->list;
+	if (list->frozen) return obj_nil;
+	List* lvec = list->list;
 	if (idx >= lvec->count) return obj_nil;
-	if (lvec->count == 0) return obj_nil;
-	
-	Object* obj = lvec->array[idx];
-	memmove(&lvec->array[idx], &lvec->array[idx + 1], (lvec->count - idx - 1) * sizeof(void*));
-	lvec->count--;
-	vec_dynamic(lvec, 0);
-	return obj;
+
+	return list_remove(lvec, idx);
 }
 
 void tug_listinsert(tug_Object* list, size_t idx, tug_Object* obj) {
-	Vector* lvec = list->list;
-	if (idx > lvec->count) {
-		vec_push(lvec, obj);
-		return;
-	}
-	
-	vec_dynamic(lvec, 1);
-	memmove(&lvec->array[idx + 1], &lvec->array[idx], (lvec->count - idx) * sizeof(void*));
-	lvec->array[idx] = obj;
-	lvec->count++;
-	return;
+	if (list->frozen) return;
+	list_insert(list->list, idx, obj);
 }
 
 int tug_listset(tug_Object* list, size_t idx, tug_Object* obj) {
-	Vector* lvec = list->list;
+	if (list->frozen) return 0;
+	List* lvec = list->list;
 	if (idx >= lvec->count) return 0;
-	lvec->array[idx] = obj;
+	list_own(lvec);
+	list_set(lvec, idx, obj);
 	return 1;
 }
 
+// a frozen list is copied, its array may be read from other threads
+tug_Object* tug_listslice(tug_Object* list, size_t start, size_t end) {
+	List* lvec = list->list;
+	if (end > lvec->count) end = lvec->count;
+	if (start > end) start = end;
+
+	Object* obj = gc_obj(obj_create(LIST));
+	if (list->frozen) {
+		obj->list = list_create(end - start);
+		for (size_t i = start; i < end; i++) {
+			list_push(obj->list, list_get(lvec, i));
+		}
+	} else obj->list = list_view(lvec, start, end);
+
+	return obj;
+}
+
 tug_Object* tug_listget(tug_Object* list, size_t idx) {
-	Vector* lvec = list->list;
+	List* lvec = list->list;
 	if (idx >= lvec->count) return obj_nil;
-	return lvec->array[idx];
+	return list_get(lvec, idx);
 }
 
 void tug_listclear(tug_Object* list) {
+	if (list->frozen) return;
+	list_own(list->list);
 	list->list->count = 0;
+	list->list->head = 0;
+	list_shrink(list->list);
+}
+
+tug_Object** tug_listdata(tug_Object* list) {
+	if (list->frozen) return NULL;
+	List* lvec = list->list;
+	list_own(lvec);
+	if (lvec->head + lvec->count > lvec->cap) list_resize(lvec, lvec->cap);
+
+	return &lvec->items[lvec->head];
 }
 
 unsigned long tug_getid(tug_Object* obj) {
@@ -4608,12 +7174,23 @@ tug_Type tug_gettype(tug_Object* obj) {
 		case FUNC: return TUG_FUNC;
 		case TABLE: return TUG_TABLE;
 		case LIST: return TUG_LIST;
+		case MAP: return TUG_MAP;
+		case STRUCT: return TUG_STRUCT;
+		case RECORD: return TUG_RECORD;
+		case BUFFER: return TUG_BUFFER;
+		case F64ARRAY: return TUG_F64ARRAY;
+		case I64ARRAY: return TUG_I64ARRAY;
 		case TUPLE: return tug_gettype(obj->tuple->count > 0 ? vec_get(obj->tuple, 0) : obj_nil);
 		default: return TUG_UNKNOWN;
 	}
 }
 
 const char* tug_getstr(tug_Object* obj) {
+	return str_cstr(obj);
+}
+
+const char* tug_getlstr(tug_Object* obj, size_t* len) {
+	if (len) *len = obj->len;
 	return (const char*)obj->str;
 }
 
@@ -4621,22 +7198,55 @@ double tug_getnum(tug_Object* obj) {
 	return obj->num;
 }
 
+int tug_istrue(tug_Object* obj) {
+	return obj_check(obj);
+}
+
 void tug_setfield(tug_Object* obj, tug_Object* key, tug_Object* value) {
+	if (obj->frozen) return;
+	if (obj->kind == RECORD) {
+		long slot = key->kind == STR ? shape_find(obj->shape, str_cstr(key)) : -1;
+		if (slot >= 0) obj->slots[slot] = value;
+		return;
+	}
 	table_set(obj->table, key, value);
 }
 
 tug_Object* tug_getfield(tug_Object* obj, tug_Object* key) {
+	if (obj->kind == RECORD) {
+		long slot = key->kind == STR ? shape_find(obj->shape, str_cstr(key)) : -1;
+		return slot >= 0 ? obj->slots[slot] : obj_nil;
+	}
 	return table_get(obj->table, key);
 }
 
+int tug_next(tug_Object* table, tug_Cursor* cursor, tug_Object** key, tug_Object** value) {
+	if (table->kind != TABLE) return 0;
+	return table_next(table->table, cursor, key, value);
+}
+
+int tug_seek(tug_Object* table, tug_Object* key, tug_Cursor* cursor) {
+	if (table->kind != TABLE) return 0;
+	return table_seek(table->table, key, cursor);
+}
+
 size_t tug_getlen(tug_Object* obj) {
-	return obj->kind == STR ? strlen(obj->str) : obj->kind == TABLE ? obj->table->count : obj->kind == LIST ? obj->list->count : 0;
+	return obj->kind == STR ? obj->len : obj->kind == TABLE ? obj->table->count : obj->kind == LIST ? obj->list->count : obj->kind == MAP ? obj->map.count : obj->kind == BUFFER ? obj->buf.len : (obj->kind == F64ARRAY || obj->kind == I64ARRAY) ? obj->arr.len : 0;
 }
 
 void tug_setmetatable(tug_Object* obj, tug_Object* metatable) {
+	if (obj->frozen) return;
 	obj->metatable = metatable;
 }
 
+int tug_freeze(tug_Object* obj) {
+	return freeze(obj);
+}
+
+int tug_isfrozen(tug_Object* obj) {
+	return obj->frozen;
+}
+
 tug_Object* tug_getmetatable(tug_Object* obj) {
 	return obj->metatable;
 }
@@ -4687,11 +7297,7 @@ tug_Object* tug_getarg(tug_Task* T, size_t idx) {
 }
 
 int tug_hasarg(tug_Task* T, size_t idx) {
-	Frame* frame = T->frame;
-	if (frame->args == NULL) return 0;
-	if (idx >= frame->args->count) return 0;
-
-	return 1;
+	return idx < get_argc(T);
 }
 
 tug_Object* tug_calls(tug_Task* T, tug_Object* func, size_t n, ...) {
@@ -4703,10 +7309,9 @@ tug_Object* tug_calls(tug_Task* T, tug_Object* func, size_t n, ...) {
 		vec_push(fargs, va_arg(args, tug_Object*));
 	}
 
-	call_obj(T, func, fargs, 1, 0);
-	if (T->state != TASK_ERROR) task_exec(T);
-	pop_value(T);
-	return get_ret(T);
+	if (call_obj(T, func, fargs, 1, 0, 1) && T->state != TASK_ERROR) task_exec(T, T->frame->next);
+	if (T->state == TASK_ERROR) return obj_nil;
+	return pop_result(T);
 }
 
 tug_Object* tug_pcalls(tug_Task* T, int* errptr, tug_Object* func, size_t n, ...) {
@@ -4718,14 +7323,13 @@ tug_Object* tug_pcalls(tug_Task* T, int* errptr, tug_Object* func, size_t n, ...
 		vec_push(fargs, va_arg(args, tug_Object*));
 	}
 
-	call_obj(T, func, fargs, 1, 1);
-	if (T->state != TASK_ERROR) task_exec(T);
+	if (call_obj(T, func, fargs, 1, 1, 1) && T->state != TASK_ERROR) task_exec(T, T->frame->next);
 	if (errptr) (*errptr) = (T->state == TASK_ERROR);
 	if (T->state == TASK_ERROR) {
 		T->state = TASK_RUNNING;
+		return obj_nil;
 	}
-	pop_value(T);
-	return get_ret(T);
+	return pop_result(T);
 }
 
 tug_Object* tug_call(tug_Task* T, tug_Object* func, tug_Object* arg) {
@@ -4738,56 +7342,113 @@ tug_Object* tug_call(tug_Task* T, tug_Object* func, tug_Object* arg) {
 		vec_push(args, arg);
 	}
 
-	call_obj(T, func, args, 0, 0);
-	if (T->state != TASK_ERROR) task_exec(T);
-	pop_value(T);
-	return get_ret(T);
+	if (call_obj(T, func, args, 0, 0, 1) && T->state != TASK_ERROR) task_exec(T, T->frame->next);
+	if (T->state == TASK_ERROR) return obj_nil;
+	return pop_result(T);
 }
 
 tug_Object* tug_pcall(tug_Task* T, int* errptr, tug_Object* func, tug_Object* arg) {
 	Vector* args;
 	if (arg->kind == TUPLE) {
 		args = arg->tuple;
+		arg->tuple = NULL;
 	} else {
 		args = vec_serve(1);
 		vec_push(args, arg);
 	}
 
-	call_obj(T, func, args, 0, 1);
-	if (T->state != TASK_ERROR) task_exec(T);
+	if (call_obj(T, func, args, 0, 1, 1) && T->state != TASK_ERROR) task_exec(T, T->frame->next);
 	if (errptr) (*errptr) = (T->state == TASK_ERROR);
 	if (T->state == TASK_ERROR) {
 		T->state = TASK_RUNNING;
+		return obj_nil;
 	}
-	pop_value(T);
-	return get_ret(T);
+	return pop_result(T);
 }
 
-void tug_rets(tug_Task* T, size_t n, ...) {
-	Vector* stack = T->stack;
-	if (n == 0) {
-		T->frame->ret = obj_nil;
+tug_Object* tug_iter(tug_Task* T, tug_Object* obj) {
+	return iter_create(T, obj);
+}
+
+int tug_iternext(tug_Task* T, tug_Object* iter, tug_Object** out, size_t* n) {
+	size_t got;
+	if (!iter_step(T, iter, *n, &got)) {
+		*n = 0;
+		return 0;
+	}
+
+	size_t keep = got < *n ? got : *n;
+	memcpy(out, &T->stack[T->sp - got], keep * sizeof(Object*));
+	T->sp -= got;
+	*n = keep;
+
+	return 1;
+}
+
+// calls `func` with the arguments pushed straight onto the stack, nothing is
+// allocated for a plain function so it suits callbacks that run many times
+tug_Object* tug_callv(tug_Task* T, tug_Object* func, size_t argc, tug_Object** argv) {
+	int pushed;
+	if (func->kind == FUNC) {
+		size_t argbase = T->sp + 1;
+		push_obj(T, func);
+		for (size_t i = 0; i < argc; i++) {
+			push_obj(T, argv[i]);
+		}
+		pushed = call_window(T, func, argbase, argc, 0);
+	} else {
+		Vector* args = vec_serve(argc);
+		for (size_t i = 0; i < argc; i++) {
+			vec_push(args, argv[i]);
+		}
+		pushed = call_obj(T, func, args, 1, 0, 0);
+	}
+
+	if (pushed && T->state != TASK_ERROR) task_exec(T, T->frame->next);
+	if (T->state == TASK_ERROR) return obj_nil;
+	return pop_value(T);
+}
+
+// the values sit from `start` to the top of the stack, the call returning takes them from there
+static void rets_finish(Task* T, size_t start) {
+	size_t count = expr_flatten(T, start);
+	if (count == 0) T->frame->ret = obj_nil;
+	else if (count == 1 || !T->frame->multret) T->frame->ret = T->stack[start + count - 1];
+	else if (count <= MULTRET_MAX) {
+		T->frame->ret = &multret_marks[count];
 		return;
+	} else {
+		Vector* tuple = vec_serve(count);
+		for (size_t i = 0; i < count; i++) {
+			vec_push(tuple, T->stack[start + i]);
+		}
+		Object* obj = gc_obj(obj_create(TUPLE));
+		obj->tuple = tuple;
+		T->frame->ret = obj;
 	}
+	T->sp = start;
+}
 
+void tug_rets(tug_Task* T, size_t n, ...) {
 	va_list args;
 	va_start(args, n);
 
-	if (n == 1) {
-		T->frame->ret = va_arg(args, Object*);
-		va_end(args);
-		return;
+	size_t start = T->sp;
+	for (size_t i = 0; i < n; i++) {
+		push_obj(T, va_arg(args, Object*));
 	}
+	va_end(args);
+
+	rets_finish(T, start);
+}
 
-	Vector* tuple = vec_serve(n);
+void tug_retv(tug_Task* T, size_t n, tug_Object** values) {
+	size_t start = T->sp;
 	for (size_t i = 0; i < n; i++) {
-		vec_push(tuple, va_arg(args, Object*));
+		push_obj(T, values[i]);
 	}
-	Object* obj = gc_obj(obj_create(TUPLE));
-	obj->tuple = tuple;
-	T->frame->ret = obj;
 
-	va_end(args);
+	rets_finish(T, start);
 }
 
 void tug_ret(tug_Task* T, tug_Object* obj) {
@@ -4884,6 +7545,9 @@ void tug_init(void) {
 	
 	compiler_init();
 	gc_init();
+	str_chars_init();
+	multret_init();
+	num_ascii_init();
 }
 
 void tug_close(void) {
@@ -4899,5 +7563,9 @@ void tug_close(void) {
 	for (size_t i = 0; i < obj_poolc; i++) {
 		gc_free(obj_pool[i]);
 	}
+	for (size_t i = 0; i < frame_poolc; i++) {
+		gc_free(frame_pool[i]);
+	}
+	frame_poolc = 0;
 	gc_close();
 }
\ No newline at end of file
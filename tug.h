@@ -1,6 +1,8 @@
 #ifndef TUG_H
 #define TUG_H
 
+#include <stdint.h>
+
 typedef struct tug_Task tug_Task;
 typedef struct tug_Object tug_Object;
 
@@ -14,6 +16,12 @@ typedef enum {
         TUG_TABLE,
         TUG_TUPLE,
         TUG_LIST,
+        TUG_MAP,
+        TUG_STRUCT,
+        TUG_RECORD,
+        TUG_BUFFER,
+        TUG_F64ARRAY,
+        TUG_I64ARRAY,
         TUG_UNKNOWN,
 } tug_Type;
 
@@ -34,8 +42,22 @@ extern tug_Object* tug_nil;
 
 tug_Object* tug_str(char* str);
 tug_Object* tug_conststr(const char* str);
+tug_Object* tug_lstr(char* str, size_t len);
+tug_Object* tug_constlstr(const char* str, size_t len);
+tug_Object* tug_strview(tug_Object* str, size_t start, size_t len);
 tug_Object* tug_num(double num);
 
+// bytes taken by the UTF-8 sequence at `str`, 0 when it's invalid
+size_t tug_utf8decode(const char* str, size_t len, uint32_t* cp);
+// iterator over the code points of `str` for `for cp, pos in ...`
+tug_Object* tug_utf8codes(tug_Object* str);
+
+// shortest text that reads back as `num`, `buf` must hold TUG_NUMBUF bytes
+#define TUG_NUMBUF 32
+size_t tug_numtostr(double num, char* buf);
+// parses the number `str` starts with, returns the bytes it took or 0 when there is none
+size_t tug_strtonum(const char* str, size_t len, double* num);
+
 typedef void(*tug_CFunc)(tug_Task*);
 tug_Object* tug_cfunc(const char* name, tug_CFunc func);
 
@@ -50,23 +72,67 @@ void tug_listinsert(tug_Object* list, size_t idx, tug_Object* obj);
 tug_Object* tug_listget(tug_Object* list, size_t idx);
 int tug_listset(tug_Object* list, size_t idx, tug_Object* obj);
 void tug_listclear(tug_Object* list);
+// the items from `start` to `end`, sharing storage with `list` until either is written to
+tug_Object* tug_listslice(tug_Object* list, size_t start, size_t end);
+// unwraps the list so its items are contiguous, the pointer stays good until the list
+// changes shape and is NULL for a frozen list
+tug_Object** tug_listdata(tug_Object* list);
 
 unsigned long tug_getid(tug_Object* obj);
 tug_Type tug_gettype(tug_Object* obj);
 
 const char* tug_getstr(tug_Object* obj);
+// the bytes of a substring view aren't NUL-terminated, use `tug_getstr` for a C string
+const char* tug_getlstr(tug_Object* obj, size_t* len);
 double tug_getnum(tug_Object* obj);
+int tug_istrue(tug_Object* obj);
 void tug_setfield(tug_Object* obj, tug_Object* key, tug_Object* value);
 tug_Object* tug_getfield(tug_Object* obj, tug_Object* key);
 size_t tug_getlen(tug_Object* obj);
 
+typedef struct {
+        size_t bucket;
+        size_t slot;
+} tug_Cursor;
+
+#define TUG_CURSOR_INIT {0, 0}
+int tug_next(tug_Object* table, tug_Cursor* cursor, tug_Object** key, tug_Object** value);
+int tug_seek(tug_Object* table, tug_Object* key, tug_Cursor* cursor);
+
 typedef void (*tug_deallocator)(tug_Object* table);
 tug_Object* tug_table(void);
+tug_Object* tug_orderedtable(void);
+tug_Object* tug_map(void);
+tug_Object* tug_mapassoc(tug_Object* map, tug_Object* key, tug_Object* value);
+tug_Object* tug_mapdissoc(tug_Object* map, tug_Object* key);
+tug_Object* tug_mapget(tug_Object* map, tug_Object* key);
+tug_Object* tug_struct(const char* name, size_t count, const char** fields);
+tug_Object* tug_record(tug_Object* type);
+tug_Object* tug_buffer(size_t cap);
+void tug_bufreserve(tug_Object* buf, size_t extra);
+void tug_bufappend(tug_Object* buf, const char* str, size_t len);
+void tug_bufclear(tug_Object* buf);
+const char* tug_bufdata(tug_Object* buf, size_t* len);
+tug_Object* tug_buftostr(tug_Object* buf);
+// flat arrays of doubles or 64-bit integers, `len` zeroed elements to start with
+tug_Object* tug_f64array(size_t len);
+tug_Object* tug_i64array(size_t len);
+// NULL when `arr` is not of that kind, the pointer moves when the array grows
+double* tug_f64data(tug_Object* arr);
+int64_t* tug_i64data(tug_Object* arr);
+void tug_arrayresize(tug_Object* arr, size_t len);
+void tug_arraypush(tug_Object* arr, double num);
 void tug_setuserdata(tug_Object* table, void* userdata);
 void* tug_getuserdata(tug_Object* table);
 void tug_setdeallocator(tug_Object* table, tug_deallocator deallocator);
+tug_deallocator tug_getdeallocator(tug_Object* table);
+// a reference the collector follows but scripts can't see, for C state that holds objects
+void tug_setuservalue(tug_Object* table, tug_Object* value);
+tug_Object* tug_getuservalue(tug_Object* table);
 void tug_setmetatable(tug_Object* obj, tug_Object* metatable);
 tug_Object* tug_getmetatable(tug_Object* obj);
+int tug_freeze(tug_Object* obj);
+int tug_isfrozen(tug_Object* obj);
 
 void tug_setvar(tug_Task* T, const char* name, tug_Object* value);
 tug_Object* tug_getvar(tug_Task* T, const char* name);
@@ -84,7 +150,13 @@ tug_Object* tug_calls(tug_Task* T, tug_Object* func, size_t n, ...);
 tug_Object* tug_pcalls(tug_Task* T, int* errptr, tug_Object* func, size_t n, ...);
 tug_Object* tug_call(tug_Task* T, tug_Object* func, tug_Object* arg);
 tug_Object* tug_pcall(tug_Task* T, int* errptr, tug_Object* func, tug_Object* arg);
+tug_Object* tug_callv(tug_Task* T, tug_Object* func, size_t argc, tug_Object** argv);
+// `for ... in` from C: tug_iter gives NULL after raising an error, tug_iternext stores up
+// to `*n` values of the next step and sets `*n` to how many it got, 0 at the end or on error
+tug_Object* tug_iter(tug_Task* T, tug_Object* obj);
+int tug_iternext(tug_Task* T, tug_Object* iter, tug_Object** out, size_t* n);
 void tug_rets(tug_Task* T, size_t n, ...);
+void tug_retv(tug_Task* T, size_t n, tug_Object** values);
 void tug_ret(tug_Task* T, tug_Object* obj);
 
 void tug_err(tug_Task* T, const char* fmt, ...);
@@ -4,12 +4,19 @@
 #include <math.h>
 #include <limits.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
 #include <time.h>
 #include <ctype.h>
+#include <setjmp.h>
 #include "tug.h"
 
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define TUGLIB_X86 1
+#include <immintrin.h>
+#endif
+
 #define tuglib_isnew(T) (tug_getstate(T) == TUG_NEW)
 #define tuglib_iserr(T) (tug_getstate(T) == TUG_ERROR)
 #define tuglib_isalive(T) (tug_getstate(T) == TUG_ALIVE)
@@ -18,7 +25,8 @@
 #define tuglib_isyield(T) (tuglib_isnew(T) || tuglib_ispaused(T))
 
 static int tuglib_hasmetatable(tug_Object* obj) {
-	if (tug_gettype(obj) == TUG_TABLE) return tug_getmetatable(obj) != tug_nil;
+	tug_Type type = tug_gettype(obj);
+	if (type == TUG_TABLE || type == TUG_RECORD) return tug_getmetatable(obj) != tug_nil;
 	return 0;
 }
 
@@ -46,6 +54,12 @@ static const char* tuglib_typename(tug_Type type) {
 		case TUG_FUNC: return "func";
 		case TUG_TABLE: return "table";
 		case TUG_LIST: return "list";
+		case TUG_MAP: return "map";
+		case TUG_STRUCT: return "struct";
+		case TUG_RECORD: return "record";
+		case TUG_BUFFER: return "buffer";
+		case TUG_F64ARRAY: return "f64array";
+		case TUG_I64ARRAY: return "i64array";
 		case TUG_TUPLE:
 		case TUG_UNKNOWN:
 		default: return "unknown";
@@ -75,6 +89,198 @@ static const char* tuglib_checkstr(tug_Task* T, size_t idx) {
 	return tug_getstr(obj);
 }
 
+static const char* tuglib_checklstr(tug_Task* T, size_t idx, size_t* len) {
+	tug_Object* obj = tuglib_checktype(T, idx, TUG_STR);
+	return tug_getlstr(obj, len);
+}
+
+static const char* tuglib_memfind_scalar(const char* hay, size_t hay_len, const char* needle, size_t needle_len) {
+	if (needle_len > hay_len) return NULL;
+
+	const char* last = hay + (hay_len - needle_len);
+	for (const char* ptr = hay; ptr <= last; ptr++) {
+		ptr = memchr(ptr, needle[0], (size_t)(last - ptr) + 1);
+		if (!ptr) return NULL;
+		if (memcmp(ptr, needle, needle_len) == 0) return ptr;
+	}
+
+	return NULL;
+}
+
+#ifdef TUGLIB_X86
+
+// the vector kernels compare the needle's first and last byte against a whole
+// block of positions at once and only memcmp the middle of the candidates,
+// the tail that doesn't fill a block goes to the scalar search
+__attribute__((target("sse2")))
+static const char* tuglib_memfind_sse2(const char* hay, size_t hay_len, const char* needle, size_t needle_len) {
+	const __m128i first = _mm_set1_epi8(needle[0]);
+	const __m128i last = _mm_set1_epi8(needle[needle_len - 1]);
+
+	size_t i = 0;
+	for (; i + needle_len + 15 <= hay_len; i += 16) {
+		__m128i block_first = _mm_loadu_si128((const __m128i*)(hay + i));
+		__m128i block_last = _mm_loadu_si128((const __m128i*)(hay + i + needle_len - 1));
+		unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last)));
+		while (mask) {
+			unsigned bit = (unsigned)__builtin_ctz(mask);
+			if (memcmp(hay + i + bit + 1, needle + 1, needle_len - 2) == 0) return hay + i + bit;
+			mask &= mask - 1;
+		}
+	}
+
+	return tuglib_memfind_scalar(hay + i, hay_len - i, needle, needle_len);
+}
+
+__attribute__((target("avx2")))
+static const char* tuglib_memfind_avx2(const char* hay, size_t hay_len, const char* needle, size_t needle_len) {
+	const __m256i first = _mm256_set1_epi8(needle[0]);
+	const __m256i last = _mm256_set1_epi8(needle[needle_len - 1]);
+
+	size_t i = 0;
+	// two blocks per step, most steps have no candidate at all
+	for (; i + needle_len + 63 <= hay_len; i += 64) {
+		__m256i eq0 = _mm256_and_si256(
+			_mm256_cmpeq_epi8(first, _mm256_loadu_si256((const __m256i*)(hay + i))),
+			_mm256_cmpeq_epi8(last, _mm256_loadu_si256((const __m256i*)(hay + i + needle_len - 1))));
+		__m256i eq1 = _mm256_and_si256(
+			_mm256_cmpeq_epi8(first, _mm256_loadu_si256((const __m256i*)(hay + i + 32))),
+			_mm256_cmpeq_epi8(last, _mm256_loadu_si256((const __m256i*)(hay + i + 32 + needle_len - 1))));
+		if (_mm256_testz_si256(_mm256_or_si256(eq0, eq1), _mm256_set1_epi8(-1))) continue;
+
+		uint64_t mask = (uint32_t)_mm256_movemask_epi8(eq0) | ((uint64_t)(uint32_t)_mm256_movemask_epi8(eq1) << 32);
+		while (mask) {
+			unsigned bit = (unsigned)__builtin_ctzll(mask);
+			if (memcmp(hay + i + bit + 1, needle + 1, needle_len - 2) == 0) return hay + i + bit;
+			mask &= mask - 1;
+		}
+	}
+	for (; i + needle_len + 31 <= hay_len; i += 32) {
+		__m256i block_first = _mm256_loadu_si256((const __m256i*)(hay + i));
+		__m256i block_last = _mm256_loadu_si256((const __m256i*)(hay + i + needle_len - 1));
+		unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, block_first), _mm256_cmpeq_epi8(last, block_last)));
+		while (mask) {
+			unsigned bit = (unsigned)__builtin_ctz(mask);
+			if (memcmp(hay + i + bit + 1, needle + 1, needle_len - 2) == 0) return hay + i + bit;
+			mask &= mask - 1;
+		}
+	}
+
+	return tuglib_memfind_sse2(hay + i, hay_len - i, needle, needle_len);
+}
+
+#endif
+
+typedef const char* (*tuglib_Finder)(const char*, size_t, const char*, size_t);
+static tuglib_Finder tuglib_finder = NULL;
+
+static tuglib_Finder tuglib_pickfinder(void) {
+	#ifdef TUGLIB_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) return tuglib_memfind_avx2;
+	if (__builtin_cpu_supports("sse2")) return tuglib_memfind_sse2;
+	#endif
+
+	return tuglib_memfind_scalar;
+}
+
+// a false candidate per this many bytes is where the vector kernels overtake memchr
+#define TUGLIB_MEMFIND_SPAN 256
+
+// first bytes that came up that often, searches for them skip the memchr pass
+static uint8_t tuglib_densebytes[32];
+
+// binary-safe strstr, picks the widest kernel the cpu has on first use; memchr
+// skips at memory speed while the first byte is rare, so the search starts with
+// it and hands the rest to the kernel once false candidates come too often
+static const char* tuglib_memfind(const char* hay, size_t hay_len, const char* needle, size_t needle_len) {
+	if (needle_len == 0) return hay;
+	if (needle_len > hay_len) return NULL;
+	if (needle_len == 1) return memchr(hay, needle[0], hay_len);
+
+	if (!tuglib_finder) tuglib_finder = tuglib_pickfinder();
+	uint8_t first = (uint8_t)needle[0];
+	if (tuglib_densebytes[first >> 3] & (1 << (first & 7))) return tuglib_finder(hay, hay_len, needle, needle_len);
+
+	const char* last = hay + (hay_len - needle_len);
+	size_t misses = 0;
+	for (const char* ptr = hay; ptr <= last; ptr++) {
+		ptr = memchr(ptr, needle[0], (size_t)(last - ptr) + 1);
+		if (!ptr) return NULL;
+		if (memcmp(ptr, needle, needle_len) == 0) return ptr;
+
+		size_t seen = (size_t)(ptr - hay) + 1;
+		if (++misses * TUGLIB_MEMFIND_SPAN > seen) {
+			tuglib_densebytes[first >> 3] |= (uint8_t)(1 << (first & 7));
+			return tuglib_finder(hay + seen, hay_len - seen, needle, needle_len);
+		}
+	}
+
+	return NULL;
+}
+
+// length of the ASCII run `str` starts with, eight bytes per step
+static size_t tuglib_asciirun_scalar(const char* str, size_t len) {
+	size_t i = 0;
+	for (; i + 8 <= len; i += 8) {
+		uint64_t word;
+		memcpy(&word, str + i, 8);
+		if (word & 0x8080808080808080ULL) break;
+	}
+	while (i < len && (unsigned char)str[i] < 0x80) i++;
+
+	return i;
+}
+
+#ifdef TUGLIB_X86
+
+// the high bit of every byte lands in the movemask, the first set one ends the run
+__attribute__((target("sse2")))
+static size_t tuglib_asciirun_sse2(const char* str, size_t len) {
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16) {
+		unsigned mask = (unsigned)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(str + i)));
+		if (mask) return i + (size_t)__builtin_ctz(mask);
+	}
+
+	return i + tuglib_asciirun_scalar(str + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t tuglib_asciirun_avx2(const char* str, size_t len) {
+	size_t i = 0;
+	for (; i + 64 <= len; i += 64) {
+		__m256i lo = _mm256_loadu_si256((const __m256i*)(str + i));
+		__m256i hi = _mm256_loadu_si256((const __m256i*)(str + i + 32));
+		if (!_mm256_movemask_epi8(_mm256_or_si256(lo, hi))) continue;
+
+		uint64_t mask = (uint32_t)_mm256_movemask_epi8(lo) | ((uint64_t)(uint32_t)_mm256_movemask_epi8(hi) << 32);
+		return i + (size_t)__builtin_ctzll(mask);
+	}
+
+	return i + tuglib_asciirun_sse2(str + i, len - i);
+}
+
+#endif
+
+typedef size_t (*tuglib_Runner)(const char*, size_t);
+static tuglib_Runner tuglib_runner = NULL;
+
+static tuglib_Runner tuglib_pickrunner(void) {
+	#ifdef TUGLIB_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) return tuglib_asciirun_avx2;
+	if (__builtin_cpu_supports("sse2")) return tuglib_asciirun_sse2;
+	#endif
+
+	return tuglib_asciirun_scalar;
+}
+
+static size_t tuglib_asciirun(const char* str, size_t len) {
+	if (!tuglib_runner) tuglib_runner = tuglib_pickrunner();
+	return tuglib_runner(str, len);
+}
+
 static double tuglib_checknum(tug_Task* T, size_t idx) {
 	tug_Object* obj = tuglib_checktype(T, idx, TUG_NUM);
 	return tug_getnum(obj);
@@ -112,6 +318,47 @@ static int tuglib_checkbool(tug_Task* T, size_t idx) {
 #define tuglib_checkfunc(T, idx) (tuglib_checktype(T, idx, TUG_FUNC))
 #define tuglib_checktable(T, idx) (tuglib_checktype(T, idx, TUG_TABLE))
 #define tuglib_checklist(T, idx) (tuglib_checktype(T, idx, TUG_LIST))
+#define tuglib_checkmap(T, idx) (tuglib_checktype(T, idx, TUG_MAP))
+#define tuglib_checkbuffer(T, idx) (tuglib_checktype(T, idx, TUG_BUFFER))
+
+static tug_Object* tuglib_checkarray(tug_Task* T, size_t idx) {
+	tug_Object* obj = tuglib_checkany(T, idx);
+	tug_Type type = tug_gettype(obj);
+	if (type != TUG_F64ARRAY && type != TUG_I64ARRAY) {
+		tug_err(T, "argument #%zu expected 'f64array' or 'i64array', got '%s'", idx + 1, tuglib_typename(type));
+	}
+
+	return obj;
+}
+
+// anything that can carry a metatable
+static tug_Object* tuglib_checkmetatabled(tug_Task* T, size_t idx) {
+	tug_Object* obj = tuglib_checkany(T, idx);
+	tug_Type type = tug_gettype(obj);
+	if (type != TUG_TABLE && type != TUG_STRUCT && type != TUG_RECORD) {
+		tug_err(T, "argument #%zu expected 'table', 'struct' or 'record', got '%s'", idx + 1, tuglib_typename(type));
+	}
+
+	return obj;
+}
+
+static tug_Object* tuglib_checkmutable(tug_Task* T, size_t idx) {
+	tug_Object* obj = tuglib_checkany(T, idx);
+	if (tug_isfrozen(obj)) {
+		tug_err(T, "argument #%zu is a frozen '%s'", idx + 1, tuglib_typename(tug_gettype(obj)));
+	}
+
+	return obj;
+}
+
+// objects a C function holds while scripts run are invisible to the collector, so
+// they go in a list that stands as its result until the real one is set
+static tug_Object* tuglib_keep(tug_Task* T) {
+	tug_Object* keep = tug_list();
+	tug_ret(T, keep);
+
+	return keep;
+}
 
 #define tuglib_isany(T, idx) tug_hasarg((T), (idx))
 #define tuglib_isnone(T, idx) (!tuglib_isany(T, idx))
@@ -130,6 +377,8 @@ static int tuglib_isbool(tug_Task* T, size_t idx) {
 #define tuglib_isfunc(T, idx) tuglib_istype(T, idx, TUG_FUNC)
 #define tuglib_istable(T, idx) tuglib_istype(T, idx, TUG_TABLE)
 #define tuglib_islist(T, idx) tuglib_istype(T, idx, TUG_LIST)
+#define tuglib_ismap(T, idx) tuglib_istype(T, idx, TUG_MAP)
+#define tuglib_isbuffer(T, idx) tuglib_istype(T, idx, TUG_BUFFER)
 
 #define tuglib_optany(T, idx, def) (tuglib_isnone((T), (idx)) ? (def) : tuglib_checkany((T), (idx)))
 #define tuglib_opttype(T, idx, expected, def) (tuglib_isnone((T), (idx)) ? (def) : tuglib_checktype((T), (idx), (expected)))
@@ -145,22 +394,51 @@ static int tuglib_isbool(tug_Task* T, size_t idx) {
 
 #define tuglib_gettypename(obj) tuglib_typename(tug_gettype((obj)))
 
+#define TUGLIB_NUMBUF TUG_NUMBUF
+
+// formats a number the way tostr does; `out` must hold TUGLIB_NUMBUF bytes
+static size_t tuglib_fmtnum(char* out, double num) {
+	return tug_numtostr(num, out);
+}
+
+// bytes of a string or number without creating a string object
+static int tuglib_strpart(tug_Object* obj, char* scratch, const char** str, size_t* len) {
+	switch (tug_gettype(obj)) {
+		case TUG_STR: *str = tug_getlstr(obj, len); return 1;
+		case TUG_NUM: {
+			*len = tuglib_fmtnum(scratch, tug_getnum(obj));
+			*str = scratch;
+			return 1;
+		}
+		default: return 0;
+	}
+}
+
 static tug_Object* tuglib_tostr(tug_Object* obj) {
 	tug_Type obj_type = tug_gettype(obj);
 	switch (obj_type) {
 		case TUG_STR: return obj;
 		case TUG_NUM: {
-			char* res = malloc(50);
-			snprintf(res, 50, "%.17g", tug_getnum(obj));
-			tug_Object* str_obj = tug_str(res);
-			return str_obj;
+			char tmp[TUGLIB_NUMBUF];
+			size_t len = tuglib_fmtnum(tmp, tug_getnum(obj));
+			return tug_constlstr(tmp, len);
 		}
 		case TUG_TRUE: return tug_conststr("true");
 		case TUG_FALSE: return tug_conststr("false");
 		case TUG_NIL: return tug_conststr("nil");
+		case TUG_BUFFER: {
+			size_t len;
+			const char* data = tug_bufdata(obj, &len);
+			return tug_constlstr(data ? data : "", len);
+		}
 		case TUG_FUNC:
 		case TUG_TABLE:
-		case TUG_LIST: {
+		case TUG_LIST:
+		case TUG_MAP:
+		case TUG_STRUCT:
+		case TUG_RECORD:
+		case TUG_F64ARRAY:
+		case TUG_I64ARRAY: {
 			char* res = malloc(50);
 			snprintf(res, 50, "%s: 0x%lx", tuglib_typename(obj_type), tug_getid(obj));
 			tug_Object* str_obj = tug_str(res);
@@ -176,7 +454,10 @@ static void __tuglib_print(tug_Task* T) {
 		tug_Object* obj = tug_getarg(T, i);
 
 		tug_Object* str_obj = tuglib_tostr(obj);
-		printf("%s%s", tug_getstr(str_obj), i + 1 == argc ? "" : "\t");
+		size_t len;
+		const char* str = tug_getlstr(str_obj, &len);
+		fwrite(str, 1, len, stdout);
+		if (i + 1 != argc) putchar('\t');
 	}
 
 	printf("\n");
@@ -227,7 +508,11 @@ static void __tuglib_len(tug_Task* T) {
 	} else switch (tug_gettype(obj)) {
 		case TUG_STR:
 		case TUG_TABLE:
-		case TUG_LIST: {
+		case TUG_LIST:
+		case TUG_MAP:
+		case TUG_BUFFER:
+		case TUG_F64ARRAY:
+		case TUG_I64ARRAY: {
 			tug_ret(T, tug_num((double)tug_getlen(obj)));
 		} break;
 		default: tug_err(T, "argument #1 expected 'table' or 'str', got '%s'", tuglib_gettypename(obj));
@@ -235,15 +520,16 @@ static void __tuglib_len(tug_Task* T) {
 }
 
 static void __tuglib_setmetatable(tug_Task* T) {
-	tug_Object* table = tuglib_checktable(T, 0);
+	tug_Object* table = tuglib_checkmetatabled(T, 0);
 	tug_Object* mtable = tuglib_checktable(T, 1);
+	tuglib_checkmutable(T, 0);
 
 	tug_setmetatable(table, mtable);
 	tug_ret(T, table);
 }
 
 static void __tuglib_getmetatable(tug_Task* T) {
-	tug_Object* table = tuglib_checktable(T, 0);
+	tug_Object* table = tuglib_checkmetatabled(T, 0);
 	tug_Object* mtable = tug_getmetatable(table);
 
 	if (mtable == tug_nil) return;
@@ -281,10 +567,14 @@ static void __tuglib_tonum(tug_Task* T) {
 		tug_ret(T, obj);
 		return;
 	} else if (type == TUG_STR) {
-		const char* str = tug_getstr(obj);
-		char* endptr;
-		double val = strtod(str, &endptr);
-		if (endptr != str && *endptr == '\0') {
+		size_t len;
+		const char* str = tug_getlstr(obj, &len);
+		size_t start = 0;
+		while (start < len && isspace((unsigned char)str[start])) start++;
+
+		double val;
+		size_t n = tug_strtonum(str + start, len - start, &val);
+		if (n > 0 && start + n == len) {
 			tug_ret(T, tug_num(val));
 			return;
 		}
@@ -299,11 +589,15 @@ static void __tuglib_assert(tug_Task* T) {
 	int is_true = 0;
 	tug_Type type = tug_gettype(obj);
 	switch (type) {
-		case TUG_STR: is_true = strlen(tug_getstr(obj)) > 0; break;
+		case TUG_STR: is_true = tug_getlen(obj) > 0; break;
 		case TUG_NUM: is_true = tug_getnum(obj) != 0.0; break;
 		case TUG_FUNC:
+		case TUG_MAP:
+		case TUG_STRUCT:
+		case TUG_BUFFER:
 		case TUG_TRUE: is_true = 1; break;
 		case TUG_LIST: is_true = tug_getlen(obj) != 0;
+		case TUG_RECORD:
 		case TUG_TABLE: {
 			tug_Object* truth_obj = tuglib_getmetafield(obj, "__truth");
 			if (truth_obj != tug_nil) {
@@ -315,7 +609,7 @@ static void __tuglib_assert(tug_Task* T) {
 					tug_err(T, "metamethod '__truth' must return 'bool', got '%s'", tuglib_gettypename(ret));
 					return;
 				}
-			} else is_true = tug_getlen(obj) != 0;
+			} else is_true = type == TUG_RECORD || tug_getlen(obj) != 0;
 		} break;
 		default: is_true = 0;
 	}
@@ -342,10 +636,78 @@ static void __tuglib_rawset(tug_Task* T) {
 	tug_Object* table = tuglib_checktable(T, 0);
 	tug_Object* key = tuglib_checkany(T, 1);
 	tug_Object* value = tuglib_checkany(T, 2);
+	tuglib_checkmutable(T, 0);
 
 	tug_setfield(table, key, value);
 }
 
+static void __tuglib_freeze(tug_Task* T) {
+	tug_Object* obj = tuglib_checkany(T, 0);
+	if (!tug_freeze(obj)) {
+		tug_err(T, "unable to freeze '%s', only str, num, bool, nil, C functions, tables, lists and records can be frozen", tuglib_gettypename(obj));
+	}
+
+	tug_ret(T, obj);
+}
+
+static void __tuglib_isfrozen(tug_Task* T) {
+	tug_Object* obj = tuglib_checkany(T, 0);
+	tug_ret(T, tug_isfrozen(obj) ? tug_true : tug_false);
+}
+
+static void __tuglib_next(tug_Task* T) {
+	tug_Object* table = tuglib_checktable(T, 0);
+	tug_Object* key = tuglib_optany(T, 1, tug_nil);
+
+	tug_Cursor cursor = TUG_CURSOR_INIT;
+	if (key != tug_nil && !tug_seek(table, key, &cursor)) {
+		tug_err(T, "invalid key to 'next'");
+	}
+
+	tug_Object* value;
+	if (tug_next(table, &cursor, &key, &value)) {
+		tug_rets(T, 2, key, value);
+	}
+}
+
+static void __tuglib_ordered(tug_Task* T) {
+	tug_Object* res = tug_orderedtable();
+	if (tuglib_isany(T, 0)) {
+		tug_Object* table = tuglib_checktable(T, 0);
+		tug_Cursor cursor = TUG_CURSOR_INIT;
+		tug_Object* key;
+		tug_Object* value;
+		while (tug_next(table, &cursor, &key, &value)) {
+			tug_setfield(res, key, value);
+		}
+	}
+
+	tug_ret(T, res);
+}
+
+// the same numbers a `for i in range(...)` loop counts through, as a list; loops
+// that call it directly never build one
+static void __tuglib_range(tug_Task* T) {
+	double start = 0.0, stop, step = 1.0;
+	if (tuglib_isnone(T, 1)) stop = tuglib_checknum(T, 0);
+	else {
+		start = tuglib_checknum(T, 0);
+		stop = tuglib_checknum(T, 1);
+		step = tuglib_optnum(T, 2, 1.0);
+	}
+	if (!isfinite(start) || !isfinite(stop) || !isfinite(step)) tug_err(T, "'range' bounds must be finite");
+	if (step == 0) tug_err(T, "'range' step must not be zero");
+
+	tug_Object* list = tug_list();
+	for (double i = 0;; i++) {
+		double at = start + i * step;
+		if (step > 0 ? at >= stop : at <= stop) break;
+		tug_listpush(list, tug_num(at));
+	}
+
+	tug_ret(T, list);
+}
+
 static void __tuglib_clock(tug_Task* T) {
 	tug_ret(T, tug_num((double)clock() / CLOCKS_PER_SEC));
 }
@@ -531,10 +893,10 @@ static void __tuglib_rand(tug_Task* T) {
 }
 
 static void __tuglib_sub(tug_Task* T) {
-	const char* str = tuglib_checkstr(T, 0);
+	size_t len;
+	tuglib_checklstr(T, 0, &len);
 	long start = tuglib_optlong(T, 1, 0);
 	start = start < 0 ? 0 : start;
-	size_t len = strlen(str);
 	long end = tuglib_optlong(T, 2, len);
 	end = end < 0 ? 0 : end;
 	end = (size_t)end > len ? len : end;
@@ -543,36 +905,91 @@ static void __tuglib_sub(tug_Task* T) {
 		return;
 	}
 	
-	size_t flen = (size_t)(end - start);
-	char* res = malloc(flen + 1);
-	memcpy(res, str + start, flen);
-	res[flen] = '\0';
-	tug_ret(T, tug_str(res));
+	tug_ret(T, tug_strview(tug_getarg(T, 0), (size_t)start, (size_t)(end - start)));
 }
 
+// strings and numbers are taken as they are, lists contribute their elements
 static void __tuglib_concat(tug_Task* T) {
 	size_t argc = tug_getargc(T);
-	const char** strs = malloc(sizeof(const char*) * argc);
+	char scratch[TUGLIB_NUMBUF];
+	const char* part;
+	size_t part_len;
+
 	size_t len = 0;
 	for (size_t i = 0; i < argc; i++) {
-		const char* str = tuglib_checkstr(T, i);
-		strs[i] = str;
-		len += strlen(str);
+		tug_Object* obj = tug_getarg(T, i);
+		if (tug_gettype(obj) == TUG_LIST) {
+			size_t count = tug_getlen(obj);
+			for (size_t j = 0; j < count; j++) {
+				tug_Object* item = tug_listget(obj, j);
+				if (!tuglib_strpart(item, scratch, &part, &part_len)) {
+					tug_err(T, "argument #%zu element #%zu expected 'str' or 'num', got '%s'", i + 1, j + 1, tuglib_gettypename(item));
+				}
+				len += part_len;
+			}
+		} else if (tuglib_strpart(obj, scratch, &part, &part_len)) len += part_len;
+		else tug_err(T, "argument #%zu expected 'str', 'num' or 'list', got '%s'", i + 1, tuglib_gettypename(obj));
 	}
 
 	char* res = malloc(len + 1);
-	res[0] = '\0';
+	char* ptr = res;
 	for (size_t i = 0; i < argc; i++) {
-		strcat(res, strs[i]);
+		tug_Object* obj = tug_getarg(T, i);
+		if (tug_gettype(obj) == TUG_LIST) {
+			size_t count = tug_getlen(obj);
+			for (size_t j = 0; j < count; j++) {
+				tuglib_strpart(tug_listget(obj, j), scratch, &part, &part_len);
+				memcpy(ptr, part, part_len);
+				ptr += part_len;
+			}
+		} else {
+			tuglib_strpart(obj, scratch, &part, &part_len);
+			memcpy(ptr, part, part_len);
+			ptr += part_len;
+		}
+	}
+	*ptr = '\0';
+
+	tug_ret(T, tug_lstr(res, len));
+}
+
+static void __tuglib_join(tug_Task* T) {
+	tug_Object* list = tuglib_checklist(T, 0);
+	size_t sep_len = 0;
+	const char* sep = tuglib_isnone(T, 1) ? "" : tuglib_checklstr(T, 1, &sep_len);
+	size_t count = tug_getlen(list);
+	char scratch[TUGLIB_NUMBUF];
+	const char* part;
+	size_t part_len;
+
+	size_t len = count > 0 ? sep_len * (count - 1) : 0;
+	for (size_t i = 0; i < count; i++) {
+		tug_Object* item = tug_listget(list, i);
+		if (!tuglib_strpart(item, scratch, &part, &part_len)) {
+			tug_err(T, "list element #%zu expected 'str' or 'num', got '%s'", i + 1, tuglib_gettypename(item));
+		}
+		len += part_len;
+	}
+
+	char* res = malloc(len + 1);
+	char* ptr = res;
+	for (size_t i = 0; i < count; i++) {
+		if (i > 0) {
+			memcpy(ptr, sep, sep_len);
+			ptr += sep_len;
+		}
+		tuglib_strpart(tug_listget(list, i), scratch, &part, &part_len);
+		memcpy(ptr, part, part_len);
+		ptr += part_len;
 	}
+	*ptr = '\0';
 
-	tug_ret(T, tug_str(res));
-	free(strs);
+	tug_ret(T, tug_lstr(res, len));
 }
 
 static void __tuglib_trim(tug_Task* T) {
-	const char* str = tuglib_checkstr(T, 0);
-	size_t len = strlen(str);
+	size_t len;
+	const char* str = tuglib_checklstr(T, 0, &len);
 
 	size_t start = 0;
 	while (start < len && isspace((unsigned char)str[start])) start++;
@@ -580,17 +997,12 @@ static void __tuglib_trim(tug_Task* T) {
 	size_t end = len;
 	while (end > start && isspace((unsigned char)str[end - 1])) end--;
 
-	size_t newlen = end - start;
-	char* res = malloc(newlen + 1);
-	memcpy(res, str + start, newlen);
-	res[newlen] = '\0';
-
-	tug_ret(T, tug_str(res));
+	tug_ret(T, tug_strview(tug_getarg(T, 0), start, end - start));
 }
 
 static void __tuglib_upper(tug_Task* T) {
-	const char* str = tuglib_checkstr(T, 0);
-	size_t len = strlen(str);
+	size_t len;
+	const char* str = tuglib_checklstr(T, 0, &len);
 	char* res = malloc(len + 1);
 
 	for (size_t i = 0; i < len; i++) {
@@ -598,12 +1010,12 @@ static void __tuglib_upper(tug_Task* T) {
 	}
 	res[len] = '\0';
 
-	tug_ret(T, tug_str(res));
+	tug_ret(T, tug_lstr(res, len));
 }
 
 static void __tuglib_lower(tug_Task* T) {
-	const char* str = tuglib_checkstr(T, 0);
-	size_t len = strlen(str);
+	size_t len;
+	const char* str = tuglib_checklstr(T, 0, &len);
 	char* res = malloc(len + 1);
 
 	for (size_t i = 0; i < len; i++) {
@@ -611,12 +1023,12 @@ static void __tuglib_lower(tug_Task* T) {
 	}
 	res[len] = '\0';
 
-	tug_ret(T, tug_str(res));
+	tug_ret(T, tug_lstr(res, len));
 }
 
 static void __tuglib_reverse(tug_Task* T) {
-	const char* str = tuglib_checkstr(T, 0);
-	size_t len = strlen(str);
+	size_t len;
+	const char* str = tuglib_checklstr(T, 0, &len);
 	char* res = malloc(len + 1);
 
 	for (size_t i = 0; i < len; i++) {
@@ -624,11 +1036,12 @@ static void __tuglib_reverse(tug_Task* T) {
 	}
 	res[len] = '\0';
 
-	tug_ret(T, tug_str(res));
+	tug_ret(T, tug_lstr(res, len));
 }
 
 static void __tuglib_repeat(tug_Task* T) {
-	const char* str = tuglib_checkstr(T, 0);
+	size_t len;
+	const char* str = tuglib_checklstr(T, 0, &len);
 	long count = tuglib_checklong(T, 1);
 
 	if (count <= 0) {
@@ -636,7 +1049,6 @@ static void __tuglib_repeat(tug_Task* T) {
 		return;
 	}
 
-	size_t len = strlen(str);
 	size_t total = len * count;
 	char* res = malloc(total + 1);
 
@@ -647,170 +1059,2971 @@ static void __tuglib_repeat(tug_Task* T) {
 	}
 	*ptr = '\0';
 
-	tug_ret(T, tug_str(res));
+	tug_ret(T, tug_lstr(res, total));
 }
 
 static void __tuglib_split(tug_Task* T) {
-	const char* str = tuglib_checkstr(T, 0);
-	const char* delim = tuglib_checkstr(T, 1);
+	size_t len, delim_len;
+	const char* str = tuglib_checklstr(T, 0, &len);
+	const char* delim = tuglib_checklstr(T, 1, &delim_len);
 
 	tug_Object* res = tug_list();
-	size_t delim_len = strlen(delim);
 	if (delim_len == 0) {
-		for (size_t i = 0; str[i]; i++) {
-			char tmp[2] = {str[i], '\0'};
-			tug_listpush(res, tug_conststr(tmp));
+		for (size_t i = 0; i < len; i++) {
+			tug_listpush(res, tug_constlstr(str + i, 1));
 		}
 	} else {
+		tug_Object* src = tug_getarg(T, 0);
 		const char* start = str;
+		const char* end = str + len;
 		const char* found;
-		char* part = NULL;
-		while ((found = strstr(start, delim)) != NULL) {
-			size_t part_len = found - start;
-			part = realloc(part, part_len + 1);
-			memcpy(part, start, part_len);
-			part[part_len] = '\0';
-			tug_listpush(res, tug_conststr((const char*)part));
-
+		while ((found = tuglib_memfind(start, (size_t)(end - start), delim, delim_len)) != NULL) {
+			tug_listpush(res, tug_strview(src, (size_t)(start - str), (size_t)(found - start)));
 			start = found + delim_len;
 		}
-		free(part);
 
-		if (*start) {
-			tug_listpush(res, tug_conststr((const char*)start));
+		if (start < end) {
+			tug_listpush(res, tug_strview(src, (size_t)(start - str), (size_t)(end - start)));
 		}
 	}
 
 	tug_ret(T, res);
 }
 
+// str.find(s, sub, start = 0, all = false), with `all` every non-overlapping
+// position is returned in a list
 static void __tuglib_str_find(tug_Task* T) {
-	const char* str = tuglib_checkstr(T, 0);
-	const char* sub = tuglib_checkstr(T, 1);
-	const char* pos = strstr(str, sub);
+	size_t len, sub_len;
+	const char* str = tuglib_checklstr(T, 0, &len);
+	const char* sub = tuglib_checklstr(T, 1, &sub_len);
+	long start = tuglib_optlong(T, 2, 0);
+	int all = tuglib_isnone(T, 3) ? 0 : tuglib_checkbool(T, 3);
+	if (start < 0) start = 0;
+	if ((size_t)start > len) {
+		if (all) tug_ret(T, tug_list());
+		return;
+	}
+
+	const char* ptr = str + start;
+	const char* end = str + len;
+	if (!all) {
+		const char* pos = tuglib_memfind(ptr, (size_t)(end - ptr), sub, sub_len);
+		if (pos) tug_ret(T, tug_num((double)(pos - str)));
+		return;
+	}
+
+	tug_Object* res = tug_list();
+	const char* pos;
+	while (ptr <= end && (pos = tuglib_memfind(ptr, (size_t)(end - ptr), sub, sub_len)) != NULL) {
+		tug_listpush(res, tug_num((double)(pos - str)));
+		ptr = pos + (sub_len > 0 ? sub_len : 1);
+	}
+
+	tug_ret(T, res);
+}
+
+static void __tuglib_str_count(tug_Task* T) {
+	size_t len, sub_len;
+	const char* str = tuglib_checklstr(T, 0, &len);
+	const char* sub = tuglib_checklstr(T, 1, &sub_len);
+	if (sub_len == 0) {
+		tug_ret(T, tug_num((double)(len + 1)));
+		return;
+	}
 
-	if (pos) {
-		tug_ret(T, tug_num((double)(pos - str)));
+	size_t count = 0;
+	const char* ptr = str;
+	const char* end = str + len;
+	while ((ptr = tuglib_memfind(ptr, (size_t)(end - ptr), sub, sub_len)) != NULL) {
+		count++;
+		ptr += sub_len;
 	}
+
+	tug_ret(T, tug_num((double)count));
 }
 
 static void __tuglib_str_replace(tug_Task* T) {
-	const char* str = tuglib_checkstr(T, 0);
-	const char* old = tuglib_checkstr(T, 1);
-	const char* new = tuglib_checkstr(T, 2);
+	size_t len, old_len, new_len;
+	const char* str = tuglib_checklstr(T, 0, &len);
+	const char* old = tuglib_checklstr(T, 1, &old_len);
+	const char* new = tuglib_checklstr(T, 2, &new_len);
 	long count = tuglib_optlong(T, 3, 0);
 
-	if (!*old) {
-		tug_ret(T, tug_conststr(str));
+	if (old_len == 0) {
+		tug_ret(T, tug_getarg(T, 0));
 		return;
 	}
 
-	size_t old_len = strlen(old);
-	size_t new_len = strlen(new);
-
-	const char* src = str;
+	// one scan, the match offsets are kept for the copy
+	size_t stack_found[64];
+	size_t* found = stack_found;
+	size_t found_cap = 64;
 	size_t total_reps = 0;
 
+	const char* end = str + len;
 	const char* tmp = str;
-	while ((tmp = strstr(tmp, old))) {
-		total_reps++;
+	while ((count <= 0 || total_reps < (size_t)count) && (tmp = tuglib_memfind(tmp, (size_t)(end - tmp), old, old_len))) {
+		if (total_reps == found_cap) {
+			found_cap *= 2;
+			if (found == stack_found) {
+				found = malloc(found_cap * sizeof(size_t));
+				memcpy(found, stack_found, sizeof(stack_found));
+			} else found = realloc(found, found_cap * sizeof(size_t));
+		}
+		found[total_reps++] = (size_t)(tmp - str);
 		tmp += old_len;
 	}
-	
-	if (count > 0 && (size_t)count < total_reps) {
-		total_reps = count;
+
+	if (total_reps == 0) {
+		tug_ret(T, tug_getarg(T, 0));
+		return;
 	}
 
-	size_t new_size = strlen(str) + (new_len - old_len) * total_reps + 1;
-	char* res = malloc(new_size);
+	size_t new_size = len - old_len * total_reps + new_len * total_reps;
+	char* res = malloc(new_size + 1);
 	char* out = res;
 
-	int done = 0;
-	while (*str) {
-		if ((count <= 0 || done < count) && strncmp(str, old, old_len) == 0) {
-			memcpy(out, new, new_len);
-			out += new_len;
-			str += old_len;
-			done++;
-		} else {
-			*out++ = *str++;
-		}
+	size_t prev = 0;
+	for (size_t i = 0; i < total_reps; i++) {
+		memcpy(out, str + prev, found[i] - prev);
+		out += found[i] - prev;
+		memcpy(out, new, new_len);
+		out += new_len;
+		prev = found[i] + old_len;
 	}
+	memcpy(out, str + prev, len - prev);
+	out += len - prev;
 	*out = '\0';
 
-	tug_ret(T, tug_str(res));
+	if (found != stack_found) free(found);
+	tug_ret(T, tug_lstr(res, new_size));
 }
 
-static void __tuglib_push(tug_Task* T) {
-	tug_Object* list = tuglib_checklist(T, 0);
-	tug_Object* obj = tuglib_checkany(T, 1);
+// str.format placeholders: {[index][:[[fill]align][0][width][.precision][type]]},
+// align is one of < > ^ =, type one of s d x X f e g, braces are doubled to escape
+typedef struct {
+	size_t lit_start;
+	size_t lit_len;
+	int field;
+	size_t arg;
+	char fill;
+	char align;
+	char type;
+	int width;
+	int prec;
+} tuglib_FmtSeg;
+
+typedef struct {
+	char* fmt;
+	size_t len;
+	uint64_t hash;
+	tuglib_FmtSeg* segs;
+	size_t count;
+} tuglib_FmtSpec;
+
+// parsed formats, direct-mapped by the hash of the format string
+#define TUGLIB_FMTCACHE 64
+#define TUGLIB_FMTPREC 100
+// FNV-1a, keys the compiled format and pattern caches
+static uint64_t tuglib_hashbytes(const char* str, size_t len) {
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < len; i++) {
+		hash ^= (unsigned char)str[i];
+		hash *= 1099511628211ULL;
+	}
 
-	tug_listpush(list, obj);
+	return hash;
 }
 
-static void __tuglib_pop(tug_Task* T) {
-	tug_Object* list = tuglib_checklist(T, 0);
-	size_t len = tug_getlen(list);
-	long idx = tuglib_optlong(T, 1, len - 1);
-	if (idx < 0 || idx >= len) tug_err(T, "pop index out of range");
+static tuglib_FmtSpec tuglib_fmtcache[TUGLIB_FMTCACHE];
+
+static const char* tuglib_fmtparse(const char* fmt, size_t len, tuglib_FmtSeg** out, size_t* out_count) {
+	size_t cap = 8;
+	size_t count = 0;
+	tuglib_FmtSeg* segs = malloc(cap * sizeof(tuglib_FmtSeg));
+	size_t next_arg = 0;
+	size_t lit_start = 0;
+	const char* err = NULL;
+
+	size_t i = 0;
+	while (i <= len) {
+		if (count == cap) {
+			cap *= 2;
+			segs = realloc(segs, cap * sizeof(tuglib_FmtSeg));
+		}
+		tuglib_FmtSeg* seg = &segs[count];
+		seg->lit_start = lit_start;
+		seg->field = 0;
+
+		if (i == len) {
+			seg->lit_len = i - lit_start;
+			if (seg->lit_len > 0) count++;
+			break;
+		}
 
-	tug_Object* pop = tug_listpop(list, idx);
-	tug_ret(T, pop);
+		char c = fmt[i];
+		if ((c == '{' || c == '}') && i + 1 < len && fmt[i + 1] == c) {
+			// keep the first brace as literal text and skip the second
+			seg->lit_len = i + 1 - lit_start;
+			count++;
+			i += 2;
+			lit_start = i;
+			continue;
+		}
+		if (c == '}') {
+			err = "single '}' in format string";
+			break;
+		}
+		if (c != '{') {
+			i++;
+			continue;
+		}
+
+		seg->lit_len = i - lit_start;
+		seg->field = 1;
+		seg->fill = ' ';
+		seg->align = 0;
+		seg->type = 0;
+		seg->width = -1;
+		seg->prec = -1;
+		i++;
+
+		if (i < len && isdigit((unsigned char)fmt[i])) {
+			size_t arg = 0;
+			while (i < len && isdigit((unsigned char)fmt[i])) arg = arg * 10 + (size_t)(fmt[i++] - '0');
+			seg->arg = arg;
+		} else seg->arg = next_arg++;
+
+		if (i < len && fmt[i] == ':') {
+			i++;
+			if (i + 1 < len && strchr("<>^=", fmt[i + 1]) && fmt[i + 1] != '\0') {
+				seg->fill = fmt[i];
+				seg->align = fmt[i + 1];
+				i += 2;
+			} else if (i < len && strchr("<>^=", fmt[i]) && fmt[i] != '\0') {
+				seg->align = fmt[i++];
+			}
+			if (i < len && fmt[i] == '0') {
+				if (!seg->align) {
+					seg->fill = '0';
+					seg->align = '=';
+				}
+				i++;
+			}
+			if (i < len && isdigit((unsigned char)fmt[i])) {
+				seg->width = 0;
+				while (i < len && isdigit((unsigned char)fmt[i]) && seg->width < 10000) seg->width = seg->width * 10 + (fmt[i++] - '0');
+			}
+			if (i < len && fmt[i] == '.') {
+				i++;
+				if (i >= len || !isdigit((unsigned char)fmt[i])) {
+					err = "missing precision in format spec";
+					break;
+				}
+				seg->prec = 0;
+				while (i < len && isdigit((unsigned char)fmt[i])) seg->prec = seg->prec * 10 + (fmt[i++] - '0');
+				if (seg->prec > TUGLIB_FMTPREC) seg->prec = TUGLIB_FMTPREC;
+			}
+			if (i < len && strchr("sdxXfeg", fmt[i]) && fmt[i] != '\0') seg->type = fmt[i++];
+		}
+
+		if (i >= len || fmt[i] != '}') {
+			err = "invalid format spec, expected '}'";
+			break;
+		}
+		i++;
+		lit_start = i;
+		count++;
+	}
+
+	if (err) {
+		free(segs);
+		return err;
+	}
+
+	*out = segs;
+	*out_count = count;
+	return NULL;
 }
 
-static void __tuglib_insert(tug_Task* T) {
-	tug_Object* list = tuglib_checklist(T, 0);
-	long idx = tuglib_checklong(T, 1);
-	if (idx < 0 || idx >= tug_getlen(list)) tug_err(T, "pop index out of range");
-	tug_Object* obj = tuglib_checkany(T, 2);
+static tuglib_FmtSpec* tuglib_fmtcompile(tug_Task* T, const char* fmt, size_t len) {
+	uint64_t hash = tuglib_hashbytes(fmt, len);
 
-	tug_listinsert(list, idx, obj);
+	tuglib_FmtSpec* spec = &tuglib_fmtcache[hash & (TUGLIB_FMTCACHE - 1)];
+	if (spec->fmt && spec->hash == hash && spec->len == len && memcmp(spec->fmt, fmt, len) == 0) return spec;
+
+	tuglib_FmtSeg* segs;
+	size_t count;
+	const char* err = tuglib_fmtparse(fmt, len, &segs, &count);
+	if (err) tug_err(T, "%s", err);
+
+	free(spec->fmt);
+	free(spec->segs);
+	spec->fmt = malloc(len + 1);
+	memcpy(spec->fmt, fmt, len);
+	spec->fmt[len] = '\0';
+	spec->len = len;
+	spec->hash = hash;
+	spec->segs = segs;
+	spec->count = count;
+
+	return spec;
 }
 
-static void __tuglib_clear(tug_Task* T) {
-	tug_listclear(tuglib_checklist(T, 0));
+// renders one field without padding, numbers are written to `scratch`
+static const char* tuglib_fmtfield(tuglib_FmtSeg* seg, tug_Object* arg, char* scratch, size_t* len) {
+	char type = seg->type;
+	if (type == 0 || type == 's') {
+		if (type == 0 && tug_gettype(arg) == TUG_NUM && seg->prec >= 0) {
+			*len = (size_t)snprintf(scratch, 512, "%.*g", seg->prec, tug_getnum(arg));
+			return scratch;
+		}
+
+		const char* str;
+		if (tug_gettype(arg) == TUG_NUM) {
+			*len = tuglib_fmtnum(scratch, tug_getnum(arg));
+			str = scratch;
+		} else str = tug_getlstr(tuglib_tostr(arg), len);
+		if (seg->prec >= 0 && (size_t)seg->prec < *len) *len = (size_t)seg->prec;
+		return str;
+	}
+
+	double num = tug_getnum(arg);
+	int prec = seg->prec >= 0 ? seg->prec : 6;
+	int n;
+	switch (type) {
+		case 'd': n = snprintf(scratch, 512, "%lld", (long long)num); break;
+		case 'x': n = snprintf(scratch, 512, "%llx", (long long)num); break;
+		case 'X': n = snprintf(scratch, 512, "%llX", (long long)num); break;
+		case 'f': n = snprintf(scratch, 512, "%.*f", prec, num); break;
+		case 'e': n = snprintf(scratch, 512, "%.*e", prec, num); break;
+		default: n = snprintf(scratch, 512, "%.*g", prec, num); break;
+	}
+
+	*len = (size_t)n;
+	return scratch;
 }
 
-static void __tuglib_unpack(tug_Task* T) {
-	tug_Object* list = tuglib_checklist(T, 0);
-	size_t len = tug_getlen(list);
-	tug_Object* tuple = tug_tuple();
-	for (size_t i = 0; i < len; i++) {
-		tug_tuplepush(tuple, tug_listget(list, i));
+typedef struct {
+	const char* str;
+	size_t off;
+	size_t len;
+} tuglib_FmtPart;
+
+static void __tuglib_str_format(tug_Task* T) {
+	size_t fmt_len;
+	const char* fmt = tuglib_checklstr(T, 0, &fmt_len);
+	tuglib_FmtSpec* spec = tuglib_fmtcompile(T, fmt, fmt_len);
+	size_t argc = tug_getargc(T);
+	for (size_t i = 0; i < spec->count; i++) {
+		tuglib_FmtSeg* seg = &spec->segs[i];
+		if (!seg->field) continue;
+		if (seg->arg + 1 >= argc) tug_err(T, "missing argument #%zu for format", seg->arg + 2);
+
+		tug_Object* arg = tug_getarg(T, seg->arg + 1);
+		if (seg->type && seg->type != 's' && tug_gettype(arg) != TUG_NUM) {
+			tug_err(T, "argument #%zu expected 'num' for '%c', got '%s'", seg->arg + 2, seg->type, tuglib_gettypename(arg));
+		}
 	}
 
-	tug_ret(T, tuple);
+	// every field is rendered once up front so the result can be sized exactly,
+	// rendered numbers go to `arena` and strings are used in place
+	tuglib_FmtPart stack_parts[16];
+	tuglib_FmtPart* parts = spec->count <= 16 ? stack_parts : malloc(spec->count * sizeof(tuglib_FmtPart));
+	char stack_arena[1024];
+	char* arena = stack_arena;
+	size_t arena_cap = sizeof(stack_arena);
+	size_t arena_len = 0;
+
+	size_t total = 0;
+	for (size_t i = 0; i < spec->count; i++) {
+		tuglib_FmtSeg* seg = &spec->segs[i];
+		total += seg->lit_len;
+		if (!seg->field) continue;
+
+		char scratch[512];
+		size_t len;
+		const char* str = tuglib_fmtfield(seg, tug_getarg(T, seg->arg + 1), scratch, &len);
+		if (str == scratch) {
+			if (arena_len + len > arena_cap) {
+				while (arena_len + len > arena_cap) arena_cap *= 2;
+				if (arena == stack_arena) {
+					arena = malloc(arena_cap);
+					memcpy(arena, stack_arena, arena_len);
+				} else arena = realloc(arena, arena_cap);
+			}
+			memcpy(arena + arena_len, scratch, len);
+			parts[i].str = NULL;
+			parts[i].off = arena_len;
+			arena_len += len;
+		} else parts[i].str = str;
+		parts[i].len = len;
+		total += (seg->width > 0 && (size_t)seg->width > len) ? (size_t)seg->width : len;
+	}
+
+	char* res = malloc(total + 1);
+	char* out = res;
+	for (size_t i = 0; i < spec->count; i++) {
+		tuglib_FmtSeg* seg = &spec->segs[i];
+		memcpy(out, spec->fmt + seg->lit_start, seg->lit_len);
+		out += seg->lit_len;
+		if (!seg->field) continue;
+
+		const char* str = parts[i].str ? parts[i].str : arena + parts[i].off;
+		size_t len = parts[i].len;
+		size_t pad = (seg->width > 0 && (size_t)seg->width > len) ? (size_t)seg->width - len : 0;
+		char align = seg->align ? seg->align : (seg->type && seg->type != 's') || (!seg->type && tug_gettype(tug_getarg(T, seg->arg + 1)) == TUG_NUM) ? '>' : '<';
+
+		size_t left = align == '>' ? pad : align == '^' ? pad / 2 : 0;
+		if (align == '=') {
+			// padding goes between the sign and the digits
+			if (len > 0 && (str[0] == '-' || str[0] == '+')) {
+				*out++ = *str++;
+				len--;
+			}
+			left = pad;
+		}
+
+		memset(out, seg->fill, left);
+		out += left;
+		memcpy(out, str, len);
+		out += len;
+		memset(out, seg->fill, pad - left);
+		out += pad - left;
+	}
+	*out = '\0';
+
+	if (parts != stack_parts) free(parts);
+	if (arena != stack_arena) free(arena);
+	tug_ret(T, tug_lstr(res, total));
 }
 
-static void tuglib_loadbuiltins(tug_Task* T) {
-	tug_setglobal(T, "print", tug_cfunc("print", __tuglib_print));
-	tug_setglobal(T, "tostr", tug_cfunc("tostr", __tuglib_tostr));
-	tug_setglobal(T, "type", tug_cfunc("type", __tuglib_type));
-	tug_setglobal(T, "setmetatable", tug_cfunc("setmetatable", __tuglib_setmetatable));
-	tug_setglobal(T, "getmetatable", tug_cfunc("getmetatable", __tuglib_getmetatable));
-	tug_setglobal(T, "len", tug_cfunc("len", __tuglib_len));
-	tug_setglobal(T, "error", tug_cfunc("error", __tuglib_error));
-	tug_setglobal(T, "pcall", tug_cfunc("pcall", __tuglib_pcall));
-	tug_setglobal(T, "tonum", tug_cfunc("tonum", __tuglib_tonum));
-	tug_setglobal(T, "assert", tug_cfunc("assert", __tuglib_assert));
-	tug_setglobal(T, "rawget", tug_cfunc("rawget", __tuglib_rawget));
-	tug_setglobal(T, "rawset", tug_cfunc("rawset", __tuglib_rawset));
-	tug_setglobal(T, "clock", tug_cfunc("clock", __tuglib_clock));
+// patterns: regex-style syntax compiled to a Pike VM program, `%` or `\` escapes,
+// %d %w %s %a %l %u %x %p are classes and their upper case forms the complements
+enum {
+	TUGLIB_RE_CHAR,
+	TUGLIB_RE_ANY,
+	TUGLIB_RE_CLASS,
+	TUGLIB_RE_SPLIT,
+	TUGLIB_RE_JMP,
+	TUGLIB_RE_SAVE,
+	TUGLIB_RE_BOL,
+	TUGLIB_RE_EOL,
+	TUGLIB_RE_MATCH,
+};
+
+typedef struct {
+	uint8_t op;
+	uint8_t c;
+	int x;
+	int y;
+} tuglib_ReInst;
+
+// a lazily built DFA state, `next` is -1 until the transition has been taken
+typedef struct {
+	int* pcs;
+	size_t count;
+	int accept;
+	int16_t next[256];
+} tuglib_ReState;
+
+#define TUGLIB_RE_MAXPROG 4096
+#define TUGLIB_RE_MAXSTATES 128
+#define TUGLIB_RE_CACHE 32
+
+typedef struct {
+	char* src;
+	size_t src_len;
+	uint64_t hash;
+	unsigned long tick;
+	int refs;
+
+	tuglib_ReInst* code;
+	size_t count;
+	size_t cap;
+	int anchored;
+	uint8_t (*classes)[32];
+	size_t class_count;
+	size_t ncap;
+	char* prefix;
+	size_t prefix_len;
+
+	// patterns without '$' also get a DFA that rules out inputs with no match
+	int dfa;
+	tuglib_ReState* states;
+	size_t state_count;
+	int start0;
+	int startn;
+	unsigned* marks;
+	unsigned mark_gen;
+	int* scratch;
+} tuglib_Re;
+
+enum {
+	TUGLIB_REN_CHAR,
+	TUGLIB_REN_ANY,
+	TUGLIB_REN_CLASS,
+	TUGLIB_REN_CAT,
+	TUGLIB_REN_ALT,
+	TUGLIB_REN_REP,
+	TUGLIB_REN_GROUP,
+	TUGLIB_REN_BOL,
+	TUGLIB_REN_EOL,
+	TUGLIB_REN_EMPTY,
+};
+
+typedef struct {
+	int kind;
+	int a;
+	int b;
+	int min;
+	int max;
+	int greedy;
+	uint8_t c;
+	int group;
+} tuglib_ReNode;
+
+typedef struct {
+	const char* ptr;
+	const char* end;
+	tuglib_ReNode* nodes;
+	size_t node_count;
+	size_t node_cap;
+	tuglib_Re* re;
+	int groups;
+	int depth;
+	const char* err;
+} tuglib_ReParser;
+
+static int tuglib_re_node(tuglib_ReParser* P, int kind) {
+	if (P->node_count == P->node_cap) {
+		P->node_cap = P->node_cap ? P->node_cap * 2 : 32;
+		P->nodes = realloc(P->nodes, P->node_cap * sizeof(tuglib_ReNode));
+	}
 
-	tug_Object* mathlib = tug_table();
-	tug_setfield(mathlib, tug_conststr("sin"), tug_cfunc("sin", __tuglib_sin));
-	tug_setfield(mathlib, tug_conststr("cos"), tug_cfunc("cos", __tuglib_cos));
-	tug_setfield(mathlib, tug_conststr("tan"), tug_cfunc("tan", __tuglib_tan));
-	tug_setfield(mathlib, tug_conststr("atan2"), tug_cfunc("atan2", __tuglib_atan2));
-	tug_setfield(mathlib, tug_conststr("asin"), tug_cfunc("asin", __tuglib_asin));
-	tug_setfield(mathlib, tug_conststr("acos"), tug_cfunc("acos", __tuglib_acos));
-	tug_setfield(mathlib, tug_conststr("sqrt"), tug_cfunc("sqrt", __tuglib_sqrt));
-	tug_setfield(mathlib, tug_conststr("pow"), tug_cfunc("pow", __tuglib_pow));
-	tug_setfield(mathlib, tug_conststr("hypot"), tug_cfunc("hypot", __tuglib_hypot));
-	tug_setfield(mathlib, tug_conststr("floor"), tug_cfunc("floor", __tuglib_floor));
-	tug_setfield(mathlib, tug_conststr("ceil"), tug_cfunc("ceil", __tuglib_ceil));
-	tug_setfield(mathlib, tug_conststr("round"), tug_cfunc("round", __tuglib_round));
-	tug_setfield(mathlib, tug_conststr("mod"), tug_cfunc("mod", __tuglib_mod));
+	tuglib_ReNode* node = &P->nodes[P->node_count];
+	memset(node, 0, sizeof(*node));
+	node->kind = kind;
+	node->group = -1;
+	return (int)P->node_count++;
+}
+
+static int tuglib_re_class(tuglib_ReParser* P) {
+	tuglib_Re* re = P->re;
+	re->classes = realloc(re->classes, (re->class_count + 1) * sizeof(*re->classes));
+	memset(re->classes[re->class_count], 0, 32);
+	return (int)re->class_count++;
+}
+
+#define tuglib_re_setbit(set, c) ((set)[(uint8_t)(c) >> 3] |= (uint8_t)(1 << ((uint8_t)(c) & 7)))
+#define tuglib_re_hasbit(set, c) ((set)[(uint8_t)(c) >> 3] & (1 << ((uint8_t)(c) & 7)))
+
+// fills `set` for a %x class letter, returns 0 when it isn't one
+static int tuglib_re_named(uint8_t* set, char letter) {
+	int (*test)(int) = NULL;
+	switch (tolower((unsigned char)letter)) {
+		case 'd': test = isdigit; break;
+		case 'w': test = isalnum; break;
+		case 's': test = isspace; break;
+		case 'a': test = isalpha; break;
+		case 'l': test = islower; break;
+		case 'u': test = isupper; break;
+		case 'x': test = isxdigit; break;
+		case 'p': test = ispunct; break;
+		default: return 0;
+	}
+
+	int negate = isupper((unsigned char)letter);
+	for (int c = 0; c < 256; c++) {
+		int in = test(c) || (tolower((unsigned char)letter) == 'w' && c == '_');
+		if (in != negate) tuglib_re_setbit(set, c);
+	}
+	return 1;
+}
+
+static int tuglib_re_escape(char c) {
+	switch (c) {
+		case 'n': return '\n';
+		case 't': return '\t';
+		case 'r': return '\r';
+		case '0': return '\0';
+		default: return (unsigned char)c;
+	}
+}
+
+static int tuglib_re_alt(tuglib_ReParser* P);
+
+static int tuglib_re_atom(tuglib_ReParser* P) {
+	char c = *P->ptr++;
+	switch (c) {
+		case '.': return tuglib_re_node(P, TUGLIB_REN_ANY);
+		case '^': return tuglib_re_node(P, TUGLIB_REN_BOL);
+		case '$': return tuglib_re_node(P, TUGLIB_REN_EOL);
+		case '(': {
+			if (++P->depth > 100) {
+				P->err = "pattern nests too deep";
+				return -1;
+			}
+			int group = -1;
+			if (P->end - P->ptr >= 2 && P->ptr[0] == '?' && P->ptr[1] == ':') P->ptr += 2;
+			else group = ++P->groups;
+
+			int inner = tuglib_re_alt(P);
+			if (inner < 0) return -1;
+			if (P->ptr >= P->end || *P->ptr != ')') {
+				P->err = "missing ')' in pattern";
+				return -1;
+			}
+			P->ptr++;
+			P->depth--;
+
+			int node = tuglib_re_node(P, TUGLIB_REN_GROUP);
+			P->nodes[node].a = inner;
+			P->nodes[node].group = group;
+			return node;
+		}
+		case '[': {
+			int cls = tuglib_re_class(P);
+			uint8_t set[32] = {0};
+			int negate = 0;
+			if (P->ptr < P->end && *P->ptr == '^') {
+				negate = 1;
+				P->ptr++;
+			}
+
+			int first = 1;
+			while (P->ptr < P->end && (*P->ptr != ']' || first)) {
+				first = 0;
+				int lo = (unsigned char)*P->ptr++;
+				if ((lo == '%' || lo == '\\') && P->ptr < P->end) {
+					char esc = *P->ptr++;
+					if (tuglib_re_named(set, esc)) continue;
+					lo = tuglib_re_escape(esc);
+				}
+
+				int hi = lo;
+				if (P->ptr + 1 < P->end && *P->ptr == '-' && P->ptr[1] != ']') {
+					P->ptr++;
+					hi = (unsigned char)*P->ptr++;
+					if ((hi == '%' || hi == '\\') && P->ptr < P->end) hi = tuglib_re_escape(*P->ptr++);
+					if (hi < lo) {
+						P->err = "invalid range in pattern class";
+						return -1;
+					}
+				}
+				for (int ch = lo; ch <= hi; ch++) tuglib_re_setbit(set, ch);
+			}
+			if (P->ptr >= P->end) {
+				P->err = "missing ']' in pattern";
+				return -1;
+			}
+			P->ptr++;
+
+			for (int i = 0; i < 32; i++) P->re->classes[cls][i] = negate ? (uint8_t)~set[i] : set[i];
+			int node = tuglib_re_node(P, TUGLIB_REN_CLASS);
+			P->nodes[node].a = cls;
+			return node;
+		}
+		case '%':
+		case '\\': {
+			if (P->ptr >= P->end) {
+				P->err = "pattern ends with an escape";
+				return -1;
+			}
+			char esc = *P->ptr++;
+			uint8_t set[32] = {0};
+			if (tuglib_re_named(set, esc)) {
+				int cls = tuglib_re_class(P);
+				memcpy(P->re->classes[cls], set, 32);
+				int node = tuglib_re_node(P, TUGLIB_REN_CLASS);
+				P->nodes[node].a = cls;
+				return node;
+			}
+
+			int node = tuglib_re_node(P, TUGLIB_REN_CHAR);
+			P->nodes[node].c = (uint8_t)tuglib_re_escape(esc);
+			return node;
+		}
+		case '*':
+		case '+':
+		case '?':
+		case '{': {
+			P->err = "quantifier without anything to repeat";
+			return -1;
+		}
+		default: {
+			int node = tuglib_re_node(P, TUGLIB_REN_CHAR);
+			P->nodes[node].c = (uint8_t)c;
+			return node;
+		}
+	}
+}
+
+static int tuglib_re_repeat(tuglib_ReParser* P) {
+	int atom = tuglib_re_atom(P);
+	while (atom >= 0 && P->ptr < P->end) {
+		int min, max;
+		char q = *P->ptr;
+		if (q == '*') { min = 0; max = -1; P->ptr++; }
+		else if (q == '+') { min = 1; max = -1; P->ptr++; }
+		else if (q == '?') { min = 0; max = 1; P->ptr++; }
+		else if (q == '{' && P->ptr + 1 < P->end && isdigit((unsigned char)P->ptr[1])) {
+			const char* ptr = P->ptr + 1;
+			min = 0;
+			while (ptr < P->end && isdigit((unsigned char)*ptr) && min <= 1000) min = min * 10 + (*ptr++ - '0');
+			max = min;
+			if (ptr < P->end && *ptr == ',') {
+				ptr++;
+				max = -1;
+				if (ptr < P->end && isdigit((unsigned char)*ptr)) {
+					max = 0;
+					while (ptr < P->end && isdigit((unsigned char)*ptr) && max <= 1000) max = max * 10 + (*ptr++ - '0');
+				}
+			}
+			if (ptr >= P->end || *ptr != '}') break;
+			if (min > 1000 || max > 1000 || (max >= 0 && max < min)) {
+				P->err = "invalid repetition count in pattern";
+				return -1;
+			}
+			P->ptr = ptr + 1;
+		} else break;
+
+		int greedy = 1;
+		if (P->ptr < P->end && *P->ptr == '?') {
+			greedy = 0;
+			P->ptr++;
+		}
+
+		int node = tuglib_re_node(P, TUGLIB_REN_REP);
+		P->nodes[node].a = atom;
+		P->nodes[node].min = min;
+		P->nodes[node].max = max;
+		P->nodes[node].greedy = greedy;
+		atom = node;
+	}
+
+	return atom;
+}
+
+static int tuglib_re_cat(tuglib_ReParser* P) {
+	int res = -1;
+	while (P->ptr < P->end && *P->ptr != '|' && *P->ptr != ')') {
+		int node = tuglib_re_repeat(P);
+		if (node < 0) return -1;
+		if (res < 0) res = node;
+		else {
+			int cat = tuglib_re_node(P, TUGLIB_REN_CAT);
+			P->nodes[cat].a = res;
+			P->nodes[cat].b = node;
+			res = cat;
+		}
+	}
+
+	return res < 0 ? tuglib_re_node(P, TUGLIB_REN_EMPTY) : res;
+}
+
+static int tuglib_re_alt(tuglib_ReParser* P) {
+	int res = tuglib_re_cat(P);
+	while (res >= 0 && P->ptr < P->end && *P->ptr == '|') {
+		P->ptr++;
+		int rhs = tuglib_re_cat(P);
+		if (rhs < 0) return -1;
+
+		int alt = tuglib_re_node(P, TUGLIB_REN_ALT);
+		P->nodes[alt].a = res;
+		P->nodes[alt].b = rhs;
+		res = alt;
+	}
+
+	return res;
+}
+
+static int tuglib_re_emit(tuglib_ReParser* P, uint8_t op, int x, int y) {
+	tuglib_Re* re = P->re;
+	if (re->count >= TUGLIB_RE_MAXPROG) {
+		P->err = "pattern too large";
+		return -1;
+	}
+	if (re->count == re->cap) {
+		re->cap = re->cap ? re->cap * 2 : 16;
+		re->code = realloc(re->code, re->cap * sizeof(tuglib_ReInst));
+	}
+
+	tuglib_ReInst* inst = &re->code[re->count];
+	inst->op = op;
+	inst->c = 0;
+	inst->x = x;
+	inst->y = y;
+	return (int)re->count++;
+}
+
+static int tuglib_re_gen(tuglib_ReParser* P, int idx) {
+	tuglib_ReNode* node = &P->nodes[idx];
+	tuglib_Re* re = P->re;
+	switch (node->kind) {
+		case TUGLIB_REN_CHAR: {
+			int pc = tuglib_re_emit(P, TUGLIB_RE_CHAR, 0, 0);
+			if (pc < 0) return 0;
+			re->code[pc].c = node->c;
+		} break;
+		case TUGLIB_REN_ANY: return tuglib_re_emit(P, TUGLIB_RE_ANY, 0, 0) >= 0;
+		case TUGLIB_REN_CLASS: return tuglib_re_emit(P, TUGLIB_RE_CLASS, node->a, 0) >= 0;
+		case TUGLIB_REN_BOL: return tuglib_re_emit(P, TUGLIB_RE_BOL, 0, 0) >= 0;
+		case TUGLIB_REN_EOL: return tuglib_re_emit(P, TUGLIB_RE_EOL, 0, 0) >= 0;
+		case TUGLIB_REN_EMPTY: break;
+		case TUGLIB_REN_CAT: return tuglib_re_gen(P, node->a) && tuglib_re_gen(P, P->nodes[idx].b);
+		case TUGLIB_REN_GROUP: {
+			int group = node->group;
+			int inner = node->a;
+			if (group >= 0 && tuglib_re_emit(P, TUGLIB_RE_SAVE, group * 2, 0) < 0) return 0;
+			if (!tuglib_re_gen(P, inner)) return 0;
+			if (group >= 0 && tuglib_re_emit(P, TUGLIB_RE_SAVE, group * 2 + 1, 0) < 0) return 0;
+		} break;
+		case TUGLIB_REN_ALT: {
+			int a = node->a;
+			int b = node->b;
+			int split = tuglib_re_emit(P, TUGLIB_RE_SPLIT, 0, 0);
+			if (split < 0) return 0;
+			re->code[split].x = split + 1;
+			if (!tuglib_re_gen(P, a)) return 0;
+			int jmp = tuglib_re_emit(P, TUGLIB_RE_JMP, 0, 0);
+			if (jmp < 0) return 0;
+			re->code[split].y = (int)re->count;
+			if (!tuglib_re_gen(P, b)) return 0;
+			re->code[jmp].x = (int)re->count;
+		} break;
+		case TUGLIB_REN_REP: {
+			int inner = node->a;
+			int min = node->min;
+			int max = node->max;
+			int greedy = node->greedy;
+			for (int i = 0; i < min; i++) {
+				if (!tuglib_re_gen(P, inner)) return 0;
+			}
+
+			if (max < 0) {
+				// L: split body, out; body; jmp L
+				int split = tuglib_re_emit(P, TUGLIB_RE_SPLIT, 0, 0);
+				if (split < 0 || !tuglib_re_gen(P, inner)) return 0;
+				if (tuglib_re_emit(P, TUGLIB_RE_JMP, split, 0) < 0) return 0;
+				int body = split + 1;
+				int out = (int)re->count;
+				re->code[split].x = greedy ? body : out;
+				re->code[split].y = greedy ? out : body;
+			} else {
+				// each optional copy may be skipped straight to the end
+				int splits[1001];
+				int n = 0;
+				for (int i = min; i < max; i++) {
+					int split = tuglib_re_emit(P, TUGLIB_RE_SPLIT, 0, 0);
+					if (split < 0) return 0;
+					splits[n++] = split;
+					if (!tuglib_re_gen(P, inner)) return 0;
+				}
+				int out = (int)re->count;
+				for (int i = 0; i < n; i++) {
+					re->code[splits[i]].x = greedy ? splits[i] + 1 : out;
+					re->code[splits[i]].y = greedy ? out : splits[i] + 1;
+				}
+			}
+		} break;
+	}
+
+	return 1;
+}
+
+static void tuglib_re_free(tuglib_Re* re) {
+	for (size_t i = 0; i < re->state_count; i++) free(re->states[i].pcs);
+	free(re->states);
+	free(re->marks);
+	free(re->scratch);
+	free(re->prefix);
+	free(re->classes);
+	free(re->code);
+	free(re->src);
+	free(re);
+}
+
+static void tuglib_re_release(tuglib_Re* re) {
+	if (--re->refs == 0) tuglib_re_free(re);
+}
+
+static tuglib_Re* tuglib_re_compile(const char* pat, size_t len, const char** err) {
+	tuglib_Re* re = calloc(1, sizeof(tuglib_Re));
+	tuglib_ReParser P = {pat, pat + len, NULL, 0, 0, re, 0, 0, NULL};
+
+	int root = tuglib_re_alt(&P);
+	if (root >= 0 && P.ptr < P.end) P.err = "unbalanced ')' in pattern";
+
+	// the whole match is group 0
+	if (!P.err) {
+		tuglib_re_emit(&P, TUGLIB_RE_SAVE, 0, 0);
+		if (!P.err) tuglib_re_gen(&P, root);
+		if (!P.err) tuglib_re_emit(&P, TUGLIB_RE_SAVE, 1, 0);
+		if (!P.err) tuglib_re_emit(&P, TUGLIB_RE_MATCH, 0, 0);
+	}
+
+	if (P.err) {
+		*err = P.err;
+		free(P.nodes);
+		tuglib_re_free(re);
+		return NULL;
+	}
+
+	re->ncap = (size_t)(P.groups + 1) * 2;
+	re->refs = 1;
+	re->src = malloc(len + 1);
+	memcpy(re->src, pat, len);
+	re->src[len] = '\0';
+	re->src_len = len;
+
+	// flatten the left-leaning concatenation to find what every match starts with,
+	// a leading literal run lets the search skip ahead with memfind
+	int items[256];
+	size_t item_count = 0;
+	int cur = root;
+	while (P.nodes[cur].kind == TUGLIB_REN_CAT && item_count < 255) {
+		items[item_count++] = P.nodes[cur].b;
+		cur = P.nodes[cur].a;
+	}
+	items[item_count++] = cur;
+
+	re->anchored = P.nodes[items[item_count - 1]].kind == TUGLIB_REN_BOL;
+	size_t lit_len = 0;
+	while (lit_len < item_count && P.nodes[items[item_count - 1 - lit_len]].kind == TUGLIB_REN_CHAR) lit_len++;
+	if (lit_len > 0) {
+		re->prefix = malloc(lit_len);
+		for (size_t i = 0; i < lit_len; i++) re->prefix[i] = (char)P.nodes[items[item_count - 1 - i]].c;
+		re->prefix_len = lit_len;
+	}
+
+	re->dfa = 1;
+	for (size_t i = 0; i < re->count; i++) {
+		if (re->code[i].op == TUGLIB_RE_EOL) re->dfa = 0;
+	}
+	re->marks = calloc(re->count, sizeof(unsigned));
+	re->scratch = malloc(re->count * sizeof(int));
+	re->start0 = -1;
+	re->startn = -1;
+
+	free(P.nodes);
+	return re;
+}
+
+// epsilon closure for the DFA, captures don't matter there
+static void tuglib_re_dclosure(tuglib_Re* re, int pc, int at_start, size_t* count) {
+	if (re->marks[pc] == re->mark_gen) return;
+	re->marks[pc] = re->mark_gen;
+
+	tuglib_ReInst* inst = &re->code[pc];
+	switch (inst->op) {
+		case TUGLIB_RE_JMP: tuglib_re_dclosure(re, inst->x, at_start, count); break;
+		case TUGLIB_RE_SPLIT: {
+			tuglib_re_dclosure(re, inst->x, at_start, count);
+			tuglib_re_dclosure(re, inst->y, at_start, count);
+		} break;
+		case TUGLIB_RE_SAVE: tuglib_re_dclosure(re, pc + 1, at_start, count); break;
+		case TUGLIB_RE_BOL: if (at_start) tuglib_re_dclosure(re, pc + 1, at_start, count); break;
+		default: re->scratch[(*count)++] = pc;
+	}
+}
+
+// interns the pc set in `scratch`, -1 when the state limit is hit
+static int tuglib_re_dstate(tuglib_Re* re, size_t count) {
+	int* pcs = re->scratch;
+	for (size_t i = 1; i < count; i++) {
+		int pc = pcs[i];
+		size_t j = i;
+		while (j > 0 && pcs[j - 1] > pc) {
+			pcs[j] = pcs[j - 1];
+			j--;
+		}
+		pcs[j] = pc;
+	}
+
+	for (size_t i = 0; i < re->state_count; i++) {
+		tuglib_ReState* state = &re->states[i];
+		if (state->count == count && memcmp(state->pcs, pcs, count * sizeof(int)) == 0) return (int)i;
+	}
+	if (re->state_count == TUGLIB_RE_MAXSTATES) return -1;
+
+	if (!re->states) re->states = malloc(TUGLIB_RE_MAXSTATES * sizeof(tuglib_ReState));
+	tuglib_ReState* state = &re->states[re->state_count];
+	state->pcs = malloc((count ? count : 1) * sizeof(int));
+	memcpy(state->pcs, pcs, count * sizeof(int));
+	state->count = count;
+	state->accept = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (re->code[pcs[i]].op == TUGLIB_RE_MATCH) state->accept = 1;
+	}
+	for (int i = 0; i < 256; i++) state->next[i] = -1;
+
+	return (int)re->state_count++;
+}
+
+static int tuglib_re_dstep(tuglib_Re* re, int from, uint8_t c) {
+	tuglib_ReState* state = &re->states[from];
+	size_t count = 0;
+	re->mark_gen++;
+	for (size_t i = 0; i < state->count; i++) {
+		tuglib_ReInst* inst = &re->code[state->pcs[i]];
+		int pass = 0;
+		switch (inst->op) {
+			case TUGLIB_RE_CHAR: pass = inst->c == c; break;
+			case TUGLIB_RE_ANY: pass = 1; break;
+			case TUGLIB_RE_CLASS: pass = tuglib_re_hasbit(re->classes[inst->x], c) != 0; break;
+		}
+		if (pass) tuglib_re_dclosure(re, state->pcs[i] + 1, 0, &count);
+	}
+
+	// a match may also begin at the next position
+	if (!re->anchored) tuglib_re_dclosure(re, 0, 0, &count);
+	return tuglib_re_dstate(re, count);
+}
+
+// 1 when a match starts at or after `start`, 0 when none can, -1 when the DFA gave up
+static int tuglib_re_dscan(tuglib_Re* re, const char* str, size_t len, size_t start) {
+	if (re->start0 < 0) {
+		size_t count = 0;
+		re->mark_gen++;
+		tuglib_re_dclosure(re, 0, 1, &count);
+		re->start0 = tuglib_re_dstate(re, count);
+
+		count = 0;
+		re->mark_gen++;
+		tuglib_re_dclosure(re, 0, 0, &count);
+		re->startn = tuglib_re_dstate(re, count);
+		if (re->start0 < 0 || re->startn < 0) return -1;
+	}
+
+	int cur = start == 0 ? re->start0 : re->startn;
+	for (size_t i = start;; i++) {
+		tuglib_ReState* state = &re->states[cur];
+		if (state->accept) return 1;
+		if (state->count == 0 || i == len) return 0;
+
+		uint8_t c = (uint8_t)str[i];
+		int next = state->next[c];
+		if (next < 0) {
+			next = tuglib_re_dstep(re, cur, c);
+			if (next < 0) return -1;
+			re->states[cur].next[c] = (int16_t)next;
+		}
+		cur = next;
+	}
+}
+
+// per-search thread lists for the Pike VM, owned by the caller so searches can nest
+typedef struct {
+	size_t ncap;
+	int* pcs[2];
+	size_t* caps[2];
+	size_t count[2];
+	unsigned list_gen[2];
+	unsigned* marks;
+	unsigned gen;
+	unsigned gen_counter;
+	size_t* work;
+	size_t* out;
+} tuglib_ReVM;
+
+static void tuglib_revm_init(tuglib_ReVM* vm, tuglib_Re* re) {
+	vm->ncap = re->ncap;
+	for (int i = 0; i < 2; i++) {
+		vm->pcs[i] = malloc(re->count * sizeof(int));
+		vm->caps[i] = malloc(re->count * re->ncap * sizeof(size_t));
+		vm->count[i] = 0;
+		vm->list_gen[i] = 0;
+	}
+	vm->marks = calloc(re->count, sizeof(unsigned));
+	vm->gen = 0;
+	vm->gen_counter = 0;
+	vm->work = malloc(re->ncap * sizeof(size_t));
+	vm->out = malloc(re->ncap * sizeof(size_t));
+}
+
+static void tuglib_revm_free(tuglib_ReVM* vm) {
+	for (int i = 0; i < 2; i++) {
+		free(vm->pcs[i]);
+		free(vm->caps[i]);
+	}
+	free(vm->marks);
+	free(vm->work);
+	free(vm->out);
+}
+
+static void tuglib_revm_add(tuglib_Re* re, tuglib_ReVM* vm, int list, int pc, size_t* caps, size_t pos, size_t len) {
+	if (vm->marks[pc] == vm->gen) return;
+	vm->marks[pc] = vm->gen;
+
+	tuglib_ReInst* inst = &re->code[pc];
+	switch (inst->op) {
+		case TUGLIB_RE_JMP: tuglib_revm_add(re, vm, list, inst->x, caps, pos, len); break;
+		case TUGLIB_RE_SPLIT: {
+			tuglib_revm_add(re, vm, list, inst->x, caps, pos, len);
+			tuglib_revm_add(re, vm, list, inst->y, caps, pos, len);
+		} break;
+		case TUGLIB_RE_SAVE: {
+			size_t old = caps[inst->x];
+			caps[inst->x] = pos;
+			tuglib_revm_add(re, vm, list, pc + 1, caps, pos, len);
+			caps[inst->x] = old;
+		} break;
+		case TUGLIB_RE_BOL: if (pos == 0) tuglib_revm_add(re, vm, list, pc + 1, caps, pos, len); break;
+		case TUGLIB_RE_EOL: if (pos == len) tuglib_revm_add(re, vm, list, pc + 1, caps, pos, len); break;
+		default: {
+			size_t idx = vm->count[list]++;
+			vm->pcs[list][idx] = pc;
+			memcpy(vm->caps[list] + idx * vm->ncap, caps, vm->ncap * sizeof(size_t));
+		}
+	}
+}
+
+// leftmost-first search from `start`, the capture offsets land in `vm->out`
+// with SIZE_MAX for groups that didn't take part
+static int tuglib_re_exec(tuglib_Re* re, tuglib_ReVM* vm, const char* str, size_t len, size_t start) {
+	if (start > len) return 0;
+	if (re->anchored && start > 0) return 0;
+	if (re->dfa) {
+		int found = tuglib_re_dscan(re, str, len, start);
+		if (found == 0) return 0;
+		if (found < 0) re->dfa = 0;
+	}
+
+	for (size_t i = 0; i < vm->ncap; i++) vm->work[i] = SIZE_MAX;
+	int matched = 0;
+	int cur = 0;
+	vm->count[cur] = 0;
+	vm->list_gen[cur] = ++vm->gen_counter;
+
+	for (size_t pos = start;; pos++) {
+		if (!matched && (!re->anchored || pos == 0)) {
+			if (vm->count[cur] == 0 && re->prefix_len > 0) {
+				// nothing in flight, skip to where the literal prefix occurs next
+				const char* found = tuglib_memfind(str + pos, len - pos, re->prefix, re->prefix_len);
+				if (!found) break;
+				pos = (size_t)(found - str);
+			}
+			vm->gen = vm->list_gen[cur];
+			tuglib_revm_add(re, vm, cur, 0, vm->work, pos, len);
+		}
+		if (vm->count[cur] == 0) break;
+
+		int next = 1 - cur;
+		vm->count[next] = 0;
+		vm->gen = vm->list_gen[next] = ++vm->gen_counter;
+		for (size_t i = 0; i < vm->count[cur]; i++) {
+			tuglib_ReInst* inst = &re->code[vm->pcs[cur][i]];
+			size_t* caps = vm->caps[cur] + i * vm->ncap;
+			int pass = 0;
+			switch (inst->op) {
+				case TUGLIB_RE_MATCH: {
+					matched = 1;
+					memcpy(vm->out, caps, vm->ncap * sizeof(size_t));
+					// lower priority threads lose to this match
+					i = vm->count[cur];
+				} continue;
+				case TUGLIB_RE_CHAR: pass = pos < len && (uint8_t)str[pos] == inst->c; break;
+				case TUGLIB_RE_ANY: pass = pos < len; break;
+				case TUGLIB_RE_CLASS: pass = pos < len && tuglib_re_hasbit(re->classes[inst->x], str[pos]); break;
+			}
+			if (pass) tuglib_revm_add(re, vm, next, vm->pcs[cur][i] + 1, caps, pos + 1, len);
+		}
+
+		cur = next;
+		if (pos >= len) {
+			// threads that reached MATCH on the last step still need a look
+			for (size_t i = 0; i < vm->count[cur]; i++) {
+				if (re->code[vm->pcs[cur][i]].op == TUGLIB_RE_MATCH) {
+					matched = 1;
+					memcpy(vm->out, vm->caps[cur] + i * vm->ncap, vm->ncap * sizeof(size_t));
+					break;
+				}
+			}
+			break;
+		}
+	}
+
+	return matched;
+}
+
+// compiled patterns, the least recently used one is dropped when the cache is full
+static tuglib_Re* tuglib_re_cache[TUGLIB_RE_CACHE];
+static unsigned long tuglib_re_tick = 0;
+
+// the caller owns a reference to the result
+static tuglib_Re* tuglib_re_get(tug_Task* T, const char* pat, size_t len) {
+	uint64_t hash = tuglib_hashbytes(pat, len);
+	size_t victim = 0;
+	for (size_t i = 0; i < TUGLIB_RE_CACHE; i++) {
+		tuglib_Re* re = tuglib_re_cache[i];
+		if (!re) {
+			if (tuglib_re_cache[victim]) victim = i;
+			continue;
+		}
+		if (re->hash == hash && re->src_len == len && memcmp(re->src, pat, len) == 0) {
+			re->tick = ++tuglib_re_tick;
+			re->refs++;
+			return re;
+		}
+		if (tuglib_re_cache[victim] && re->tick < tuglib_re_cache[victim]->tick) victim = i;
+	}
+
+	const char* err = NULL;
+	tuglib_Re* re = tuglib_re_compile(pat, len, &err);
+	if (!re) tug_err(T, "%s", err);
+
+	if (tuglib_re_cache[victim]) tuglib_re_release(tuglib_re_cache[victim]);
+	tuglib_re_cache[victim] = re;
+	re->hash = hash;
+	re->tick = ++tuglib_re_tick;
+	re->refs++;
+	return re;
+}
+
+// capture `idx` of the last match, the whole match for 0
+static tug_Object* tuglib_re_capture(tuglib_ReVM* vm, tug_Object* subject, size_t idx) {
+	size_t start = vm->out[idx * 2];
+	size_t end = vm->out[idx * 2 + 1];
+	if (start == SIZE_MAX || end == SIZE_MAX) return tug_nil;
+
+	return tug_strview(subject, start, end - start);
+}
+
+// the groups of the last match, or the whole match when there are none
+static tug_Object* tuglib_re_captures(tuglib_ReVM* vm, tug_Object* subject, tug_Object* tuple) {
+	size_t groups = vm->ncap / 2 - 1;
+	if (groups == 0) {
+		if (!tuple) return tuglib_re_capture(vm, subject, 0);
+		tug_tuplepush(tuple, tuglib_re_capture(vm, subject, 0));
+		return tuple;
+	}
+
+	if (!tuple) {
+		if (groups == 1) return tuglib_re_capture(vm, subject, 1);
+		tuple = tug_tuple();
+	}
+	for (size_t i = 1; i <= groups; i++) tug_tuplepush(tuple, tuglib_re_capture(vm, subject, i));
+	return tuple;
+}
+
+static void __tuglib_str_match(tug_Task* T) {
+	size_t len, pat_len;
+	const char* str = tuglib_checklstr(T, 0, &len);
+	const char* pat = tuglib_checklstr(T, 1, &pat_len);
+	long init = tuglib_optlong(T, 2, 0);
+	if (init < 0) init = 0;
+
+	tuglib_Re* re = tuglib_re_get(T, pat, pat_len);
+	tuglib_ReVM vm;
+	tuglib_revm_init(&vm, re);
+
+	if (tuglib_re_exec(re, &vm, str, len, (size_t)init)) {
+		tug_ret(T, tuglib_re_captures(&vm, tug_getarg(T, 0), NULL));
+	}
+
+	tuglib_revm_free(&vm);
+	tuglib_re_release(re);
+}
+
+typedef struct {
+	tuglib_Re* re;
+	tuglib_ReVM vm;
+	size_t pos;
+	size_t last_end;
+	int done;
+} tuglib_GMatch;
+
+static void tuglib_gmatch_free(tug_Object* iter) {
+	tuglib_GMatch* state = tug_getuserdata(iter);
+	if (!state) return;
+
+	tuglib_revm_free(&state->vm);
+	tuglib_re_release(state->re);
+	free(state);
+}
+
+static void __tuglib_gmatch_next(tug_Task* T) {
+	tug_Object* iter = tuglib_checktable(T, 0);
+	if (tug_getdeallocator(iter) != tuglib_gmatch_free) return;
+	tuglib_GMatch* state = tug_getuserdata(iter);
+	if (!state || state->done) return;
+
+	tug_Object* subject = tug_getuservalue(iter);
+
+	size_t len;
+	const char* str = tug_getlstr(subject, &len);
+	while (tuglib_re_exec(state->re, &state->vm, str, len, state->pos)) {
+		size_t start = state->vm.out[0];
+		size_t end = state->vm.out[1];
+		if (start == end && end == state->last_end) {
+			// an empty match right where the previous one ended doesn't count
+			state->pos = start + 1;
+			if (state->pos > len) break;
+			continue;
+		}
+
+		state->pos = start == end ? end + 1 : end;
+		state->last_end = end;
+		tug_Object* res = tug_tuple();
+		tug_tuplepush(res, tug_true);
+		tug_ret(T, tuglib_re_captures(&state->vm, subject, res));
+		return;
+	}
+
+	state->done = 1;
+}
+
+static void __tuglib_str_gmatch(tug_Task* T) {
+	size_t pat_len;
+	tuglib_checkstr(T, 0);
+	const char* pat = tuglib_checklstr(T, 1, &pat_len);
+
+	tuglib_GMatch* state = malloc(sizeof(tuglib_GMatch));
+	state->re = tuglib_re_get(T, pat, pat_len);
+	tuglib_revm_init(&state->vm, state->re);
+	state->pos = 0;
+	state->last_end = SIZE_MAX;
+	state->done = 0;
+
+	tug_Object* iter = tug_table();
+	tug_setuservalue(iter, tug_getarg(T, 0));
+	tug_setuserdata(iter, state);
+	tug_setdeallocator(iter, tuglib_gmatch_free);
+
+	tug_Object* meta = tug_table();
+	tug_setfield(meta, tug_conststr("__next"), tug_cfunc("__next", __tuglib_gmatch_next));
+	tug_setmetatable(iter, meta);
+
+	tug_ret(T, iter);
+}
+
+// appends the replacement for the current match, 0 after an error was raised in a callback
+static int tuglib_gsub_repl(tug_Task* T, tug_Object* buf, tug_Object* repl, tuglib_ReVM* vm, tug_Object* subject, const char** err) {
+	size_t len;
+	const char* str = tug_getlstr(subject, &len);
+	size_t start = vm->out[0];
+	size_t end = vm->out[1];
+	tug_Object* value;
+
+	switch (tug_gettype(repl)) {
+		case TUG_STR: {
+			size_t repl_len;
+			const char* text = tug_getlstr(repl, &repl_len);
+			size_t groups = vm->ncap / 2 - 1;
+			for (size_t i = 0; i < repl_len; i++) {
+				if (text[i] != '%' || i + 1 >= repl_len) {
+					tug_bufappend(buf, text + i, 1);
+					continue;
+				}
+
+				char c = text[++i];
+				if (c == '%') tug_bufappend(buf, "%", 1);
+				else if (isdigit((unsigned char)c) && (size_t)(c - '0') <= groups) {
+					size_t idx = (size_t)(c - '0');
+					size_t cap_start = vm->out[idx * 2];
+					size_t cap_end = vm->out[idx * 2 + 1];
+					if (cap_start != SIZE_MAX && cap_end != SIZE_MAX) tug_bufappend(buf, str + cap_start, cap_end - cap_start);
+				} else {
+					*err = "invalid capture reference in replacement";
+					return 0;
+				}
+			}
+			return 1;
+		}
+		case TUG_TABLE: {
+			value = tug_getfield(repl, vm->ncap > 2 ? tuglib_re_capture(vm, subject, 1) : tuglib_re_capture(vm, subject, 0));
+		} break;
+		case TUG_FUNC: {
+			// the captures go on the stack as arguments, which roots them for the call,
+			// and a callback returning several values counts with its last one
+			size_t groups = vm->ncap / 2 - 1;
+			size_t argc = groups ? groups : 1;
+			tug_Object** args = malloc(argc * sizeof(tug_Object*));
+			for (size_t i = 0; i < argc; i++) args[i] = tuglib_re_capture(vm, subject, groups ? i + 1 : 0);
+			value = tug_callv(T, repl, argc, args);
+			free(args);
+			if (tuglib_iserr(T)) return 0;
+		} break;
+		default: {
+			*err = "replacement must be 'str', 'table' or 'func'";
+			return 0;
+		}
+	}
+
+	char scratch[TUGLIB_NUMBUF];
+	const char* part;
+	size_t part_len;
+	if (value == tug_nil || value == tug_false) tug_bufappend(buf, str + start, end - start);
+	else if (tuglib_strpart(value, scratch, &part, &part_len)) tug_bufappend(buf, part, part_len);
+	else {
+		*err = "replacement value must be 'str' or 'num'";
+		return 0;
+	}
+
+	return 1;
+}
+
+// str.gsub(s, pattern, repl, n?) returns the new string and the number of replacements
+static void __tuglib_str_gsub(tug_Task* T) {
+	size_t len, pat_len;
+	const char* str = tuglib_checklstr(T, 0, &len);
+	const char* pat = tuglib_checklstr(T, 1, &pat_len);
+	tug_Object* repl = tuglib_checkany(T, 2);
+	long max = tuglib_optlong(T, 3, -1);
+	tug_Object* subject = tug_getarg(T, 0);
+
+	tuglib_Re* re = tuglib_re_get(T, pat, pat_len);
+	tuglib_ReVM vm;
+	tuglib_revm_init(&vm, re);
+
+	// a function replacement runs scripts, which may collect
+	tug_Object* keep = tuglib_keep(T);
+	tug_Object* buf = tug_buffer(len);
+	tug_listpush(keep, buf);
+	size_t pos = 0;
+	size_t copied = 0;
+	size_t last_end = SIZE_MAX;
+	size_t count = 0;
+	const char* err = NULL;
+	int ok = 1;
+	while ((max < 0 || count < (size_t)max) && tuglib_re_exec(re, &vm, str, len, pos)) {
+		size_t start = vm.out[0];
+		size_t end = vm.out[1];
+		if (start == end && end == last_end) {
+			pos = start + 1;
+			if (pos > len) break;
+			continue;
+		}
+
+		tug_bufappend(buf, str + copied, start - copied);
+		if (!(ok = tuglib_gsub_repl(T, buf, repl, &vm, subject, &err))) break;
+		// the callback may have run other searches, `str` stays valid since `subject` is an argument
+		str = tug_getlstr(subject, &len);
+
+		count++;
+		copied = end;
+		last_end = end;
+		pos = start == end ? end + 1 : end;
+		if (pos > len) break;
+	}
+
+	tuglib_revm_free(&vm);
+	tuglib_re_release(re);
+	if (!ok) {
+		if (err) tug_err(T, "%s", err);
+		return;
+	}
+
+	if (copied < len) tug_bufappend(buf, str + copied, len - copied);
+	tug_rets(T, 2, tug_buftostr(buf), tug_num((double)count));
+}
+
+// counts code points from `*pos` until `limit` of them were seen or the string ends,
+// ASCII runs are skipped in bulk; 0 with `*pos` at the bad byte on malformed input
+static int tuglib_utf8scan(const char* str, size_t len, size_t* pos, size_t* count, size_t limit) {
+	while (*pos < len && *count < limit) {
+		if ((unsigned char)str[*pos] < 0x80) {
+			size_t room = len - *pos;
+			if (limit - *count < room) room = limit - *count;
+			size_t run = tuglib_asciirun(str + *pos, room);
+			*pos += run;
+			*count += run;
+			continue;
+		}
+
+		uint32_t cp;
+		size_t n = tug_utf8decode(str + *pos, len - *pos, &cp);
+		if (n == 0) return 0;
+		*pos += n;
+		(*count)++;
+	}
+
+	return 1;
+}
+
+static size_t tuglib_utf8encode(uint32_t cp, char* out) {
+	if (cp < 0x80) {
+		out[0] = (char)cp;
+		return 1;
+	}
+	if (cp < 0x800) {
+		out[0] = (char)(0xC0 | (cp >> 6));
+		out[1] = (char)(0x80 | (cp & 0x3F));
+		return 2;
+	}
+	if (cp < 0x10000) {
+		out[0] = (char)(0xE0 | (cp >> 12));
+		out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+		out[2] = (char)(0x80 | (cp & 0x3F));
+		return 3;
+	}
+	out[0] = (char)(0xF0 | (cp >> 18));
+	out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+	out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+	out[3] = (char)(0x80 | (cp & 0x3F));
+	return 4;
+}
+
+// utf8.len(s) returns the number of code points, or nil and the offset of the first bad byte
+static void __tuglib_utf8_len(tug_Task* T) {
+	size_t len;
+	const char* str = tuglib_checklstr(T, 0, &len);
+
+	size_t pos = 0;
+	size_t count = 0;
+	if (!tuglib_utf8scan(str, len, &pos, &count, SIZE_MAX)) tug_rets(T, 2, tug_nil, tug_num((double)pos));
+	else tug_ret(T, tug_num((double)count));
+}
+
+static void __tuglib_utf8_valid(tug_Task* T) {
+	size_t len;
+	const char* str = tuglib_checklstr(T, 0, &len);
+
+	size_t pos = 0;
+	size_t count = 0;
+	tug_ret(T, tuglib_utf8scan(str, len, &pos, &count, SIZE_MAX) ? tug_true : tug_false);
+}
+
+// utf8.offset(s, n) returns the byte offset of the n-th code point, the length for one past the last
+static void __tuglib_utf8_offset(tug_Task* T) {
+	size_t len;
+	const char* str = tuglib_checklstr(T, 0, &len);
+	long n = tuglib_checklong(T, 1);
+	if (n < 0) return;
+
+	size_t pos = 0;
+	size_t count = 0;
+	if (!tuglib_utf8scan(str, len, &pos, &count, (size_t)n)) tug_err(T, "invalid UTF-8 code at byte %zu", pos);
+	if (count == (size_t)n) tug_ret(T, tug_num((double)pos));
+}
+
+static void __tuglib_utf8_codepoint(tug_Task* T) {
+	size_t len;
+	const char* str = tuglib_checklstr(T, 0, &len);
+	long pos = tuglib_optlong(T, 1, 0);
+	if (pos < 0 || (size_t)pos >= len) tug_err(T, "position %ld out of bounds", pos);
+
+	uint32_t cp;
+	if (!tug_utf8decode(str + pos, len - (size_t)pos, &cp)) tug_err(T, "invalid UTF-8 code at byte %ld", pos);
+	tug_ret(T, tug_num((double)cp));
+}
+
+static void __tuglib_utf8_char(tug_Task* T) {
+	size_t argc = tug_getargc(T);
+	char* res = malloc(argc * 4 + 1);
+	size_t len = 0;
+	for (size_t i = 0; i < argc; i++) {
+		double cp = tug_getnum(tuglib_checktype(T, i, TUG_NUM));
+		if (cp < 0 || cp > 0x10FFFF || floor(cp) != cp || (cp >= 0xD800 && cp <= 0xDFFF)) {
+			free(res);
+			tug_err(T, "argument #%zu is not a valid code point", i + 1);
+		}
+		len += tuglib_utf8encode((uint32_t)cp, res + len);
+	}
+	res[len] = '\0';
+
+	tug_ret(T, tug_lstr(res, len));
+}
+
+// `for cp, pos in utf8.codes(s)` is stepped by the VM itself
+static void __tuglib_utf8_codes(tug_Task* T) {
+	tuglib_checkstr(T, 0);
+	tug_ret(T, tug_utf8codes(tug_getarg(T, 0)));
+}
+
+static void __tuglib_push(tug_Task* T) {
+	tug_Object* list = tuglib_checklist(T, 0);
+	tuglib_checkmutable(T, 0);
+	tug_Object* obj = tuglib_checkany(T, 1);
+
+	tug_listpush(list, obj);
+}
+
+static void __tuglib_pop(tug_Task* T) {
+	tug_Object* list = tuglib_checklist(T, 0);
+	tuglib_checkmutable(T, 0);
+	size_t len = tug_getlen(list);
+	long idx = tuglib_optlong(T, 1, len - 1);
+	if (idx < 0 || idx >= len) tug_err(T, "pop index out of range");
+
+	tug_Object* pop = tug_listpop(list, idx);
+	tug_ret(T, pop);
+}
+
+static void __tuglib_pushfront(tug_Task* T) {
+	tug_Object* list = tuglib_checklist(T, 0);
+	tuglib_checkmutable(T, 0);
+	tug_Object* obj = tuglib_checkany(T, 1);
+
+	tug_listinsert(list, 0, obj);
+}
+
+static void __tuglib_popfront(tug_Task* T) {
+	tug_Object* list = tuglib_checklist(T, 0);
+	tuglib_checkmutable(T, 0);
+	if (tug_getlen(list) == 0) tug_err(T, "pop index out of range");
+
+	tug_ret(T, tug_listpop(list, 0));
+}
+
+static void __tuglib_insert(tug_Task* T) {
+	tug_Object* list = tuglib_checklist(T, 0);
+	tuglib_checkmutable(T, 0);
+	long idx = tuglib_checklong(T, 1);
+	if (idx < 0 || idx >= tug_getlen(list)) tug_err(T, "pop index out of range");
+	tug_Object* obj = tuglib_checkany(T, 2);
+
+	tug_listinsert(list, idx, obj);
+}
+
+static void __tuglib_clear(tug_Task* T) {
+	tug_Object* list = tuglib_checklist(T, 0);
+	tuglib_checkmutable(T, 0);
+	tug_listclear(list);
+}
+
+// pattern-defeating quicksort, generated once per element type so the fast paths
+// compare inline; it only ever swaps, so the items stay a permutation even when a
+// comparator bails out half way, and every scan is bounds checked so a comparator
+// that isn't a strict order can't run off the ends
+#define TUGLIB_SORT_INSERTION 24
+#define TUGLIB_SORT_NINTHER 128
+
+#define TUGLIB_SORT_SWAP(T, v, i, j) do { T __t = (v)[i]; (v)[i] = (v)[j]; (v)[j] = __t; } while (0)
+
+#define TUGLIB_PDQSORT(NAME, T, LESS) \
+static void NAME##_insertion(tuglib_Sort* s, T* v, size_t lo, size_t hi) { \
+	for (size_t i = lo + 1; i < hi; i++) { \
+		for (size_t j = i; j > lo && LESS(s, v[j], v[j - 1]); j--) TUGLIB_SORT_SWAP(T, v, j, j - 1); \
+	} \
+} \
+\
+/* gives up once more than a handful of items had to move */ \
+static int NAME##_partial(tuglib_Sort* s, T* v, size_t lo, size_t hi) { \
+	size_t moved = 0; \
+	for (size_t i = lo + 1; i < hi; i++) { \
+		size_t j = i; \
+		for (; j > lo && LESS(s, v[j], v[j - 1]); j--) TUGLIB_SORT_SWAP(T, v, j, j - 1); \
+		moved += i - j; \
+		if (moved > 8) return 0; \
+	} \
+	return 1; \
+} \
+\
+static void NAME##_heapsort(tuglib_Sort* s, T* v, size_t lo, size_t hi) { \
+	size_t n = hi - lo; \
+	v += lo; \
+	for (size_t end = n, i = n / 2; end > 1;) { \
+		if (i > 0) i--; \
+		else { \
+			end--; \
+			TUGLIB_SORT_SWAP(T, v, 0, end); \
+		} \
+		for (size_t root = i, child; (child = root * 2 + 1) < end; root = child) { \
+			if (child + 1 < end && LESS(s, v[child], v[child + 1])) child++; \
+			if (!LESS(s, v[root], v[child])) break; \
+			TUGLIB_SORT_SWAP(T, v, root, child); \
+		} \
+	} \
+} \
+\
+static void NAME##_sort2(tuglib_Sort* s, T* v, size_t a, size_t b) { \
+	if (LESS(s, v[b], v[a])) TUGLIB_SORT_SWAP(T, v, a, b); \
+} \
+\
+static void NAME##_sort3(tuglib_Sort* s, T* v, size_t a, size_t b, size_t c) { \
+	NAME##_sort2(s, v, a, b); \
+	NAME##_sort2(s, v, b, c); \
+	NAME##_sort2(s, v, a, b); \
+} \
+\
+/* the pivot sits at `lo`, smaller items end up left of it */ \
+static size_t NAME##_partition(tuglib_Sort* s, T* v, size_t lo, size_t hi, int* partitioned) { \
+	size_t first = lo + 1, last = hi; \
+	while (first < last && LESS(s, v[first], v[lo])) first++; \
+	while (first < last && !LESS(s, v[last - 1], v[lo])) last--; \
+	*partitioned = first >= last; \
+	while (first < last) { \
+		TUGLIB_SORT_SWAP(T, v, first, last - 1); \
+		first++; \
+		last--; \
+		while (first < last && LESS(s, v[first], v[lo])) first++; \
+		while (first < last && !LESS(s, v[last - 1], v[lo])) last--; \
+	} \
+	TUGLIB_SORT_SWAP(T, v, lo, first - 1); \
+	return first - 1; \
+} \
+\
+/* same but items equal to the pivot go left, used when the pivot equals \
+   the item before the range so the whole run of equals is done at once */ \
+static size_t NAME##_partitionleft(tuglib_Sort* s, T* v, size_t lo, size_t hi) { \
+	size_t first = lo + 1, last = hi; \
+	while (first < last && LESS(s, v[lo], v[last - 1])) last--; \
+	while (first < last && !LESS(s, v[lo], v[first])) first++; \
+	while (first < last) { \
+		TUGLIB_SORT_SWAP(T, v, first, last - 1); \
+		first++; \
+		last--; \
+		while (first < last && LESS(s, v[lo], v[last - 1])) last--; \
+		while (first < last && !LESS(s, v[lo], v[first])) first++; \
+	} \
+	TUGLIB_SORT_SWAP(T, v, lo, first - 1); \
+	return first - 1; \
+} \
+\
+static void NAME##_loop(tuglib_Sort* s, T* v, size_t lo, size_t hi, int bad, int leftmost) { \
+	while (1) { \
+		size_t n = hi - lo; \
+		if (n < TUGLIB_SORT_INSERTION) { \
+			NAME##_insertion(s, v, lo, hi); \
+			return; \
+		} \
+\
+		size_t mid = lo + n / 2; \
+		if (n > TUGLIB_SORT_NINTHER) { \
+			NAME##_sort3(s, v, lo, mid, hi - 1); \
+			NAME##_sort3(s, v, lo + 1, mid - 1, hi - 2); \
+			NAME##_sort3(s, v, lo + 2, mid + 1, hi - 3); \
+			NAME##_sort3(s, v, mid - 1, mid, mid + 1); \
+			TUGLIB_SORT_SWAP(T, v, lo, mid); \
+		} else NAME##_sort3(s, v, mid, lo, hi - 1); \
+\
+		if (!leftmost && !LESS(s, v[lo - 1], v[lo])) { \
+			lo = NAME##_partitionleft(s, v, lo, hi) + 1; \
+			continue; \
+		} \
+\
+		int partitioned; \
+		size_t pos = NAME##_partition(s, v, lo, hi, &partitioned); \
+		size_t ls = pos - lo, rs = hi - pos - 1; \
+		if (ls < n / 8 || rs < n / 8) { \
+			if (--bad == 0) { \
+				NAME##_heapsort(s, v, lo, hi); \
+				return; \
+			} \
+			/* shuffle a few items around so the next pivots land elsewhere */ \
+			if (ls >= TUGLIB_SORT_INSERTION) { \
+				TUGLIB_SORT_SWAP(T, v, lo, lo + ls / 4); \
+				TUGLIB_SORT_SWAP(T, v, pos - 1, pos - ls / 4); \
+				if (ls > TUGLIB_SORT_NINTHER) { \
+					TUGLIB_SORT_SWAP(T, v, lo + 1, lo + ls / 4 + 1); \
+					TUGLIB_SORT_SWAP(T, v, pos - 2, pos - ls / 4 - 1); \
+				} \
+			} \
+			if (rs >= TUGLIB_SORT_INSERTION) { \
+				TUGLIB_SORT_SWAP(T, v, pos + 1, pos + 1 + rs / 4); \
+				TUGLIB_SORT_SWAP(T, v, hi - 1, hi - rs / 4); \
+				if (rs > TUGLIB_SORT_NINTHER) { \
+					TUGLIB_SORT_SWAP(T, v, pos + 2, pos + 2 + rs / 4); \
+					TUGLIB_SORT_SWAP(T, v, hi - 2, hi - rs / 4 - 1); \
+				} \
+			} \
+		} else if (partitioned && NAME##_partial(s, v, lo, pos) && NAME##_partial(s, v, pos + 1, hi)) { \
+			return; \
+		} \
+\
+		NAME##_loop(s, v, lo, pos, bad, leftmost); \
+		lo = pos + 1; \
+		leftmost = 0; \
+	} \
+} \
+\
+static void NAME(tuglib_Sort* s, T* v, size_t n) { \
+	int bad = 1; \
+	while (n >> bad) bad++; \
+	NAME##_loop(s, v, 0, n, bad, 1); \
+}
+
+typedef struct {
+	double num;
+	tug_Object* obj;
+} tuglib_NumItem;
+
+typedef struct {
+	const char* str;
+	size_t len;
+	tug_Object* obj;
+} tuglib_StrItem;
+
+typedef struct {
+	tug_Task* T;
+	tug_Object* list;
+	tug_Object* cmp;
+	tug_Object** items;
+	size_t len;
+	jmp_buf jmp;
+} tuglib_Sort;
+
+static inline int tuglib_strless(tuglib_StrItem a, tuglib_StrItem b) {
+	int res = memcmp(a.str, b.str, a.len < b.len ? a.len : b.len);
+	return res < 0 || (res == 0 && a.len < b.len);
+}
+
+// the comparator runs on a pushed window of the stack and the items are sorted
+// where they live, so everything it sees stays reachable; if it changes the
+// list's shape the sort stops instead of writing into stale storage
+static int tuglib_sortcall(tuglib_Sort* s, tug_Object* a, tug_Object* b) {
+	tug_Object* argv[2] = {a, b};
+	tug_Object* res = tug_callv(s->T, s->cmp, 2, argv);
+	if (tuglib_iserr(s->T)) longjmp(s->jmp, 1);
+	if (tug_getlen(s->list) != s->len || tug_listdata(s->list) != s->items) longjmp(s->jmp, 1);
+
+	return tug_istrue(res);
+}
+
+// the plain orderings ignore the sort state, they still evaluate it so every helper uses `s`
+#define TUGLIB_NUMLESS(s, a, b) ((void)(s), (a).num < (b).num)
+#define TUGLIB_STRLESS(s, a, b) ((void)(s), tuglib_strless((a), (b)))
+#define TUGLIB_CALLLESS(s, a, b) tuglib_sortcall((s), (a), (b))
+
+TUGLIB_PDQSORT(tuglib_numsort, tuglib_NumItem, TUGLIB_NUMLESS)
+TUGLIB_PDQSORT(tuglib_strsort, tuglib_StrItem, TUGLIB_STRLESS)
+TUGLIB_PDQSORT(tuglib_callsort, tug_Object*, TUGLIB_CALLLESS)
+
+// `list.sort(l, cmp?)` sorts in place, `cmp(a, b)` says whether `a` goes first;
+// without one a list of only numbers or only strings is compared in C
+static void __tuglib_sort(tug_Task* T) {
+	tug_Object* list = tuglib_checklist(T, 0);
+	tuglib_checkmutable(T, 0);
+	size_t len = tug_getlen(list);
+	tug_Object** items = tug_listdata(list);
+
+	if (tuglib_isany(T, 1) && !tuglib_isnil(T, 1)) {
+		tuglib_Sort s;
+		s.T = T;
+		s.list = list;
+		s.cmp = tug_getarg(T, 1);
+		s.items = items;
+		s.len = len;
+		// an error from the comparator is already set, otherwise the list was changed
+		if (setjmp(s.jmp) == 0) tuglib_callsort(&s, items, len);
+		else if (!tuglib_iserr(T)) tug_err(T, "list modified during sort");
+		return;
+	}
+	if (len < 2) return;
+
+	tug_Type type = tug_gettype(items[0]);
+	for (size_t i = 1; i < len; i++) {
+		tug_Type other = tug_gettype(items[i]);
+		if (other != type) tug_err(T, "unable to sort '%s' with '%s' without a comparator", tuglib_typename(type), tuglib_typename(other));
+	}
+
+	if (type == TUG_NUM) {
+		tuglib_NumItem* v = malloc(len * sizeof(tuglib_NumItem));
+		for (size_t i = 0; i < len; i++) {
+			v[i].num = tug_getnum(items[i]);
+			v[i].obj = items[i];
+		}
+		tuglib_numsort(NULL, v, len);
+		for (size_t i = 0; i < len; i++) items[i] = v[i].obj;
+		free(v);
+	} else if (type == TUG_STR) {
+		tuglib_StrItem* v = malloc(len * sizeof(tuglib_StrItem));
+		for (size_t i = 0; i < len; i++) {
+			v[i].str = tug_getlstr(items[i], &v[i].len);
+			v[i].obj = items[i];
+		}
+		tuglib_strsort(NULL, v, len);
+		for (size_t i = 0; i < len; i++) items[i] = v[i].obj;
+		free(v);
+	} else {
+		tug_err(T, "unable to sort '%s' without a comparator", tuglib_typename(type));
+	}
+}
+
+// `list.slice(l, start?, end?)` shares the items with `l` until either list is written to
+static void __tuglib_list_slice(tug_Task* T) {
+	tug_Object* list = tuglib_checklist(T, 0);
+	size_t len = tug_getlen(list);
+	long start = tuglib_optlong(T, 1, 0);
+	start = start < 0 ? 0 : start;
+	long end = tuglib_optlong(T, 2, len);
+	end = end < 0 ? 0 : end;
+
+	tug_ret(T, tug_listslice(list, (size_t)start, (size_t)end));
+}
+
+static void __tuglib_unpack(tug_Task* T) {
+	tug_Object* list = tuglib_checklist(T, 0);
+	size_t len = tug_getlen(list);
+	tug_Object* tuple = tug_tuple();
+	for (size_t i = 0; i < len; i++) {
+		tug_tuplepush(tuple, tug_listget(list, i));
+	}
+
+	tug_ret(T, tuple);
+}
+
+static void __tuglib_map_new(tug_Task* T) {
+	tug_Object* res = tug_map();
+	if (tuglib_isany(T, 0)) {
+		tug_Object* table = tuglib_checktable(T, 0);
+		tug_Cursor cursor = TUG_CURSOR_INIT;
+		tug_Object* key;
+		tug_Object* value;
+		while (tug_next(table, &cursor, &key, &value)) {
+			res = tug_mapassoc(res, key, value);
+		}
+	}
+
+	tug_ret(T, res);
+}
+
+static void __tuglib_map_assoc(tug_Task* T) {
+	tug_Object* map = tuglib_checkmap(T, 0);
+	tug_Object* key = tuglib_checkany(T, 1);
+	tug_Object* value = tuglib_checkany(T, 2);
+	if (key == tug_nil) tug_err(T, "map key can't be nil");
+
+	tug_ret(T, tug_mapassoc(map, key, value));
+}
+
+static void __tuglib_map_dissoc(tug_Task* T) {
+	tug_Object* map = tuglib_checkmap(T, 0);
+	tug_Object* key = tuglib_checkany(T, 1);
+
+	tug_ret(T, tug_mapdissoc(map, key));
+}
+
+static void __tuglib_map_get(tug_Task* T) {
+	tug_Object* map = tuglib_checkmap(T, 0);
+	tug_Object* key = tuglib_checkany(T, 1);
+	tug_Object* def = tuglib_optany(T, 2, tug_nil);
+
+	tug_Object* value = tug_mapget(map, key);
+	tug_ret(T, value == tug_nil ? def : value);
+}
+
+static void __tuglib_map_has(tug_Task* T) {
+	tug_Object* map = tuglib_checkmap(T, 0);
+	tug_Object* key = tuglib_checkany(T, 1);
+
+	tug_ret(T, tug_mapget(map, key) != tug_nil ? tug_true : tug_false);
+}
+
+// formats one printf conversion; `out` is only written when the result fits in `size`
+static int tuglib_fmtone(char* out, size_t size, const char* spec, char conv, double num, const char* str) {
+	switch (conv) {
+		case 'c': return snprintf(out, size, spec, (int)(unsigned char)num);
+		case 'd': case 'x': case 'X': case 'o': return snprintf(out, size, spec, (long long)num);
+		case 's': return snprintf(out, size, spec, str);
+		default: return snprintf(out, size, spec, num);
+	}
+}
+
+// appends `fmt` to `buf`, taking printf-style values from the arguments starting at `argi`
+static void tuglib_appendf(tug_Task* T, tug_Object* buf, const char* fmt, size_t fmt_len, size_t argi) {
+	const char* end = fmt + fmt_len;
+	while (fmt < end) {
+		const char* pct = memchr(fmt, '%', (size_t)(end - fmt));
+		if (!pct) pct = end;
+		tug_bufappend(buf, fmt, (size_t)(pct - fmt));
+		if (pct == end) break;
+
+		// %[flags][width][.prec]conv
+		char spec[32];
+		size_t spec_len = 0;
+		const char* ptr = pct + 1;
+		spec[spec_len++] = '%';
+		while (ptr < end && strchr("-+ #0", *ptr) && spec_len < 8) spec[spec_len++] = *ptr++;
+		while (ptr < end && isdigit((unsigned char)*ptr) && spec_len < 16) spec[spec_len++] = *ptr++;
+		if (ptr < end && *ptr == '.') {
+			spec[spec_len++] = *ptr++;
+			while (ptr < end && isdigit((unsigned char)*ptr) && spec_len < 24) spec[spec_len++] = *ptr++;
+		}
+		if (ptr >= end) tug_err(T, "incomplete format specifier at end of format");
+
+		char conv = *ptr++;
+		fmt = ptr;
+		if (conv == '%') {
+			tug_bufappend(buf, "%", 1);
+			continue;
+		}
+		if (conv == 'i') conv = 'd';
+
+		double num = 0;
+		const char* str = NULL;
+		switch (conv) {
+			case 'd': case 'x': case 'X': case 'o': {
+				num = tuglib_checknum(T, argi);
+				spec[spec_len++] = 'l';
+				spec[spec_len++] = 'l';
+			} break;
+			case 'c': case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': {
+				num = tuglib_checknum(T, argi);
+			} break;
+			case 's': {
+				tug_Object* str_obj = tuglib_tostr(tuglib_checkany(T, argi));
+				if (spec_len == 1) {
+					size_t len;
+					str = tug_getlstr(str_obj, &len);
+					tug_bufappend(buf, str, len);
+					argi++;
+					continue;
+				}
+				str = tug_getstr(str_obj);
+			} break;
+			default: tug_err(T, "invalid format specifier '%%%c'", conv);
+		}
+		spec[spec_len++] = conv;
+		spec[spec_len] = '\0';
+
+		char tmp[128];
+		int n = tuglib_fmtone(tmp, sizeof(tmp), spec, conv, num, str);
+		if (n >= (int)sizeof(tmp)) {
+			char* big = malloc((size_t)n + 1);
+			tuglib_fmtone(big, (size_t)n + 1, spec, conv, num, str);
+			tug_bufappend(buf, big, (size_t)n);
+			free(big);
+		} else if (n > 0) tug_bufappend(buf, tmp, (size_t)n);
+		argi++;
+	}
+}
+
+// out of range values saturate and nan becomes 0, the same as storing into an i64array
+static int64_t tuglib_toi64(double num) {
+	if (num != num) return 0;
+	if (num >= 9223372036854775807.0) return INT64_MAX;
+	if (num <= -9223372036854775808.0) return INT64_MIN;
+	return (int64_t)num;
+}
+
+// the f64 reductions keep several partial sums so the adds don't wait on each
+// other, results can differ from a left-to-right sum in the last bits; min and
+// max of arrays holding nan are unspecified
+static double tuglib_f64sum_scalar(const double* x, size_t n) {
+	double a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		a0 += x[i];
+		a1 += x[i + 1];
+		a2 += x[i + 2];
+		a3 += x[i + 3];
+	}
+	for (; i < n; i++) a0 += x[i];
+
+	return (a0 + a1) + (a2 + a3);
+}
+
+static double tuglib_f64dot_scalar(const double* x, const double* y, size_t n) {
+	double a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		a0 += x[i] * y[i];
+		a1 += x[i + 1] * y[i + 1];
+		a2 += x[i + 2] * y[i + 2];
+		a3 += x[i + 3] * y[i + 3];
+	}
+	for (; i < n; i++) a0 += x[i] * y[i];
+
+	return (a0 + a1) + (a2 + a3);
+}
+
+// `n` must not be 0
+static void tuglib_f64minmax_scalar(const double* x, size_t n, double* lo, double* hi) {
+	double mn = x[0], mx = x[0];
+	for (size_t i = 1; i < n; i++) {
+		if (x[i] < mn) mn = x[i];
+		if (x[i] > mx) mx = x[i];
+	}
+	*lo = mn;
+	*hi = mx;
+}
+
+static void tuglib_f64scale_scalar(double* x, size_t n, double k) {
+	for (size_t i = 0; i < n; i++) x[i] *= k;
+}
+
+static void tuglib_f64add_scalar(double* x, const double* y, size_t n) {
+	for (size_t i = 0; i < n; i++) x[i] += y[i];
+}
+
+#ifdef TUGLIB_X86
+
+__attribute__((target("sse2")))
+static double tuglib_f64sum_sse2(const double* x, size_t n) {
+	__m128d a0 = _mm_setzero_pd(), a1 = _mm_setzero_pd();
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		a0 = _mm_add_pd(a0, _mm_loadu_pd(x + i));
+		a1 = _mm_add_pd(a1, _mm_loadu_pd(x + i + 2));
+	}
+	double lanes[2];
+	_mm_storeu_pd(lanes, _mm_add_pd(a0, a1));
+
+	return lanes[0] + lanes[1] + tuglib_f64sum_scalar(x + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static double tuglib_f64dot_sse2(const double* x, const double* y, size_t n) {
+	__m128d a0 = _mm_setzero_pd(), a1 = _mm_setzero_pd();
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		a0 = _mm_add_pd(a0, _mm_mul_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));
+		a1 = _mm_add_pd(a1, _mm_mul_pd(_mm_loadu_pd(x + i + 2), _mm_loadu_pd(y + i + 2)));
+	}
+	double lanes[2];
+	_mm_storeu_pd(lanes, _mm_add_pd(a0, a1));
+
+	return lanes[0] + lanes[1] + tuglib_f64dot_scalar(x + i, y + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void tuglib_f64minmax_sse2(const double* x, size_t n, double* lo, double* hi) {
+	if (n < 2) {
+		tuglib_f64minmax_scalar(x, n, lo, hi);
+		return;
+	}
+
+	__m128d mn = _mm_loadu_pd(x), mx = mn;
+	size_t i = 2;
+	for (; i + 2 <= n; i += 2) {
+		__m128d v = _mm_loadu_pd(x + i);
+		mn = _mm_min_pd(mn, v);
+		mx = _mm_max_pd(mx, v);
+	}
+	double l[2], h[2];
+	_mm_storeu_pd(l, mn);
+	_mm_storeu_pd(h, mx);
+	*lo = l[0] < l[1] ? l[0] : l[1];
+	*hi = h[0] > h[1] ? h[0] : h[1];
+	for (; i < n; i++) {
+		if (x[i] < *lo) *lo = x[i];
+		if (x[i] > *hi) *hi = x[i];
+	}
+}
+
+__attribute__((target("sse2")))
+static void tuglib_f64scale_sse2(double* x, size_t n, double k) {
+	__m128d kv = _mm_set1_pd(k);
+	size_t i = 0;
+	for (; i + 2 <= n; i += 2) _mm_storeu_pd(x + i, _mm_mul_pd(_mm_loadu_pd(x + i), kv));
+	tuglib_f64scale_scalar(x + i, n - i, k);
+}
+
+__attribute__((target("sse2")))
+static void tuglib_f64add_sse2(double* x, const double* y, size_t n) {
+	size_t i = 0;
+	for (; i + 2 <= n; i += 2) _mm_storeu_pd(x + i, _mm_add_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));
+	tuglib_f64add_scalar(x + i, y + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static double tuglib_f64sum_avx2(const double* x, size_t n) {
+	__m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+	__m256d a2 = _mm256_setzero_pd(), a3 = _mm256_setzero_pd();
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		a0 = _mm256_add_pd(a0, _mm256_loadu_pd(x + i));
+		a1 = _mm256_add_pd(a1, _mm256_loadu_pd(x + i + 4));
+		a2 = _mm256_add_pd(a2, _mm256_loadu_pd(x + i + 8));
+		a3 = _mm256_add_pd(a3, _mm256_loadu_pd(x + i + 12));
+	}
+	double lanes[4];
+	_mm256_storeu_pd(lanes, _mm256_add_pd(_mm256_add_pd(a0, a1), _mm256_add_pd(a2, a3)));
+
+	return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + tuglib_f64sum_sse2(x + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static double tuglib_f64dot_avx2(const double* x, const double* y, size_t n) {
+	__m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+	__m256d a2 = _mm256_setzero_pd(), a3 = _mm256_setzero_pd();
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		a0 = _mm256_add_pd(a0, _mm256_mul_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+		a1 = _mm256_add_pd(a1, _mm256_mul_pd(_mm256_loadu_pd(x + i + 4), _mm256_loadu_pd(y + i + 4)));
+		a2 = _mm256_add_pd(a2, _mm256_mul_pd(_mm256_loadu_pd(x + i + 8), _mm256_loadu_pd(y + i + 8)));
+		a3 = _mm256_add_pd(a3, _mm256_mul_pd(_mm256_loadu_pd(x + i + 12), _mm256_loadu_pd(y + i + 12)));
+	}
+	double lanes[4];
+	_mm256_storeu_pd(lanes, _mm256_add_pd(_mm256_add_pd(a0, a1), _mm256_add_pd(a2, a3)));
+
+	return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + tuglib_f64dot_sse2(x + i, y + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void tuglib_f64minmax_avx2(const double* x, size_t n, double* lo, double* hi) {
+	if (n < 8) {
+		tuglib_f64minmax_sse2(x, n, lo, hi);
+		return;
+	}
+
+	__m256d mn0 = _mm256_loadu_pd(x), mn1 = _mm256_loadu_pd(x + 4);
+	__m256d mx0 = mn0, mx1 = mn1;
+	size_t i = 8;
+	for (; i + 8 <= n; i += 8) {
+		__m256d v0 = _mm256_loadu_pd(x + i);
+		__m256d v1 = _mm256_loadu_pd(x + i + 4);
+		mn0 = _mm256_min_pd(mn0, v0);
+		mn1 = _mm256_min_pd(mn1, v1);
+		mx0 = _mm256_max_pd(mx0, v0);
+		mx1 = _mm256_max_pd(mx1, v1);
+	}
+	double l[4], h[4];
+	_mm256_storeu_pd(l, _mm256_min_pd(mn0, mn1));
+	_mm256_storeu_pd(h, _mm256_max_pd(mx0, mx1));
+	*lo = l[0];
+	*hi = h[0];
+	for (int j = 1; j < 4; j++) {
+		if (l[j] < *lo) *lo = l[j];
+		if (h[j] > *hi) *hi = h[j];
+	}
+	for (; i < n; i++) {
+		if (x[i] < *lo) *lo = x[i];
+		if (x[i] > *hi) *hi = x[i];
+	}
+}
+
+__attribute__((target("avx2")))
+static void tuglib_f64scale_avx2(double* x, size_t n, double k) {
+	__m256d kv = _mm256_set1_pd(k);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) _mm256_storeu_pd(x + i, _mm256_mul_pd(_mm256_loadu_pd(x + i), kv));
+	tuglib_f64scale_scalar(x + i, n - i, k);
+}
+
+__attribute__((target("avx2")))
+static void tuglib_f64add_avx2(double* x, const double* y, size_t n) {
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) _mm256_storeu_pd(x + i, _mm256_add_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+	tuglib_f64add_scalar(x + i, y + i, n - i);
+}
+
+#endif
+
+typedef struct {
+	double (*sum)(const double*, size_t);
+	double (*dot)(const double*, const double*, size_t);
+	void (*minmax)(const double*, size_t, double*, double*);
+	void (*scale)(double*, size_t, double);
+	void (*add)(double*, const double*, size_t);
+} tuglib_F64Ops;
+
+static tuglib_F64Ops tuglib_f64ops = {NULL};
+
+static void tuglib_pickf64ops(void) {
+	tuglib_f64ops = (tuglib_F64Ops){tuglib_f64sum_scalar, tuglib_f64dot_scalar, tuglib_f64minmax_scalar, tuglib_f64scale_scalar, tuglib_f64add_scalar};
+
+	#ifdef TUGLIB_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		tuglib_f64ops = (tuglib_F64Ops){tuglib_f64sum_avx2, tuglib_f64dot_avx2, tuglib_f64minmax_avx2, tuglib_f64scale_avx2, tuglib_f64add_avx2};
+	} else if (__builtin_cpu_supports("sse2")) {
+		tuglib_f64ops = (tuglib_F64Ops){tuglib_f64sum_sse2, tuglib_f64dot_sse2, tuglib_f64minmax_sse2, tuglib_f64scale_sse2, tuglib_f64add_sse2};
+	}
+	#endif
+}
+
+static const tuglib_F64Ops* tuglib_f64(void) {
+	if (!tuglib_f64ops.sum) tuglib_pickf64ops();
+	return &tuglib_f64ops;
+}
+
+// integer adds are exact in any order, so these plain loops are left to the
+// compiler's vectorizer; i64 arithmetic wraps like unsigned
+static int64_t tuglib_i64sum(const int64_t* x, size_t n) {
+	uint64_t sum = 0;
+	for (size_t i = 0; i < n; i++) sum += (uint64_t)x[i];
+	return (int64_t)sum;
+}
+
+static int64_t tuglib_i64dot(const int64_t* x, const int64_t* y, size_t n) {
+	uint64_t sum = 0;
+	for (size_t i = 0; i < n; i++) sum += (uint64_t)x[i] * (uint64_t)y[i];
+	return (int64_t)sum;
+}
+
+static void tuglib_i64minmax(const int64_t* x, size_t n, int64_t* lo, int64_t* hi) {
+	int64_t mn = x[0], mx = x[0];
+	for (size_t i = 1; i < n; i++) {
+		mn = x[i] < mn ? x[i] : mn;
+		mx = x[i] > mx ? x[i] : mx;
+	}
+	*lo = mn;
+	*hi = mx;
+}
+
+// lsd radix sort on keys whose unsigned order is the value order, a byte
+// position every key agrees on is skipped
+static void tuglib_radixsort(uint64_t* keys, size_t n) {
+	if (n < 64) {
+		for (size_t i = 1; i < n; i++) {
+			uint64_t key = keys[i];
+			size_t j = i;
+			for (; j > 0 && keys[j - 1] > key; j--) keys[j] = keys[j - 1];
+			keys[j] = key;
+		}
+		return;
+	}
+
+	uint64_t* tmp = malloc(n * sizeof(uint64_t));
+	size_t (*counts)[256] = calloc(8, sizeof(*counts));
+	for (size_t i = 0; i < n; i++) {
+		for (int b = 0; b < 8; b++) counts[b][(keys[i] >> (b * 8)) & 0xFF]++;
+	}
+
+	uint64_t* src = keys;
+	uint64_t* dst = tmp;
+	for (int b = 0; b < 8; b++) {
+		size_t* count = counts[b];
+		if (count[(src[0] >> (b * 8)) & 0xFF] == n) continue;
+
+		size_t pos = 0;
+		for (int d = 0; d < 256; d++) {
+			size_t c = count[d];
+			count[d] = pos;
+			pos += c;
+		}
+		for (size_t i = 0; i < n; i++) dst[count[(src[i] >> (b * 8)) & 0xFF]++] = src[i];
+
+		uint64_t* swap = src;
+		src = dst;
+		dst = swap;
+	}
+	if (src != keys) memcpy(keys, src, n * sizeof(uint64_t));
+
+	free(counts);
+	free(tmp);
+}
+
+// flipping the sign bit orders signed integers as unsigned, for doubles the
+// negative ones also get their other bits flipped
+static void tuglib_i64sort(int64_t* x, size_t n) {
+	uint64_t* keys = (uint64_t*)x;
+	for (size_t i = 0; i < n; i++) keys[i] ^= 0x8000000000000000ULL;
+	tuglib_radixsort(keys, n);
+	for (size_t i = 0; i < n; i++) keys[i] ^= 0x8000000000000000ULL;
+}
+
+static void tuglib_f64sort(double* x, size_t n) {
+	uint64_t* keys = (uint64_t*)x;
+	for (size_t i = 0; i < n; i++) {
+		uint64_t bits = keys[i];
+		keys[i] = bits >> 63 ? ~bits : bits | 0x8000000000000000ULL;
+	}
+	tuglib_radixsort(keys, n);
+	for (size_t i = 0; i < n; i++) {
+		uint64_t key = keys[i];
+		keys[i] = key >> 63 ? key & 0x7FFFFFFFFFFFFFFFULL : ~key;
+	}
+}
+
+// `src` is a length, a list of numbers or another array
+static tug_Object* tuglib_newarray(tug_Task* T, int f64) {
+	tug_Object* arr = f64 ? tug_f64array(0) : tug_i64array(0);
+	if (tuglib_isnone(T, 0)) return arr;
+
+	tug_Object* src = tug_getarg(T, 0);
+	tug_Type type = tug_gettype(src);
+	if (type == TUG_NUM) {
+		long len = tuglib_checklong(T, 0);
+		if (len < 0) tug_err(T, "array length can't be negative");
+		tug_arrayresize(arr, (size_t)len);
+	} else if (type == TUG_LIST) {
+		size_t len = tug_getlen(src);
+		tug_arrayresize(arr, len);
+		double* fdata = tug_f64data(arr);
+		int64_t* idata = tug_i64data(arr);
+		for (size_t i = 0; i < len; i++) {
+			tug_Object* item = tug_listget(src, i);
+			if (tug_gettype(item) != TUG_NUM) tug_err(T, "list item #%zu expected 'num', got '%s'", i + 1, tuglib_gettypename(item));
+			if (f64) fdata[i] = tug_getnum(item);
+			else idata[i] = tuglib_toi64(tug_getnum(item));
+		}
+	} else if (type == TUG_F64ARRAY || type == TUG_I64ARRAY) {
+		size_t len = tug_getlen(src);
+		tug_arrayresize(arr, len);
+		if ((type == TUG_F64ARRAY) == f64) memcpy(f64 ? (void*)tug_f64data(arr) : (void*)tug_i64data(arr), f64 ? (void*)tug_f64data(src) : (void*)tug_i64data(src), len * 8);
+		else if (f64) {
+			const int64_t* from = tug_i64data(src);
+			double* to = tug_f64data(arr);
+			for (size_t i = 0; i < len; i++) to[i] = (double)from[i];
+		} else {
+			const double* from = tug_f64data(src);
+			int64_t* to = tug_i64data(arr);
+			for (size_t i = 0; i < len; i++) to[i] = tuglib_toi64(from[i]);
+		}
+	} else tug_err(T, "argument #1 expected 'num', 'list' or an array, got '%s'", tuglib_typename(type));
+
+	return arr;
+}
+
+static void __tuglib_array_f64(tug_Task* T) {
+	tug_ret(T, tuglib_newarray(T, 1));
+}
+
+static void __tuglib_array_i64(tug_Task* T) {
+	tug_ret(T, tuglib_newarray(T, 0));
+}
+
+static void __tuglib_array_push(tug_Task* T) {
+	tug_Object* arr = tuglib_checkarray(T, 0);
+	tuglib_checkmutable(T, 0);
+	size_t argc = tug_getargc(T);
+	for (size_t i = 1; i < argc; i++) {
+		tug_arraypush(arr, tuglib_checknum(T, i));
+	}
+
+	tug_ret(T, arr);
+}
+
+static void __tuglib_array_sum(tug_Task* T) {
+	tug_Object* arr = tuglib_checkarray(T, 0);
+	size_t len = tug_getlen(arr);
+	double* fdata = tug_f64data(arr);
+	tug_ret(T, tug_num(fdata ? tuglib_f64()->sum(fdata, len) : (double)tuglib_i64sum(tug_i64data(arr), len)));
+}
+
+// gives both ends, nil for an empty array
+static void tuglib_arrayminmax(tug_Task* T, int max) {
+	tug_Object* arr = tuglib_checkarray(T, 0);
+	size_t len = tug_getlen(arr);
+	if (len == 0) {
+		tug_ret(T, tug_nil);
+		return;
+	}
+
+	double* fdata = tug_f64data(arr);
+	double lo, hi;
+	if (fdata) tuglib_f64()->minmax(fdata, len, &lo, &hi);
+	else {
+		int64_t ilo, ihi;
+		tuglib_i64minmax(tug_i64data(arr), len, &ilo, &ihi);
+		lo = (double)ilo;
+		hi = (double)ihi;
+	}
+	tug_ret(T, tug_num(max ? hi : lo));
+}
+
+static void __tuglib_array_min(tug_Task* T) {
+	tuglib_arrayminmax(T, 0);
+}
+
+static void __tuglib_array_max(tug_Task* T) {
+	tuglib_arrayminmax(T, 1);
+}
+
+// the second array has to be of the same kind and length as the first
+static tug_Object* tuglib_checkpeer(tug_Task* T, size_t idx, tug_Object* arr) {
+	tug_Object* other = tuglib_checktype(T, idx, tug_gettype(arr));
+	if (tug_getlen(other) != tug_getlen(arr)) {
+		tug_err(T, "argument #%zu has %zu elements, expected %zu", idx + 1, tug_getlen(other), tug_getlen(arr));
+	}
+
+	return other;
+}
+
+static void __tuglib_array_dot(tug_Task* T) {
+	tug_Object* arr = tuglib_checkarray(T, 0);
+	tug_Object* other = tuglib_checkpeer(T, 1, arr);
+	size_t len = tug_getlen(arr);
+	double* fdata = tug_f64data(arr);
+	if (fdata) tug_ret(T, tug_num(tuglib_f64()->dot(fdata, tug_f64data(other), len)));
+	else tug_ret(T, tug_num((double)tuglib_i64dot(tug_i64data(arr), tug_i64data(other), len)));
+}
+
+static void __tuglib_array_scale(tug_Task* T) {
+	tug_Object* arr = tuglib_checkarray(T, 0);
+	tuglib_checkmutable(T, 0);
+	double k = tuglib_checknum(T, 1);
+	size_t len = tug_getlen(arr);
+
+	double* fdata = tug_f64data(arr);
+	if (fdata) tuglib_f64()->scale(fdata, len, k);
+	else {
+		int64_t* idata = tug_i64data(arr);
+		if (floor(k) == k && fabs(k) < 9007199254740992.0) {
+			uint64_t ik = (uint64_t)(int64_t)k;
+			for (size_t i = 0; i < len; i++) idata[i] = (int64_t)((uint64_t)idata[i] * ik);
+		} else {
+			for (size_t i = 0; i < len; i++) idata[i] = tuglib_toi64((double)idata[i] * k);
+		}
+	}
+
+	tug_ret(T, arr);
+}
+
+// adds another array element by element, or the same number to every element
+static void __tuglib_array_add(tug_Task* T) {
+	tug_Object* arr = tuglib_checkarray(T, 0);
+	tuglib_checkmutable(T, 0);
+	size_t len = tug_getlen(arr);
+	double* fdata = tug_f64data(arr);
+	int64_t* idata = tug_i64data(arr);
+
+	if (tuglib_istype(T, 1, TUG_NUM) == 1) {
+		double k = tuglib_checknum(T, 1);
+		if (fdata) {
+			for (size_t i = 0; i < len; i++) fdata[i] += k;
+		} else {
+			uint64_t ik = (uint64_t)tuglib_toi64(k);
+			for (size_t i = 0; i < len; i++) idata[i] = (int64_t)((uint64_t)idata[i] + ik);
+		}
+	} else {
+		tug_Object* other = tuglib_checkpeer(T, 1, arr);
+		if (fdata) tuglib_f64()->add(fdata, tug_f64data(other), len);
+		else {
+			const int64_t* odata = tug_i64data(other);
+			for (size_t i = 0; i < len; i++) idata[i] = (int64_t)((uint64_t)idata[i] + (uint64_t)odata[i]);
+		}
+	}
+
+	tug_ret(T, arr);
+}
+
+static void __tuglib_array_fill(tug_Task* T) {
+	tug_Object* arr = tuglib_checkarray(T, 0);
+	tuglib_checkmutable(T, 0);
+	double num = tuglib_checknum(T, 1);
+	size_t len = tug_getlen(arr);
+
+	double* fdata = tug_f64data(arr);
+	if (fdata) {
+		for (size_t i = 0; i < len; i++) fdata[i] = num;
+	} else {
+		int64_t* idata = tug_i64data(arr);
+		int64_t inum = tuglib_toi64(num);
+		for (size_t i = 0; i < len; i++) idata[i] = inum;
+	}
+
+	tug_ret(T, arr);
+}
+
+// ascending, negative zero sorts before zero and nan goes to the ends by its sign
+static void __tuglib_array_sort(tug_Task* T) {
+	tug_Object* arr = tuglib_checkarray(T, 0);
+	tuglib_checkmutable(T, 0);
+	size_t len = tug_getlen(arr);
+
+	double* fdata = tug_f64data(arr);
+	if (fdata) tuglib_f64sort(fdata, len);
+	else tuglib_i64sort(tug_i64data(arr), len);
+
+	tug_ret(T, arr);
+}
+
+static void __tuglib_array_tolist(tug_Task* T) {
+	tug_Object* arr = tuglib_checkarray(T, 0);
+	size_t len = tug_getlen(arr);
+	double* fdata = tug_f64data(arr);
+	int64_t* idata = tug_i64data(arr);
+
+	tug_Object* list = tug_list();
+	for (size_t i = 0; i < len; i++) {
+		tug_listpush(list, tug_num(fdata ? fdata[i] : (double)idata[i]));
+	}
+
+	tug_ret(T, list);
+}
+
+static void __tuglib_buffer_new(tug_Task* T) {
+	long cap = tuglib_optlong(T, 0, 0);
+	if (cap < 0) tug_err(T, "buffer capacity can't be negative");
+
+	tug_ret(T, tug_buffer((size_t)cap));
+}
+
+static void __tuglib_buffer_append(tug_Task* T) {
+	tug_Object* buf = tuglib_checkbuffer(T, 0);
+	size_t argc = tug_getargc(T);
+	for (size_t i = 1; i < argc; i++) {
+		tug_Object* obj = tug_getarg(T, i);
+		if (obj == buf) tug_err(T, "can't append a buffer to itself");
+
+		tug_Object* str_obj = tuglib_tostr(obj);
+		size_t len;
+		const char* str = tug_getlstr(str_obj, &len);
+		tug_bufappend(buf, str, len);
+	}
+
+	tug_ret(T, buf);
+}
+
+static void __tuglib_buffer_appendf(tug_Task* T) {
+	tug_Object* buf = tuglib_checkbuffer(T, 0);
+	size_t fmt_len;
+	const char* fmt = tuglib_checklstr(T, 1, &fmt_len);
+
+	tuglib_appendf(T, buf, fmt, fmt_len, 2);
+	tug_ret(T, buf);
+}
+
+static void __tuglib_buffer_reserve(tug_Task* T) {
+	tug_Object* buf = tuglib_checkbuffer(T, 0);
+	long extra = tuglib_checklong(T, 1);
+	if (extra < 0) tug_err(T, "reserve size can't be negative");
+
+	tug_bufreserve(buf, (size_t)extra);
+	tug_ret(T, buf);
+}
+
+static void __tuglib_buffer_clear(tug_Task* T) {
+	tug_Object* buf = tuglib_checkbuffer(T, 0);
+	tug_bufclear(buf);
+	tug_ret(T, buf);
+}
+
+static void __tuglib_buffer_tostr(tug_Task* T) {
+	tug_Object* buf = tuglib_checkbuffer(T, 0);
+	tug_ret(T, tug_buftostr(buf));
+}
+
+// lazy pipelines: every adapter is a table whose '__next' pulls from its sources
+// only when asked, and a stage reading another stage calls its step directly
+#define TUGLIB_ITER_MAX 8
+
+enum {
+	TUGLIB_ITER_MAP,
+	TUGLIB_ITER_FILTER,
+	TUGLIB_ITER_TAKE,
+	TUGLIB_ITER_SKIP,
+	TUGLIB_ITER_ZIP,
+	TUGLIB_ITER_ENUMERATE,
+	TUGLIB_ITER_CHAIN,
+};
+
+typedef struct {
+	int kind;
+	// the sources, the function and zip's values are in the stage's uservalue list
+	// as well, which keeps them reachable and out of the scripts' hands
+	tug_Object* srcs;
+	tug_Object* fn;
+	tug_Object* held;
+	size_t n;
+	int done;
+} tuglib_Iter;
+
+static void tuglib_iter_free(tug_Object* stage) {
+	free(tug_getuserdata(stage));
+}
+
+#define tuglib_isstage(obj) (tug_gettype(obj) == TUG_TABLE && tug_getdeallocator(obj) == tuglib_iter_free)
+
+static int tuglib_iterstep(tug_Task* T, tuglib_Iter* it, tug_Object** out, size_t* n);
+
+static int tuglib_iterpull(tug_Task* T, tug_Object* src, tug_Object** out, size_t* n) {
+	if (tuglib_isstage(src)) return tuglib_iterstep(T, tug_getuserdata(src), out, n);
+	return tug_iternext(T, src, out, n);
+}
+
+// `*n` is the room in `out` going in and the number of values coming out
+static int tuglib_iterstep(tug_Task* T, tuglib_Iter* it, tug_Object** out, size_t* n) {
+	size_t cap = *n;
+	*n = 0;
+	if (it->done) return 0;
+
+	tug_Object* src = tug_listget(it->srcs, 0);
+	switch (it->kind) {
+		case TUGLIB_ITER_MAP: {
+			tug_Object* values[TUGLIB_ITER_MAX];
+			size_t c = TUGLIB_ITER_MAX;
+			if (!tuglib_iterpull(T, src, values, &c)) break;
+
+			tug_Object* res = tug_callv(T, it->fn, c, values);
+			if (tuglib_iserr(T)) return 0;
+			if (cap > 0) {
+				out[0] = res;
+				*n = 1;
+			}
+			return 1;
+		}
+		case TUGLIB_ITER_FILTER: {
+			while (1) {
+				size_t c = cap;
+				if (!tuglib_iterpull(T, src, out, &c)) break;
+
+				tug_Object* res = tug_callv(T, it->fn, c, out);
+				if (tuglib_iserr(T)) return 0;
+				if (tug_istrue(res)) {
+					*n = c;
+					return 1;
+				}
+			}
+		} break;
+		case TUGLIB_ITER_TAKE: {
+			if (it->n == 0) break;
+			it->n--;
+			*n = cap;
+			if (tuglib_iterpull(T, src, out, n)) return 1;
+		} break;
+		case TUGLIB_ITER_SKIP: {
+			tug_Object* values[TUGLIB_ITER_MAX];
+			for (; it->n > 0; it->n--) {
+				size_t c = TUGLIB_ITER_MAX;
+				if (!tuglib_iterpull(T, src, values, &c)) goto done;
+			}
+			*n = cap;
+			if (tuglib_iterpull(T, src, out, n)) return 1;
+		} break;
+		case TUGLIB_ITER_ZIP: {
+			size_t srcc = tug_getlen(it->srcs);
+			tug_Object* values[TUGLIB_ITER_MAX];
+			for (size_t i = 0; i < srcc; i++) {
+				size_t c = TUGLIB_ITER_MAX;
+				if (!tuglib_iterpull(T, tug_listget(it->srcs, i), values, &c)) goto done;
+				// a later source can run scripts, the values so far wait in the stage
+				tug_listset(it->held, i, c ? values[0] : tug_nil);
+			}
+			*n = srcc < cap ? srcc : cap;
+			for (size_t i = 0; i < *n; i++) {
+				out[i] = tug_listget(it->held, i);
+			}
+			return 1;
+		}
+		case TUGLIB_ITER_ENUMERATE: {
+			if (cap == 0) break;
+			size_t c = cap - 1;
+			if (!tuglib_iterpull(T, src, out + 1, &c)) break;
+			out[0] = tug_num((double)it->n++);
+			*n = c + 1;
+			return 1;
+		}
+		case TUGLIB_ITER_CHAIN: {
+			size_t srcc = tug_getlen(it->srcs);
+			for (; it->n < srcc; it->n++) {
+				*n = cap;
+				if (tuglib_iterpull(T, tug_listget(it->srcs, it->n), out, n)) return 1;
+				if (tuglib_iserr(T)) return 0;
+			}
+		} break;
+	}
+
+done:
+	*n = 0;
+	if (!tuglib_iserr(T)) it->done = 1;
+	return 0;
+}
+
+static void __tuglib_iter_next(tug_Task* T) {
+	tug_Object* stage = tuglib_checktable(T, 0);
+	if (!tuglib_isstage(stage)) tug_err(T, "argument #1 expected an iterator stage");
+
+	tug_Object* values[TUGLIB_ITER_MAX + 1];
+	size_t n = TUGLIB_ITER_MAX;
+	if (!tuglib_iterstep(T, tug_getuserdata(stage), values + 1, &n)) return;
+
+	values[0] = tug_true;
+	tug_retv(T, n + 1, values);
+}
+
+// the stage is returned right away so it stays reachable while '__iter' runs for
+// the sources, which are the arguments from `first` to `last`; NULL after an error
+static tug_Object* tuglib_newstage(tug_Task* T, int kind, size_t first, size_t last) {
+	tug_Object* stage = tug_table();
+	tug_ret(T, stage);
+
+	tuglib_Iter* it = malloc(sizeof(tuglib_Iter));
+	it->kind = kind;
+	it->srcs = tug_list();
+	it->fn = tug_nil;
+	it->held = tug_nil;
+	it->n = 0;
+	it->done = 0;
+	tug_Object* refs = tug_list();
+	tug_listpush(refs, it->srcs);
+	tug_setuservalue(stage, refs);
+	tug_setuserdata(stage, it);
+	tug_setdeallocator(stage, tuglib_iter_free);
+
+	tug_Object* meta = tug_table();
+	tug_setfield(meta, tug_conststr("__next"), tug_cfunc("__next", __tuglib_iter_next));
+	tug_setmetatable(stage, meta);
+
+	for (size_t i = first; i < last; i++) {
+		tug_Object* src = tug_iter(T, tug_getarg(T, i));
+		if (!src) return NULL;
+		tug_listpush(it->srcs, src);
+	}
+
+	return stage;
+}
+
+static void tuglib_fnstage(tug_Task* T, int kind) {
+	tuglib_checkany(T, 0);
+	tug_Object* fn = tuglib_checkany(T, 1);
+	tug_Object* stage = tuglib_newstage(T, kind, 0, 1);
+	if (!stage) return;
+
+	tuglib_Iter* it = tug_getuserdata(stage);
+	it->fn = fn;
+	tug_listpush(tug_getuservalue(stage), fn);
+}
+
+static void tuglib_countstage(tug_Task* T, int kind) {
+	tuglib_checkany(T, 0);
+	long n = tuglib_checklong(T, 1);
+	if (n < 0) tug_err(T, "count can't be negative");
+	tug_Object* stage = tuglib_newstage(T, kind, 0, 1);
+	if (!stage) return;
+
+	tuglib_Iter* it = tug_getuserdata(stage);
+	it->n = (size_t)n;
+}
+
+// `iter.map(src, f)` yields f of each step's values
+static void __tuglib_iter_map(tug_Task* T) {
+	tuglib_fnstage(T, TUGLIB_ITER_MAP);
+}
+
+// `iter.filter(src, f)` keeps the steps f says yes to
+static void __tuglib_iter_filter(tug_Task* T) {
+	tuglib_fnstage(T, TUGLIB_ITER_FILTER);
+}
+
+static void __tuglib_iter_take(tug_Task* T) {
+	tuglib_countstage(T, TUGLIB_ITER_TAKE);
+}
+
+static void __tuglib_iter_skip(tug_Task* T) {
+	tuglib_countstage(T, TUGLIB_ITER_SKIP);
+}
+
+// `iter.zip(a, b, ...)` yields the first value of every source until one runs out
+static void __tuglib_iter_zip(tug_Task* T) {
+	size_t argc = tug_getargc(T);
+	if (argc == 0) tuglib_checkany(T, 0);
+	if (argc > TUGLIB_ITER_MAX) tug_err(T, "too many sources to zip (max %d)", TUGLIB_ITER_MAX);
+	tug_Object* stage = tuglib_newstage(T, TUGLIB_ITER_ZIP, 0, argc);
+	if (!stage) return;
+
+	tuglib_Iter* it = tug_getuserdata(stage);
+	it->held = tug_list();
+	for (size_t i = 0; i < argc; i++) {
+		tug_listpush(it->held, tug_nil);
+	}
+	tug_listpush(tug_getuservalue(stage), it->held);
+}
+
+// `iter.enumerate(src)` puts a count from 0 before each step's values
+static void __tuglib_iter_enumerate(tug_Task* T) {
+	tuglib_checkany(T, 0);
+	tuglib_newstage(T, TUGLIB_ITER_ENUMERATE, 0, 1);
+}
+
+static void __tuglib_iter_chain(tug_Task* T) {
+	tuglib_newstage(T, TUGLIB_ITER_CHAIN, 0, tug_getargc(T));
+}
+
+// terminals run a pipeline, or anything else `for ... in` takes, to the end
+static tug_Object* tuglib_itersrc(tug_Task* T, tug_Object* keep) {
+	tug_Object* src = tug_iter(T, tuglib_checkany(T, 0));
+	if (src) tug_listpush(keep, src);
+
+	return src;
+}
+
+// steps with several values are collected as lists of them
+static void __tuglib_iter_collect(tug_Task* T) {
+	tug_Object* keep = tuglib_keep(T);
+	tug_Object* src = tuglib_itersrc(T, keep);
+	if (!src) return;
+	tug_Object* res = tug_list();
+	tug_listpush(keep, res);
+
+	tug_Object* values[TUGLIB_ITER_MAX];
+	size_t n = TUGLIB_ITER_MAX;
+	while (tuglib_iterpull(T, src, values, &n)) {
+		if (n == 1) tug_listpush(res, values[0]);
+		else if (n == 0) tug_listpush(res, tug_nil);
+		else {
+			tug_Object* step = tug_list();
+			for (size_t i = 0; i < n; i++) {
+				tug_listpush(step, values[i]);
+			}
+			tug_listpush(res, step);
+		}
+		n = TUGLIB_ITER_MAX;
+	}
+	if (tuglib_iserr(T)) return;
+
+	tug_ret(T, res);
+}
+
+// `iter.reduce(src, f, init?)` folds with f(acc, values...), starting from the
+// first step's value when there is no `init`
+static void __tuglib_iter_reduce(tug_Task* T) {
+	tug_Object* fn = tuglib_checkany(T, 1);
+	tug_Object* keep = tuglib_keep(T);
+	tug_Object* src = tuglib_itersrc(T, keep);
+	if (!src) return;
+
+	tug_Object* values[TUGLIB_ITER_MAX + 1];
+	size_t n = TUGLIB_ITER_MAX;
+	tug_Object* acc;
+	if (tuglib_isany(T, 2)) acc = tug_getarg(T, 2);
+	else if (tuglib_iterpull(T, src, values, &n)) acc = n ? values[0] : tug_nil;
+	else {
+		if (!tuglib_iserr(T)) tug_err(T, "reduce of an empty iterator with no initial value");
+		return;
+	}
+	tug_listpush(keep, acc);
+
+	n = TUGLIB_ITER_MAX;
+	while (tuglib_iterpull(T, src, values + 1, &n)) {
+		values[0] = acc;
+		acc = tug_callv(T, fn, n + 1, values);
+		if (tuglib_iserr(T)) return;
+		tug_listset(keep, 1, acc);
+		n = TUGLIB_ITER_MAX;
+	}
+	if (tuglib_iserr(T)) return;
+
+	tug_ret(T, acc);
+}
+
+static void __tuglib_iter_count(tug_Task* T) {
+	tug_Object* keep = tuglib_keep(T);
+	tug_Object* src = tuglib_itersrc(T, keep);
+	if (!src) return;
+
+	tug_Object* values[TUGLIB_ITER_MAX];
+	size_t n = TUGLIB_ITER_MAX;
+	size_t count = 0;
+	while (tuglib_iterpull(T, src, values, &n)) {
+		count++;
+		n = TUGLIB_ITER_MAX;
+	}
+	if (tuglib_iserr(T)) return;
+
+	tug_ret(T, tug_num((double)count));
+}
+
+static void tuglib_loadbuiltins(tug_Task* T) {
+	tug_setglobal(T, "print", tug_cfunc("print", __tuglib_print));
+	tug_setglobal(T, "tostr", tug_cfunc("tostr", __tuglib_tostr));
+	tug_setglobal(T, "type", tug_cfunc("type", __tuglib_type));
+	tug_setglobal(T, "setmetatable", tug_cfunc("setmetatable", __tuglib_setmetatable));
+	tug_setglobal(T, "getmetatable", tug_cfunc("getmetatable", __tuglib_getmetatable));
+	tug_setglobal(T, "len", tug_cfunc("len", __tuglib_len));
+	tug_setglobal(T, "error", tug_cfunc("error", __tuglib_error));
+	tug_setglobal(T, "pcall", tug_cfunc("pcall", __tuglib_pcall));
+	tug_setglobal(T, "tonum", tug_cfunc("tonum", __tuglib_tonum));
+	tug_setglobal(T, "assert", tug_cfunc("assert", __tuglib_assert));
+	tug_setglobal(T, "rawget", tug_cfunc("rawget", __tuglib_rawget));
+	tug_setglobal(T, "rawset", tug_cfunc("rawset", __tuglib_rawset));
+	tug_setglobal(T, "clock", tug_cfunc("clock", __tuglib_clock));
+	tug_setglobal(T, "next", tug_cfunc("next", __tuglib_next));
+	tug_setglobal(T, "freeze", tug_cfunc("freeze", __tuglib_freeze));
+	tug_setglobal(T, "isfrozen", tug_cfunc("isfrozen", __tuglib_isfrozen));
+	tug_setglobal(T, "ordered", tug_cfunc("ordered", __tuglib_ordered));
+	tug_setglobal(T, "range", tug_cfunc("range", __tuglib_range));
+
+	tug_Object* mathlib = tug_table();
+	tug_setfield(mathlib, tug_conststr("sin"), tug_cfunc("sin", __tuglib_sin));
+	tug_setfield(mathlib, tug_conststr("cos"), tug_cfunc("cos", __tuglib_cos));
+	tug_setfield(mathlib, tug_conststr("tan"), tug_cfunc("tan", __tuglib_tan));
+	tug_setfield(mathlib, tug_conststr("atan2"), tug_cfunc("atan2", __tuglib_atan2));
+	tug_setfield(mathlib, tug_conststr("asin"), tug_cfunc("asin", __tuglib_asin));
+	tug_setfield(mathlib, tug_conststr("acos"), tug_cfunc("acos", __tuglib_acos));
+	tug_setfield(mathlib, tug_conststr("sqrt"), tug_cfunc("sqrt", __tuglib_sqrt));
+	tug_setfield(mathlib, tug_conststr("pow"), tug_cfunc("pow", __tuglib_pow));
+	tug_setfield(mathlib, tug_conststr("hypot"), tug_cfunc("hypot", __tuglib_hypot));
+	tug_setfield(mathlib, tug_conststr("floor"), tug_cfunc("floor", __tuglib_floor));
+	tug_setfield(mathlib, tug_conststr("ceil"), tug_cfunc("ceil", __tuglib_ceil));
+	tug_setfield(mathlib, tug_conststr("round"), tug_cfunc("round", __tuglib_round));
+	tug_setfield(mathlib, tug_conststr("mod"), tug_cfunc("mod", __tuglib_mod));
 	tug_setfield(mathlib, tug_conststr("abs"), tug_cfunc("abs", __tuglib_abs));
 	tug_setfield(mathlib, tug_conststr("seed"), tug_cfunc("seed", __tuglib_seed));
 	tug_setfield(mathlib, tug_conststr("rand"), tug_cfunc("rand", __tuglib_rand));
@@ -840,6 +4053,7 @@ static void tuglib_loadbuiltins(tug_Task* T) {
 	tug_Object* strlib = tug_table();
 	tug_setfield(strlib, tug_conststr("sub"), tug_cfunc("sub", __tuglib_sub));
 	tug_setfield(strlib, tug_conststr("concat"), tug_cfunc("concat", __tuglib_concat));
+	tug_setfield(strlib, tug_conststr("join"), tug_cfunc("join", __tuglib_join));
 	tug_setfield(strlib, tug_conststr("trim"), tug_cfunc("trim", __tuglib_trim));
 	tug_setfield(strlib, tug_conststr("upper"), tug_cfunc("upper", __tuglib_upper));
 	tug_setfield(strlib, tug_conststr("lower"), tug_cfunc("lower", __tuglib_lower));
@@ -848,15 +4062,78 @@ static void tuglib_loadbuiltins(tug_Task* T) {
 	tug_setfield(strlib, tug_conststr("split"), tug_cfunc("split", __tuglib_split));
 	tug_setfield(strlib, tug_conststr("find"), tug_cfunc("find", __tuglib_str_find));
 	tug_setfield(strlib, tug_conststr("replace"), tug_cfunc("replace", __tuglib_str_replace));
+	tug_setfield(strlib, tug_conststr("count"), tug_cfunc("count", __tuglib_str_count));
+	tug_setfield(strlib, tug_conststr("format"), tug_cfunc("format", __tuglib_str_format));
+	tug_setfield(strlib, tug_conststr("match"), tug_cfunc("match", __tuglib_str_match));
+	tug_setfield(strlib, tug_conststr("gmatch"), tug_cfunc("gmatch", __tuglib_str_gmatch));
+	tug_setfield(strlib, tug_conststr("gsub"), tug_cfunc("gsub", __tuglib_str_gsub));
 	tug_setglobal(T, "str", strlib);
 	
 	tug_Object* listlib = tug_table();
 	tug_setfield(listlib, tug_conststr("push"), tug_cfunc("push", __tuglib_push));
 	tug_setfield(listlib, tug_conststr("pop"), tug_cfunc("pop", __tuglib_pop));
+	tug_setfield(listlib, tug_conststr("pushfront"), tug_cfunc("pushfront", __tuglib_pushfront));
+	tug_setfield(listlib, tug_conststr("popfront"), tug_cfunc("popfront", __tuglib_popfront));
 	tug_setfield(listlib, tug_conststr("insert"), tug_cfunc("insert", __tuglib_insert));
 	tug_setfield(listlib, tug_conststr("clear"), tug_cfunc("clear", __tuglib_clear));
 	tug_setfield(listlib, tug_conststr("unpack"), tug_cfunc("unpack", __tuglib_unpack));
+	tug_setfield(listlib, tug_conststr("sort"), tug_cfunc("sort", __tuglib_sort));
+	tug_setfield(listlib, tug_conststr("slice"), tug_cfunc("slice", __tuglib_list_slice));
 	tug_setglobal(T, "list", listlib);
+
+	tug_Object* maplib = tug_table();
+	tug_setfield(maplib, tug_conststr("new"), tug_cfunc("new", __tuglib_map_new));
+	tug_setfield(maplib, tug_conststr("assoc"), tug_cfunc("assoc", __tuglib_map_assoc));
+	tug_setfield(maplib, tug_conststr("dissoc"), tug_cfunc("dissoc", __tuglib_map_dissoc));
+	tug_setfield(maplib, tug_conststr("get"), tug_cfunc("get", __tuglib_map_get));
+	tug_setfield(maplib, tug_conststr("has"), tug_cfunc("has", __tuglib_map_has));
+	tug_setglobal(T, "map", maplib);
+
+	tug_Object* buflib = tug_table();
+	tug_setfield(buflib, tug_conststr("new"), tug_cfunc("new", __tuglib_buffer_new));
+	tug_setfield(buflib, tug_conststr("append"), tug_cfunc("append", __tuglib_buffer_append));
+	tug_setfield(buflib, tug_conststr("appendf"), tug_cfunc("appendf", __tuglib_buffer_appendf));
+	tug_setfield(buflib, tug_conststr("reserve"), tug_cfunc("reserve", __tuglib_buffer_reserve));
+	tug_setfield(buflib, tug_conststr("clear"), tug_cfunc("clear", __tuglib_buffer_clear));
+	tug_setfield(buflib, tug_conststr("tostr"), tug_cfunc("tostr", __tuglib_buffer_tostr));
+	tug_setglobal(T, "buffer", buflib);
+
+	tug_Object* utf8lib = tug_table();
+	tug_setfield(utf8lib, tug_conststr("len"), tug_cfunc("len", __tuglib_utf8_len));
+	tug_setfield(utf8lib, tug_conststr("valid"), tug_cfunc("valid", __tuglib_utf8_valid));
+	tug_setfield(utf8lib, tug_conststr("offset"), tug_cfunc("offset", __tuglib_utf8_offset));
+	tug_setfield(utf8lib, tug_conststr("codepoint"), tug_cfunc("codepoint", __tuglib_utf8_codepoint));
+	tug_setfield(utf8lib, tug_conststr("char"), tug_cfunc("char", __tuglib_utf8_char));
+	tug_setfield(utf8lib, tug_conststr("codes"), tug_cfunc("codes", __tuglib_utf8_codes));
+	tug_setglobal(T, "utf8", utf8lib);
+
+	tug_Object* arraylib = tug_table();
+	tug_setfield(arraylib, tug_conststr("f64"), tug_cfunc("f64", __tuglib_array_f64));
+	tug_setfield(arraylib, tug_conststr("i64"), tug_cfunc("i64", __tuglib_array_i64));
+	tug_setfield(arraylib, tug_conststr("push"), tug_cfunc("push", __tuglib_array_push));
+	tug_setfield(arraylib, tug_conststr("sum"), tug_cfunc("sum", __tuglib_array_sum));
+	tug_setfield(arraylib, tug_conststr("min"), tug_cfunc("min", __tuglib_array_min));
+	tug_setfield(arraylib, tug_conststr("max"), tug_cfunc("max", __tuglib_array_max));
+	tug_setfield(arraylib, tug_conststr("dot"), tug_cfunc("dot", __tuglib_array_dot));
+	tug_setfield(arraylib, tug_conststr("scale"), tug_cfunc("scale", __tuglib_array_scale));
+	tug_setfield(arraylib, tug_conststr("add"), tug_cfunc("add", __tuglib_array_add));
+	tug_setfield(arraylib, tug_conststr("fill"), tug_cfunc("fill", __tuglib_array_fill));
+	tug_setfield(arraylib, tug_conststr("sort"), tug_cfunc("sort", __tuglib_array_sort));
+	tug_setfield(arraylib, tug_conststr("tolist"), tug_cfunc("tolist", __tuglib_array_tolist));
+	tug_setglobal(T, "array", arraylib);
+
+	tug_Object* iterlib = tug_table();
+	tug_setfield(iterlib, tug_conststr("map"), tug_cfunc("map", __tuglib_iter_map));
+	tug_setfield(iterlib, tug_conststr("filter"), tug_cfunc("filter", __tuglib_iter_filter));
+	tug_setfield(iterlib, tug_conststr("take"), tug_cfunc("take", __tuglib_iter_take));
+	tug_setfield(iterlib, tug_conststr("skip"), tug_cfunc("skip", __tuglib_iter_skip));
+	tug_setfield(iterlib, tug_conststr("zip"), tug_cfunc("zip", __tuglib_iter_zip));
+	tug_setfield(iterlib, tug_conststr("enumerate"), tug_cfunc("enumerate", __tuglib_iter_enumerate));
+	tug_setfield(iterlib, tug_conststr("chain"), tug_cfunc("chain", __tuglib_iter_chain));
+	tug_setfield(iterlib, tug_conststr("collect"), tug_cfunc("collect", __tuglib_iter_collect));
+	tug_setfield(iterlib, tug_conststr("reduce"), tug_cfunc("reduce", __tuglib_iter_reduce));
+	tug_setfield(iterlib, tug_conststr("count"), tug_cfunc("count", __tuglib_iter_count));
+	tug_setglobal(T, "iter", iterlib);
 }
 
 static void tuglib_loadlibs(tug_Task* T) {